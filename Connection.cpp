@@ -6,6 +6,14 @@
 #include <cassert>
 #include <cstring>
 
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
 
@@ -13,14 +21,74 @@
 
 
 //---------------------------------
+//Turn off Nagle's algorithm, since game messages are small and latency-sensitive:
+// (writes are batched per-tick in send_buffer instead)
+static void set_nodelay(char const *where, SOCKET s) {
+	#ifdef _WIN32
+	BOOL one = TRUE;
+	int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast< const char * >(&one), sizeof(one));
+	#else
+	int one = 1;
+	int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	#endif
+	if (ret != 0) {
+		std::cerr << "[" << where << "] note: couldn't set TCP_NODELAY." << std::endl;
+	}
+}
+
+//Writing to a socket the peer has reset raises SIGPIPE, which by default would kill the whole
+// process (every match on every worker); sends pass MSG_NOSIGNAL, or, where that flag doesn't exist,
+// the socket is told not to raise it:
+static void set_nosigpipe(char const *where, SOCKET s) {
+	#ifdef SO_NOSIGPIPE
+	int one = 1;
+	if (setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one)) != 0) {
+		std::cerr << "[" << where << "] note: couldn't set SO_NOSIGPIPE." << std::endl;
+	}
+	#endif
+}
+
+//Write as much of a connection's send_buffer as the socket will take right now, in a single send():
+// returns true if the buffer was drained. (Errors are left for the next poll to report.)
+static bool send_now(Connection &c) {
+	if (c.socket == INVALID_SOCKET || c.send_buffer.empty()) return true;
+	#ifdef _WIN32
+	ssize_t ret = send(c.socket, c.send_buffer.data(), int(c.send_buffer.size()), MSG_DONTWAIT);
+	#else
+	ssize_t ret = send(c.socket, c.send_buffer.data(), c.send_buffer.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	#endif
+	if (ret > 0 && ret <= (ssize_t)c.send_buffer.size()) {
+		c.send_buffer.consume(ret);
+	}
+	return c.send_buffer.empty();
+}
+
+//Append received data to a buffer, keeping track of the allocation/copy cost:
+static void append_counted(ByteBuffer &to, char const *data, size_t size, PollStats &stats) {
+	size_t old_capacity = to.storage.capacity();
+	size_t old_head = to.head;
+	size_t old_stored = to.storage.size();
+	to.append(data, size);
+	if (to.storage.capacity() != old_capacity) {
+		stats.allocations += 1;
+		stats.bytes_copied += old_stored; //realloc moves existing contents
+	} else if (to.head != old_head) {
+		stats.bytes_copied += old_stored - old_head; //compaction moves unconsumed contents
+	}
+	stats.bytes_copied += size;
+}
+
 //Polling helper used by both server and client:
 void poll_connections(
 	char const *where,
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
 	double timeout,
+	PollStats &stats,
 	SOCKET listen_socket = INVALID_SOCKET) {
 
+	stats.polls += 1;
+
 	fd_set read_fds, write_fds;
 	FD_ZERO(&read_fds);
 	FD_ZERO(&write_fds);
@@ -34,7 +102,7 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != INVALID_SOCKET) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
@@ -71,7 +139,10 @@ void poll_connections(
 			#else
 			{
 			#endif
+				set_nodelay(where, got);
+				set_nosigpipe(where, got);
 				connections.emplace_back();
+				stats.allocations += 1;
 				connections.back().socket = got;
 				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
 				if (on_event) on_event(&connections.back(), Connection::OnOpen);
@@ -102,7 +173,7 @@ void poll_connections(
 			c.close();
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret > 0
-			c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
+			append_counted(c.recv_buffer, buffer, ret, stats);
 			if (on_event) on_event(&c, Connection::OnRecv);
 		}
 	}
@@ -115,11 +186,11 @@ void poll_connections(
 		#ifdef _WIN32
 		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
 		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
+		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
 		#endif
 		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
+			//~no problem~, but don't keep trying this connection
+			continue;
 		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
 			if (ret < 0) {
 				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
@@ -129,17 +200,184 @@ void poll_connections(
 			c.close();
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+			c.send_buffer.consume(ret);
 		}
 	}
 
 
 }
 
+#ifdef __linux__
+//---------------------------------
+//Polling helper used by servers with the epoll backend:
+// (sockets are registered edge-triggered, so every ready socket is read/written until EAGAIN)
+
+//(un)register a connection's interest in writability:
+static void epoll_want_write(char const *where, Server &server, Connection &c, bool want_write) {
+	if (c.want_write == want_write) return;
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET | (want_write ? EPOLLOUT : 0);
+	ev.data.ptr = &c;
+	if (epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c.socket, &ev) != 0) {
+		std::cerr << "[" << where << "] epoll_ctl(MOD) returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+		return;
+	}
+	c.want_write = want_write;
+}
+
+//write as much of a connection's send_buffer as the socket will take:
+// returns false if the connection was closed.
+static bool epoll_send(char const *where, Server &server, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	while (!c.send_buffer.empty()) {
+		ssize_t ret = send(c.socket, c.send_buffer.data(), c.send_buffer.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//socket is full; wait for EPOLLOUT:
+			epoll_want_write(where, server, c, true);
+			return true;
+		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
+			if (ret < 0) {
+				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+			} else {
+				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+			}
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			return false;
+		} else { //ret seems reasonable
+			c.send_buffer.consume(ret);
+		}
+	}
+	epoll_want_write(where, server, c, false);
+	return true;
+}
+
+//send data queued (by Connection::send_raw) since the last call:
+static void epoll_flush_send_queue(char const *where, Server &server, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	//NOTE: on_event may queue more data, so don't iterate the queue directly:
+	static thread_local std::vector< Connection * > queue;
+	queue.clear();
+	std::swap(queue, server.send_queue);
+	for (Connection *c : queue) {
+		if (c->socket == INVALID_SOCKET || c->want_write) continue;
+		epoll_send(where, server, *c, on_event);
+	}
+}
+
+void poll_connections_epoll(
+	char const *where,
+	Server &server,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout) {
+
+	server.stats.polls += 1;
+
+	//anything queued between polls can go out right away:
+	epoll_flush_send_queue(where, server, on_event);
+
+	const uint32_t MaxEvents = 256;
+	static thread_local struct epoll_event *events = new struct epoll_event[MaxEvents];
+
+	int count = epoll_wait(server.epoll_fd, events, MaxEvents, int(std::lround(timeout * 1000.0)));
+	if (count < 0) {
+		if (errno != EINTR) {
+			std::cerr << "[" << where << "] epoll_wait returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+		}
+		return;
+	}
+
+	const uint32_t BufferSize = 20000;
+	static thread_local char *buffer = new char[BufferSize];
+
+	for (int i = 0; i < count; ++i) {
+		if (events[i].data.ptr == nullptr) {
+			//add new connections as needed:
+			while (true) {
+				SOCKET got = accept4(server.listen_socket, NULL, NULL, SOCK_NONBLOCK);
+				if (got == INVALID_SOCKET) {
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						std::cerr << "[" << where << "] accept() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+					}
+					break;
+				}
+				set_nodelay(where, got);
+				set_nosigpipe(where, got);
+				server.connections.emplace_back();
+				server.stats.allocations += 1;
+				Connection &c = server.connections.back();
+				c.socket = got;
+				c.send_queue = &server.send_queue;
+				c.closed_list = &server.closed;
+
+				struct epoll_event ev;
+				memset(&ev, 0, sizeof(ev));
+				ev.events = EPOLLIN | EPOLLET;
+				ev.data.ptr = &c;
+				if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, got, &ev) != 0) {
+					std::cerr << "[" << where << "] epoll_ctl(ADD) returned error " << errno << "(" << strerror(errno) << "), dropping client." << std::endl;
+					c.close();
+					continue;
+				}
+				std::cerr << "[" << where << "] client connected on " << c.socket << "." << std::endl; //INFO
+				if (on_event) on_event(&c, Connection::OnOpen);
+			}
+			continue;
+		}
+
+		Connection &c = *reinterpret_cast< Connection * >(events[i].data.ptr);
+		//connection may have been closed by an earlier event this poll:
+		if (c.socket == INVALID_SOCKET) continue;
+
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+			//read until the socket runs dry:
+			bool got_data = false;
+			bool problem = false;
+			while (true) {
+				ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
+				if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					//~no problem~ but no more data
+					break;
+				} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
+					//~problem~ so remove connection (after delivering any data already read)
+					if (ret == 0) {
+						std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+					} else if (ret < 0) {
+						std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+					} else {
+						std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+					}
+					problem = true;
+					break;
+				} else { //ret > 0
+					append_counted(c.recv_buffer, buffer, ret, server.stats);
+					got_data = true;
+				}
+			}
+			if (got_data) {
+				if (on_event) on_event(&c, Connection::OnRecv);
+				if (c.socket == INVALID_SOCKET) continue;
+			}
+			if (problem) {
+				c.close();
+				if (on_event) on_event(&c, Connection::OnClose);
+				continue;
+			}
+		}
+
+		if ((events[i].events & EPOLLOUT) && c.want_write) {
+			epoll_send(where, server, c, on_event);
+		}
+	}
+
+	//send any replies queued by the callbacks:
+	epoll_flush_send_queue(where, server, on_event);
+}
+#endif
+
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, Backend backend_) : backend(backend_) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -227,10 +465,136 @@ Server::Server(std::string const &port) {
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	if (backend == Epoll) {
+		#ifdef __linux__
+		//listen socket is non-blocking so that edge-triggered accepts can run until EAGAIN:
+		int flags = fcntl(listen_socket, F_GETFL, 0);
+		if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to make listen socket non-blocking");
+		}
+
+		epoll_fd = epoll_create1(0);
+		if (epoll_fd < 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+
+		//listen socket is registered once, with a null data pointer to tell it apart from connections:
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = nullptr;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &ev) != 0) {
+			::close(epoll_fd);
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to add listen socket to epoll instance");
+		}
+		#else
+		closesocket(listen_socket);
+		throw std::runtime_error("Server::Epoll backend is only available on linux.");
+		#endif
+	}
+}
+
+Server::Server(Backend backend_) : backend(backend_) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	if (backend == Epoll) {
+		#ifdef __linux__
+		epoll_fd = epoll_create1(0);
+		if (epoll_fd < 0) {
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+		#else
+		throw std::runtime_error("Server::Epoll backend is only available on linux.");
+		#endif
+	}
+}
+
+Connection *Server::adopt(SOCKET socket) {
+	set_nodelay("Server::adopt", socket);
+	set_nosigpipe("Server::adopt", socket);
+	connections.emplace_back();
+	stats.allocations += 1;
+	Connection &c = connections.back();
+	c.socket = socket;
+
+	#ifdef _WIN32
+	unsigned long one = 1;
+	if (0 != ioctlsocket(socket, FIONBIO, &one)) {
+		std::cerr << "[Server::adopt] couldn't make socket non-blocking, dropping client." << std::endl;
+		c.close();
+		return nullptr;
+	}
+	#endif
+
+	#ifdef __linux__
+	if (backend == Epoll) {
+		c.send_queue = &send_queue;
+		c.closed_list = &closed;
+
+		int flags = fcntl(socket, F_GETFL, 0);
+		if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+			std::cerr << "[Server::adopt] couldn't make socket non-blocking, dropping client." << std::endl;
+			c.close();
+			return nullptr;
+		}
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = &c;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &ev) != 0) {
+			std::cerr << "[Server::adopt] epoll_ctl(ADD) returned error " << errno << "(" << strerror(errno) << "), dropping client." << std::endl;
+			c.close();
+			return nullptr;
+		}
+	}
+	#endif
+
+	return &c;
+}
+
+Server::~Server() {
+	#ifdef __linux__
+	if (epoll_fd >= 0) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	#ifdef __linux__
+	if (backend == Epoll) {
+		poll_connections_epoll("Server::poll", *this, on_event, timeout);
+
+		//reap closed clients (only those closed since the last poll need to be found):
+		if (!closed.empty()) {
+			std::sort(closed.begin(), closed.end());
+			//(a callback may have queued data on a connection it then closed; don't leave that pointer behind)
+			send_queue.erase(std::remove_if(send_queue.begin(), send_queue.end(), [this](Connection *c){
+				return std::binary_search(closed.begin(), closed.end(), c);
+			}), send_queue.end());
+			connections.remove_if([this](Connection const &c){
+				return std::binary_search(closed.begin(), closed.end(), &c);
+			});
+			closed.clear();
+		}
+		return;
+	}
+	#endif
+
+	poll_connections("Server::poll", connections, on_event, timeout, stats, listen_socket);
 
 	//reap closed clients:
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
@@ -242,6 +606,22 @@ void Server::poll(std::function< void(Connection *, Connection::Event event) > c
 	}
 }
 
+void Server::flush() {
+	#ifdef __linux__
+	if (backend == Epoll) {
+		for (Connection *c : send_queue) {
+			if (c->want_write) continue; //already waiting on EPOLLOUT
+			if (!send_now(*c)) epoll_want_write("Server::flush", *this, *c, true);
+		}
+		send_queue.clear();
+		return;
+	}
+	#endif
+	for (auto &c : connections) {
+		send_now(c);
+	}
+}
+
 Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
 	#ifdef _WIN32
 	{ //init winsock:
@@ -297,6 +677,8 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			}
 			std::cout << "success!" << std::endl;
 
+			set_nodelay("Client::Client", s);
+			set_nosigpipe("Client::Client", s);
 			connection.socket = s;
 			break;
 		}
@@ -311,6 +693,9 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, INVALID_SOCKET);
+	poll_connections("Client::poll", connections, on_event, timeout, stats, INVALID_SOCKET);
 }
 
+void Client::flush() {
+	send_now(connection);
+}
@@ -27,6 +27,14 @@ typedef int ssize_t;
 #include <unistd.h>
 #include <netdb.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //(e.g., on macOS; sockets are given SO_NOSIGPIPE instead)
+#endif
+
 #define closesocket close
 typedef int SOCKET;
 constexpr const SOCKET INVALID_SOCKET = -1;
@@ -37,6 +45,7 @@ constexpr const SOCKET INVALID_SOCKET = -1;
 #include <list>
 #include <string>
 #include <functional>
+#include <cassert>
 
 /*
  * Connection is a simple wrapper around a TCP socket connection.
@@ -52,7 +61,7 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
+				std::vector< char > data(connection->recv_buffer.begin(), connection->recv_buffer.end());
 				connection->recv_buffer.clear();
 				//send to other connections:
 
@@ -78,8 +87,60 @@ int main(int argc, char **argv) {
  */
 
 
+//Growable queue of bytes, appended at the back and consumed from the front:
+// (consumed bytes are skipped with a read cursor and only compacted away once
+//  they make up at least half the storage, so draining k messages is linear)
+struct ByteBuffer {
+	//span-style access to the unconsumed bytes:
+	char const *data() const { return storage.data() + head; }
+	char *data() { return storage.data() + head; }
+	size_t size() const { return storage.size() - head; }
+	bool empty() const { return storage.size() == head; }
+	char const *begin() const { return data(); }
+	char const *end() const { return storage.data() + storage.size(); }
+	char operator[](size_t i) const { return storage[head + i]; }
+
+	//add bytes to the back:
+	void append(void const *bytes, size_t count) {
+		if (head != 0 && storage.size() + count > storage.capacity() && head >= storage.size() / 2) {
+			//compact instead of growing:
+			storage.erase(storage.begin(), storage.begin() + head);
+			head = 0;
+		}
+		storage.insert(storage.end(), reinterpret_cast< char const * >(bytes), reinterpret_cast< char const * >(bytes) + count);
+	}
+
+	//remove bytes from the front:
+	void consume(size_t count) {
+		assert(count <= size());
+		head += count;
+		if (head == storage.size()) clear();
+	}
+
+	void clear() {
+		storage.clear();
+		head = 0;
+	}
+
+	//internals:
+	std::vector< char > storage;
+	size_t head = 0; //index of first unconsumed byte in storage
+};
+
+//Counters kept by Server/Client so that the cost of polling can be checked:
+// (an idle poll should leave 'allocations' and 'bytes_copied' unchanged; 'bench poll' checks this,
+//  along with the process's actual heap allocations)
+struct PollStats {
+	uint64_t polls = 0; //number of calls to poll()
+	uint64_t allocations = 0; //heap allocations made while polling (new connections, buffer growth)
+	uint64_t bytes_copied = 0; //bytes copied into connection buffers while polling (including reallocation/compaction)
+};
+
 //Thin wrapper around a (polling-based) TCP socket connection:
 struct Connection {
+	Connection() = default;
+	Connection(Connection const &) = delete; //connections own a socket and (potentially large) buffers; never copy them
+
 	//Helper that will append any type to the send buffer:
 	template< typename T >
 	void send(T const &t) {
@@ -87,7 +148,8 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		if (send_buffer.empty() && size != 0 && send_queue) send_queue->emplace_back(this);
+		send_buffer.append(data, size);
 	}
 
 	//Call 'close' to mark a connection for discard:
@@ -95,6 +157,7 @@ struct Connection {
 		if (socket != INVALID_SOCKET) {
 			::closesocket(socket);
 			socket = INVALID_SOCKET;
+			if (closed_list) closed_list->emplace_back(this);
 		}
 	}
 
@@ -102,12 +165,20 @@ struct Connection {
 	explicit operator bool() { return socket != INVALID_SOCKET; }
 
 	//To send data over a connection, append it to send_buffer:
-	std::vector< char > send_buffer;
+	ByteBuffer send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< char > recv_buffer;
+	// (use recv_buffer.consume() to discard data once it has been handled)
+	ByteBuffer recv_buffer;
 
 	//internals:
 	SOCKET socket = INVALID_SOCKET;
+	//(epoll backend) owning server's list of connections that have just started to have data to send:
+	std::vector< Connection * > *send_queue = nullptr;
+	//(epoll backend) owning server's list of connections closed since the last reap:
+	// (so closing any connection -- not just the one a callback was given -- gets it reaped)
+	std::vector< Connection * > *closed_list = nullptr;
+	//(epoll backend) true if the socket is currently registered for EPOLLOUT:
+	bool want_write = false;
 
 	enum Event {
 		OnOpen,
@@ -117,7 +188,20 @@ struct Connection {
 };
 
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	//Which OS facility is used to wait for socket activity:
+	enum Backend {
+		Select, //portable; rebuilds fd_sets each poll, limited to FD_SETSIZE sockets
+		Epoll //linux only; edge-triggered, cost proportional to the number of active sockets
+	};
+
+	Server(std::string const &port, Backend backend = Select); //pass the port number to listen on, as a string (servname, really)
+	explicit Server(Backend backend); //server without a listen socket; connections are added with adopt()
+	~Server();
+
+	//adopt() takes ownership of an already-connected socket (e.g., accepted on another thread):
+	// returns the new connection, or nullptr if it couldn't be added (in which case the socket is closed).
+	// (no OnOpen event is generated; the caller already knows about the connection)
+	Connection *adopt(SOCKET socket);
 
 	//poll() updates the list of active connections and provides information to your callbacks:
 	void poll(
@@ -125,8 +209,21 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//flush() immediately writes everything queued in send_buffers (one send() per connection).
+	// poll() also writes queued data, so calling flush() is only needed to get data generated
+	// after the last poll() of a tick onto the wire without waiting for the next poll().
+	void flush();
+
 	std::list< Connection > connections;
 	SOCKET listen_socket = INVALID_SOCKET;
+
+	PollStats stats;
+
+	//internals:
+	Backend backend = Select;
+	int epoll_fd = -1; //(epoll backend) epoll instance watching listen_socket and all connections
+	std::vector< Connection * > send_queue; //(epoll backend) connections which got data to send since the last flush
+	std::vector< Connection * > closed; //(epoll backend) connections closed since the last reap (see Connection::closed_list)
 };
 
 
@@ -139,6 +236,11 @@ struct Client {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//flush() immediately writes everything queued in connection.send_buffer (see Server::flush):
+	void flush();
+
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+
+	PollStats stats;
 };
@@ -0,0 +1,34 @@
+#include "Entities.hpp"
+
+#include <cassert>
+
+uint32_t Entities::create() {
+	uint32_t i;
+	if (free_head < free_indices.size()) {
+		i = free_indices[free_head];
+		free_head += 1;
+		//(compact the queue once most of it has been used)
+		if (free_head > 64 && free_head * 2 > free_indices.size()) {
+			free_indices.erase(free_indices.begin(), free_indices.begin() + free_head);
+			free_head = 0;
+		}
+	} else {
+		if (generations.empty()) generations.emplace_back(0); //index 0 is never used
+		i = uint32_t(generations.size());
+		assert(i <= IndexMask && "ran out of entity indices");
+		generations.emplace_back(0);
+		if (alive_bits.size() * 64 <= i) alive_bits.emplace_back(0);
+	}
+	alive_bits[i / 64] |= (uint64_t(1) << (i % 64));
+	count += 1;
+	return (generations[i] << IndexBits) | i;
+}
+
+void Entities::destroy(uint32_t id) {
+	if (!alive(id)) return;
+	uint32_t i = index(id);
+	alive_bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+	generations[i] = (generations[i] + 1) & (0xffffffffU >> IndexBits);
+	free_indices.emplace_back(i);
+	count -= 1;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+ * Entities hands out entity ids and remembers which are alive.
+ *
+ * An id is a dense index (low IndexBits bits) plus a generation (high
+ * bits), bumped each time an index is reused, so an id held after its
+ * entity was destroyed never matches a newer entity in the same slot.
+ * The first entity created is id 1 (index 0 is never used, so 0 means
+ * "none"), and ids come out as 1, 2, 3, ... until one is destroyed -- which
+ * is why clients and the server agree on animal ids without sending them.
+ *
+ * Liveness is one bit per index, so checks and iteration are cheap, and
+ * per-entity data can live in a flat EntityArray indexed the same way:
+
+Entities animal_ids;
+EntityArray< Scene::Object * > animal_objects;
+uint32_t id = animal_ids.create();
+animal_objects[id] = object;
+...
+if (animal_ids.alive(target)) animal_ids.destroy(target);
+animal_ids.for_each([&](uint32_t id){
+	draw(animal_objects[id]);
+});
+
+ */
+
+struct Entities {
+	static constexpr const uint32_t IndexBits = 24; //(up to ~16 million entities at once)
+	static constexpr const uint32_t IndexMask = (1U << IndexBits) - 1;
+
+	static uint32_t index(uint32_t id) { return id & IndexMask; }
+	static uint32_t generation(uint32_t id) { return id >> IndexBits; }
+
+	//new id (reusing the oldest free index, if any):
+	uint32_t create();
+	//mark 'id' dead and free its index (does nothing if it isn't alive):
+	void destroy(uint32_t id);
+
+	bool alive(uint32_t id) const {
+		uint32_t i = index(id);
+		if (i >= generations.size()) return false;
+		return ((alive_bits[i / 64] >> (i % 64)) & 1) && generations[i] == generation(id);
+	}
+
+	//number of living entities:
+	size_t size() const { return count; }
+
+	//call 'f(id)' for every living entity, in index order:
+	template< typename F >
+	void for_each(F const &f) const {
+		for (uint32_t w = 0; w < alive_bits.size(); ++w) {
+			uint64_t bits = alive_bits[w];
+			while (bits) {
+				uint32_t i = w * 64 + lowest_bit(bits);
+				bits &= bits - 1;
+				f((generations[i] << IndexBits) | i);
+			}
+		}
+	}
+
+	//internals:
+	static uint32_t lowest_bit(uint64_t bits) { //(index of the lowest set bit; 'bits' must not be zero)
+		#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward64(&i, bits);
+		return uint32_t(i);
+		#else
+		return uint32_t(__builtin_ctzll(bits));
+		#endif
+	}
+	std::vector< uint64_t > alive_bits; //bit i: index i is alive
+	std::vector< uint32_t > generations; //current generation of each index (index 0 unused)
+	std::vector< uint32_t > free_indices; //dead indices, waiting for reuse (used as a queue)
+	size_t free_head = 0; //first entry of free_indices not yet reused
+	size_t count = 0;
+};
+
+//Per-entity data, in a flat array indexed by Entities::index(id):
+// (the slot for a dead id holds whatever was last put there; check Entities::alive first)
+template< typename T >
+struct EntityArray {
+	T &operator[](uint32_t id) {
+		uint32_t i = Entities::index(id);
+		if (i >= data.size()) data.resize(i + 1, T());
+		return data[i];
+	}
+	T const &operator[](uint32_t id) const {
+		static T const none = T();
+		uint32_t i = Entities::index(id);
+		return (i < data.size() ? data[i] : none);
+	}
+
+	std::vector< T > data;
+};
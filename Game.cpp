@@ -1,5 +1,8 @@
 #include "Game.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 void Game::update(float time) {
 	ball += ball_velocity * time;
 	if (ball.x >= 0.5f * FrameWidth - BallRadius) {
@@ -37,44 +40,106 @@ void Game::update(float time) {
 	do_edge(glm::vec2(paddle.x + 0.5f * PaddleWidth, paddle.y), glm::vec2(paddle.x - 0.5f * PaddleWidth, paddle.y));
 
     // new line
-    {  // if arrow keys are pressed, move your character (hunter or wolf)
-        float speed = 2.0f;
-        float dist = time * speed;
-        if (identity.is_hunter) {
-            if (controls.move_up) {
-                crosshair.y += dist;
-            }
-            if (controls.move_down) {
-                crosshair.y -= dist;
-            }
-            if (controls.move_right) {
-                crosshair.x += dist;
-            }
-            if (controls.move_left) {
-                crosshair.x -= dist;
-            }
-        } else if (identity.is_wolf) {
-            if (controls.move_up) {
-                wolf.y += dist;
-            }
-            if (controls.move_down) {
-                wolf.y -= dist;
-            }
-            if (controls.move_right) {
-                wolf.x += dist;
-            }
-            if (controls.move_left) {
-                wolf.x -= dist;
-            }
-        }
+    // if arrow keys are pressed, move your character (hunter or wolf)
+    if (identity.is_hunter) {
+        move(crosshair, controls, time);
+    } else if (identity.is_wolf) {
+        move(wolf, controls, time);
+    }
+}
+
+void Game::step_herd(float time, Jobs *jobs) {
+    herd.step(time, jobs);
+    herd.ids.for_each([this](uint32_t id) {
+        uint32_t i = Entities::index(id);
+        if (herd.vx[i] != 0.0f || herd.vy[i] != 0.0f) animals.insert(id, herd.position(id));
+    });
+}
+
+void Game::move(glm::vec2 &at, Controls const &controls, float time) {
+    float dist = time * PlayerSpeed;
+    if (controls.move_up) {
+        at.y += dist;
+    }
+    if (controls.move_down) {
+        at.y -= dist;
+    }
+    if (controls.move_right) {
+        at.x += dist;
+    }
+    if (controls.move_left) {
+        at.x -= dist;
+    }
+    // stay on the playfield
+    at.x = std::max(-0.5f * FrameWidth, std::min(0.5f * FrameWidth, at.x));
+    at.y = std::max(-0.5f * FrameHeight, std::min(0.5f * FrameHeight, at.y));
+}
+
+uint8_t Game::Controls::bits() const {
+    return (move_left ? 1 : 0) | (move_right ? 2 : 0) | (move_up ? 4 : 0) | (move_down ? 8 : 0);
+}
 
+void Game::Controls::set_bits(uint8_t bits) {
+    move_left = (bits & 1) != 0;
+    move_right = (bits & 2) != 0;
+    move_up = (bits & 4) != 0;
+    move_down = (bits & 8) != 0;
+}
+
+void Game::tick(uint8_t hunter_input, uint8_t wolf_input) {
+    Controls hunter_controls, wolf_controls;
+    hunter_controls.set_bits(hunter_input);
+    wolf_controls.set_bits(wolf_input);
+    move(crosshair, hunter_controls, TickDt);
+    move(wolf, wolf_controls, TickDt);
+    if (herd.ids.alive(wolf_id)) {
+        herd.set_position(wolf_id, wolf);
+        animals.insert(wolf_id, wolf);
+    }
+    // attacks, hunter's first (so both peers resolve a shared target the same way)
+    if (hunter_input & Controls::Attack) {
+        uint32_t target = nearest_prey(crosshair);
+        if (target) herd.remove(target);
     }
+    if ((wolf_input & Controls::Attack) && herd.ids.alive(wolf_id)) {
+        uint32_t target = nearest_prey(wolf, wolf_id);
+        if (target) herd.remove(target);
+    }
+    step_herd(TickDt);
+}
+
+uint32_t Game::hash() const {
+    //FNV-1a, a 32-bit word at a time, over the state:
+    uint32_t h = 2166136261U;
+    auto add = [&h](void const *data, size_t size) {
+        unsigned char const *bytes = reinterpret_cast< unsigned char const * >(data);
+        for (size_t i = 0; i + 4 <= size; i += 4) {
+            uint32_t word;
+            std::memcpy(&word, bytes + i, 4);
+            h = (h ^ word) * 16777619U;
+        }
+    };
+    add(&crosshair, sizeof(crosshair));
+    add(&wolf, sizeof(wolf));
+    add(&herd.tick, sizeof(herd.tick));
+    add(herd.ids.alive_bits.data(), herd.ids.alive_bits.size() * sizeof(uint64_t));
+    add(herd.x.data(), herd.x.size() * sizeof(float));
+    add(herd.y.data(), herd.y.size() * sizeof(float));
+    add(herd.vx.data(), herd.vx.size() * sizeof(float));
+    add(herd.vy.data(), herd.vy.size() * sizeof(float));
+    add(herd.random.data(), herd.random.size() * sizeof(uint32_t));
+    return h;
+}
 
+bool Game::in_reach(glm::vec2 const &from, uint32_t target, float slack) const {
+    if (!herd.ids.alive(target)) return false;
+    glm::vec2 at;
+    if (!animals.find(target, &at)) return false;
+    return glm::distance(from, at) < AttackRange + slack;
 }
 
-// game state is updated, need to send new information to server
-bool Game::need_to_send() {
-    return controls.move_up || controls.move_down ||
-           controls.move_left || controls.move_right ||
-           try_attack.first;
+uint32_t Game::nearest_prey(glm::vec2 const &from, uint32_t ignore) const {
+    return animals.nearest(from, AttackRange, [&](uint32_t id) {
+        return id != ignore && herd.ids.alive(id);
+    });
 }
@@ -1,20 +1,22 @@
 #pragma once
 
+#include "Herd.hpp"
+#include "SpatialHash.hpp"
+
 #include <glm/glm.hpp>
 
-#include <set>
+#include <cstdint>
+#include <utility>
 
 struct Game {
 	glm::vec2 paddle = glm::vec2(0.0f,-3.0f);
 	glm::vec2 ball = glm::vec2(0.0f, 0.0f);
     glm::vec2 ball_velocity = glm::vec2(0.0f,-2.0f);
 
-    glm::vec2 cow;
-    glm::vec2 pig;
-    glm::vec2 sheep;
     glm::vec2 wolf;
     glm::vec2 crosshair;
 
+	//advance the local player (crosshair if hunter, wolf if wolf) by 'controls':
 	void update(float time);
 
 	static constexpr const float FrameWidth = 10.0f;
@@ -22,24 +24,61 @@ struct Game {
 	static constexpr const float PaddleWidth = 2.0f;
 	static constexpr const float PaddleHeight = 0.4f;
 	static constexpr const float BallRadius = 0.5f;
+	static constexpr const float PlayerSpeed = 2.0f;
+	static constexpr const float AttackRange = 1.0f; //attacks hit animals closer than this to the crosshair/wolf
 
-    struct {
+	//players move in fixed steps of TickDt, one Protocol::Input tick per step (same on server and clients):
+	static constexpr const uint32_t TickRate = 60;
+	static constexpr const float TickDt = 1.0f / TickRate;
+
+    struct Controls {
         bool move_left = false;
         bool move_right = false;
         bool move_up = false;
         bool move_down = false;
+
+        //packed form, as sent in Protocol::Input:
+        uint8_t bits() const;
+        void set_bits(uint8_t bits);
+
+        //input bit above bits() (only in lockstep, see tick()): attack the nearest animal
+        static constexpr const uint8_t Attack = 0x10;
     } controls;
 
+    //move a player position by 'controls' for 'time' seconds (staying within FrameWidth x FrameHeight):
+    static void move(glm::vec2 &at, Controls const &controls, float time);
+
+    //------ lockstep (see Lockstep.hpp) ------
+    //one TickDt step of the whole game from both players' inputs (Controls::bits(), plus Controls::Attack):
+    // the same inputs from the same state give bit-identical results on every peer
+    void tick(uint8_t hunter_input, uint8_t wolf_input);
+    //hash of everything tick() changes (players, herd), for comparing peers' states:
+    uint32_t hash() const;
+
     struct {
         bool is_hunter = false;
         bool is_wolf = false;
     } identity;
 
-    // id of living animals
-    std::set< uint32_t > living_animal;
+    //------ animals ------
+    //every animal, wolf included (ids 1 .. animal count, in scene order; the wolf's position is kept at 'wolf'):
+    // the herd wanders identically on the server and clients as long as both step it once per server tick
+    // from the placement (herd.tick tracks the tick it is at)
+    static constexpr const uint32_t HerdSeed = 0x466;
+    Herd herd = Herd(glm::vec2(-0.5f * FrameWidth, -0.5f * FrameHeight), glm::vec2(0.5f * FrameWidth, 0.5f * FrameHeight), HerdSeed);
+    uint32_t wolf_id = 0; //animal id of the wolf
+
+    //move the herd for 'time' seconds (keeping 'animals' up to date), on 'jobs' if given:
+    void step_herd(float time, Jobs *jobs = nullptr);
+
+    //animal positions, for hit-testing (and validating attacks on the server):
+    // every animal placed, living or dead
+    SpatialHash animals = SpatialHash(AttackRange);
 
-    //------ anything is updated? ------
-    bool need_to_send();
+    //is living animal 'target' within AttackRange (+ 'slack') of 'from'?
+    bool in_reach(glm::vec2 const &from, uint32_t target, float slack = 0.0f) const;
+    //nearest living animal within AttackRange of 'from', other than 'ignore' (or 0 if there is none):
+    uint32_t nearest_prey(glm::vec2 const &from, uint32_t ignore = 0) const;
 
     //------ try to kill an animal? ------
     //       yes/no  target id
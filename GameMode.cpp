@@ -11,6 +11,9 @@
 #include "compile_program.hpp" //helper to compile opengl shader programs
 #include "draw_text.hpp" //helper to... um.. draw text
 #include "vertex_color_program.hpp"
+#include "vertex_color_instanced_program.hpp"
+#include "Protocol.hpp"
+#include "Snapshot.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -20,6 +23,8 @@
 #include <cstddef>
 #include <random>
 #include <queue>
+#include <limits>
+#include <cmath>
 
 #define DEBUG
 #ifdef DEBUG
@@ -37,6 +42,17 @@ Load< GLuint > meshes_for_vertex_color_program(LoadTagDefault, [](){
 	return new GLuint(meshes->make_vao_for_program(vertex_color_program->program));
 });
 
+//the animals' matrices, refilled every frame (see Scene::HerdLook):
+Load< GLuint > herd_instance_buffer(LoadTagDefault, [](){
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	return new GLuint(buffer);
+});
+
+Load< GLuint > meshes_for_vertex_color_instanced_program(LoadTagDefault, [](){
+	return new GLuint(meshes->make_vao_for_program(vertex_color_instanced_program->program, *herd_instance_buffer));
+});
+
 Load< Sound::Sample > sheep_sound(LoadTagDefault, [](){
 	return new Sound::Sample(data_path("sheep.wav"));
 });
@@ -57,12 +73,17 @@ Load< Sound::Sample > shotgun_sound(LoadTagDefault, [](){
 	return new Sound::Sample(data_path("shotgun.wav"));
 });
 
-auto start_with = [](std::string& target, std::string to_match) -> bool {
-    return target.find(to_match) == 0;
-};
-
 // new line
-std::map< uint32_t, Scene::Object* > animal_list;
+Scene::HerdLook herd_look; //how the animals (moved out of the scene into Game::herd) are drawn
+
+//species of an animal named (or with a mesh named) 'name' -- "Cow", "Pig.001", ... -- or Herd::Unknown:
+static Herd::Species species_named(std::string const &name) {
+    if (name.compare(0, 3, "Cow") == 0) return Herd::Cow;
+    if (name.compare(0, 3, "Pig") == 0) return Herd::Pig;
+    if (name.compare(0, 5, "Sheep") == 0) return Herd::Sheep;
+    if (name.compare(0, 4, "Wolf") == 0) return Herd::Wolf;
+    return Herd::Unknown;
+}
 Scene::Transform *cow_transform = nullptr;
 Scene::Transform *pig_transform = nullptr;
 Scene::Transform *sheep_transform = nullptr;
@@ -74,6 +95,31 @@ std::queue< std::pair< std::string, std::pair< GLuint, GLuint > > > animal_skin;
 
 Scene::Camera *camera = nullptr;
 
+//part of the ground (z = 0) 'camera' can see, as a bounding rectangle (grown by 'margin'):
+// (if some of the view doesn't reach the ground, the whole playfield is used)
+static Protocol::View camera_view(Scene::Camera const &camera, float margin) {
+	Protocol::View view;
+	view.min = glm::vec2(-0.5f * Game::FrameWidth, -0.5f * Game::FrameHeight) - margin;
+	view.max = glm::vec2( 0.5f * Game::FrameWidth,  0.5f * Game::FrameHeight) + margin;
+
+	glm::mat4 to_world = camera.transform->make_local_to_world();
+	glm::vec3 eye = glm::vec3(to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	float y = std::tan(0.5f * camera.fovy);
+	float x = y * camera.aspect;
+	glm::vec2 min = glm::vec2(std::numeric_limits< float >::infinity());
+	glm::vec2 max = -min;
+	for (glm::vec2 corner : {glm::vec2(-x, -y), glm::vec2(x, -y), glm::vec2(-x, y), glm::vec2(x, y)}) {
+		glm::vec3 dir = glm::vec3(to_world * glm::vec4(corner, -1.0f, 0.0f));
+		if (!(eye.z * dir.z < 0.0f)) return view; //ray misses the ground
+		glm::vec3 at = eye - (eye.z / dir.z) * dir;
+		min = glm::min(min, glm::vec2(at));
+		max = glm::max(max, glm::vec2(at));
+	}
+	view.min = min - margin;
+	view.max = max + margin;
+	return view;
+}
+
 Load< Scene > scene(LoadTagDefault, [](){
 	Scene *ret = new Scene;
 	//load transform hierarchy:
@@ -139,46 +185,197 @@ Load< Scene > scene(LoadTagDefault, [](){
 	return ret;
 });
 
+//numeric address of a connected socket's peer (so UDP goes to the same server TCP reached):
+static std::string peer_host(SOCKET s) {
+    sockaddr_storage address;
+    socklen_t size = sizeof(address);
+    char host[NI_MAXHOST];
+    if (getpeername(s, reinterpret_cast< sockaddr * >(&address), &size) != 0
+     || getnameinfo(reinterpret_cast< sockaddr * >(&address), size, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0) {
+        throw std::runtime_error("couldn't get the server's address");
+    }
+    return host;
+}
+
 GameMode::GameMode(Client &client_) : client(client_) {
-	client.connection.send_raw("h", 1); //send a 'hello' to the server
+	send_message(client.connection, Protocol::Hello()); //send a 'hello' to the server
 
     // new line
-    state.cow.x = cow_transform->position.x;
-    state.cow.y = cow_transform->position.y;
-    state.pig.x = pig_transform->position.x;
-    state.pig.y = pig_transform->position.y;
-    state.sheep.x = sheep_transform->position.x;
-    state.sheep.y = sheep_transform->position.y;
     state.wolf.x = wolf_transform->position.x;
     state.wolf.y = wolf_transform->position.y;
     state.crosshair.x = crosshair_transform->position.x;
     state.crosshair.y = crosshair_transform->position.y;
 
-    {  // register animal to animal_list
-        uint32_t id = 1;
+    {  // move the animals from the scene into the herd (ids 1, 2, ... in scene order, the same on every client)
+        std::vector< Scene::Object * > moved;
+        dbg_cout("Register animals");
         for (Scene::Object *obj = scene->first_object; obj != nullptr; obj = obj->alloc_next) {
-            std::string name = obj->transform->name;
-            if (start_with(name, "Cow") || start_with(name, "Pig") ||
-                start_with(name, "Sheep") || start_with(name, "Wolf")) {
-                obj->transform->id = id;
-                animal_list[id++] = obj;
-                state.living_animal.insert(id);
-            }
+            Scene::Transform *t = obj->transform;
+            Herd::Species species = species_named(t->name);
+            if (species == Herd::Unknown) continue;
+            // meshes face +x at heading 0 (rotation 'direction.right'); find the turn about +z from there
+            glm::quat turn = t->rotation * glm::inverse(scene->direction.right);
+            glm::vec2 at = glm::vec2(t->position.x, t->position.y);
+            uint32_t id = state.herd.add(species, at, 2.0f * std::atan2(turn.z, turn.w));
+            t->id = id;
+            state.animals.insert(id, at);
+            if (t == wolf_transform) state.wolf_id = id;
+            if (state.herd.skins.size() <= species) state.herd.skins.resize(species + 1);
+            state.herd.skins[species].start = obj->start;
+            state.herd.skins[species].count = obj->count;
+            herd_look.program = obj->program;
+            herd_look.program_mvp_mat4 = obj->program_mvp_mat4;
+            herd_look.program_mv_mat4x3 = obj->program_mv_mat4x3;
+            herd_look.program_itmv_mat3 = obj->program_itmv_mat3;
+            herd_look.vao = obj->vao;
+            moved.emplace_back(obj);
+            dbg_cout("id " << id << " name " << t->name);
         }
-
-        dbg_cout("Register animal_list");
-        for (auto &it : animal_list) {
-            dbg_cout("id " << it.first << " name " << it.second->transform->name);
+        if (state.herd.ids.size() > Protocol::AnimalCount::MaxCount) {
+            throw std::runtime_error("Scene has more animals than the server accepts (Protocol::AnimalCount::MaxCount).");
+        }
+        // (the transforms stay, for sounds and the wolf's facing)
+        for (Scene::Object *obj : moved) {
+            non_const_scene->delete_object(obj);
         }
+        // draw each species with one instanced draw:
+        herd_look.instanced_program = vertex_color_instanced_program->program;
+        herd_look.instanced_program_world_to_clip_mat4 = vertex_color_instanced_program->world_to_clip_mat4;
+        herd_look.instanced_program_instance_to_world_mat4x3 = vertex_color_instanced_program->instance_to_world_mat4x3;
+        herd_look.instanced_vao = *meshes_for_vertex_color_instanced_program;
+        herd_look.instance_buffer = *herd_instance_buffer;
         dbg_cout("");
     }
 
+    // handle identity
+    handlers.on< Protocol::Identity >([this](Connection *c, Protocol::Identity const &message) {
+        if (state.identity.is_hunter || state.identity.is_wolf) return;
+        if (message.role == 'h') {
+            state.identity.is_hunter = true;
+            // sent the size of animals, then where they (and the crosshair) start
+            if (client.connection) {
+                Protocol::AnimalCount count;
+                count.count = uint32_t(state.herd.ids.size());
+                send_message(client.connection, count);
+
+                state.herd.ids.for_each([this](uint32_t id) {
+                    Protocol::Placement placement;
+                    placement.id = id;
+                    placement.kind = (id == state.wolf_id ? Protocol::Placement::Wolf : Protocol::Placement::Animal);
+                    placement.position = state.herd.position(id);
+                    send_message(client.connection, placement);
+                });
+                Protocol::Placement placement;
+                placement.id = 0;
+                placement.kind = Protocol::Placement::Crosshair;
+                placement.position = state.crosshair;
+                send_message(client.connection, placement);
+            }
+        } else if (message.role == 'w') {
+            state.identity.is_wolf = true;
+        }
+    });
+
+    // the server offers UDP: claim it (States then can't get stuck behind a lost packet)
+    handlers.on< Protocol::UdpOffer >([this](Connection *c, Protocol::UdpOffer const &message) {
+        if (udp) return;
+        try {
+            udp.reset(new UdpClient(peer_host(c->socket), std::to_string(message.port)));
+        } catch (std::exception &e) {
+            std::cerr << "Couldn't set up UDP to the server (" << e.what() << "); staying on TCP." << std::endl;
+            return;
+        }
+        udp_token = message.token;
+        Protocol::UdpHello hello;
+        hello.token = message.token;
+        send_message(udp->connection.reliable, hello);
+    });
+
+    // (arrives over udp)
+    handlers.on< Protocol::UdpHello >([this](Connection *c, Protocol::UdpHello const &message) {
+        if (udp && message.token == udp_token) udp_claimed = true;
+    });
+
+    // handle position update: the server simulates both players;
+    // our own player is predicted (and corrected here), the other one is shown slightly in the past
+    handlers.on(Protocol::State::Type, [this](Connection *c, char const *payload, size_t size) {
+        Snapshot snapshot;
+        if (!decode_snapshot(payload, size, received_states, &snapshot)) {
+            std::cerr << "Couldn't decode State from server; ignoring." << std::endl;
+            return;
+        }
+        received_states.add(snapshot);
+        // the herd wanders in step with the server's ticks (it starts from the placement at tick 0)
+        while (state.herd.tick < snapshot.tick) {
+            state.step_herd(Game::TickDt);
+        }
+        if (state.identity.is_hunter) {
+            prediction.reconcile(snapshot.tick, snapshot.ack, Snapshot::dequantize(snapshot.crosshair), &state.crosshair);
+            remote.push(snapshot.tick, Snapshot::dequantize(snapshot.wolf));
+        } else if (state.identity.is_wolf) {
+            prediction.reconcile(snapshot.tick, snapshot.ack, Snapshot::dequantize(snapshot.wolf), &state.wolf);
+            remote.push(snapshot.tick, Snapshot::dequantize(snapshot.crosshair));
+        }
+    });
+
+    // handle attack event
+    handlers.on< Protocol::Attack >([this](Connection *c, Protocol::Attack const &message) {
+        if (!state.identity.is_hunter && !state.identity.is_wolf) return;
+        uint32_t target = message.target;
+        // remove from the herd
+        if (!state.herd.ids.alive(target)) return;
+        dbg_cout("Receive kill id " << target);
+        if (state.herd.species[Entities::index(target)] == Herd::Pig) {
+            pig_dead_sound->play(glm::vec3(state.herd.position(target), 0.0f));
+        }
+        state.herd.remove(target);
+    });
+
+    handlers.on< Protocol::Direction >([this](Connection *c, Protocol::Direction const &message) {
+        if (state.identity.is_hunter) {
+            if (state.herd.ids.alive(message.id) && scene->direction.direction_map.count(message.direction)) {
+                state.herd.heading[Entities::index(message.id)] = Herd::heading_of(message.direction);
+            }
+        }
+    });
+
+    handlers.on< Protocol::ChangeSkin >([this](Connection *c, Protocol::ChangeSkin const &) {
+        if (!state.identity.is_hunter) return;
+        // change wolf's skin
+        if (!state.herd.ids.alive(state.wolf_id)) return;
+
+        auto skin = animal_skin.front();
+        animal_skin.pop();
+        state.herd.skin[Entities::index(state.wolf_id)] = species_named(skin.first);
+        animal_skin.push(skin);
+        if (skin.first == "Sheep") {
+            sheep_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        } else if (skin.first == "Cow") {
+            cow_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), 2.0f);
+        } else if (skin.first == "Pig") {
+            pig_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        }
+    });
+
+    handlers.on< Protocol::Shoot >([this](Connection *c, Protocol::Shoot const &) {
+        if (state.identity.is_wolf) {
+            shotgun_sound->play( crosshair_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
+        }
+    });
+
 }
 
 GameMode::~GameMode() {
+    finish_herd();
+}
+
+void GameMode::finish_herd() {
+    jobs.wait(&herd_stepped);
 }
 
 bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	finish_herd();
+
 	//ignore any keys that are the result of automatic key repeat:
 	if (evt.type == SDL_KEYDOWN && evt.key.repeat) {
 		return false;
@@ -218,41 +415,28 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
                     shotgun_sound->play( crosshair_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
                     {  // tell wolf to play shotgun
                         if (client.connection) {
-                            client.connection.send_raw("s", 1);
+                            send_reliable(Protocol::Shoot());
                         }
                     }
-                    for (auto &a : animal_list) {
-                        uint32_t id = a.first;
-                        Scene::Object *obj = a.second;
-                        Scene::Transform *t = obj->transform;
-                        if (glm::distance(state.crosshair, glm::vec2(t->position.x, t->position.y)) < 1.0f) {
-                            dbg_cout("Try to kill id " << id << " name "<< t->name);
-                            state.try_attack = std::make_pair(true, id);
-                            break;
-                        }
+                    uint32_t id = state.nearest_prey(state.crosshair);
+                    if (id) {
+                        dbg_cout("Try to kill id " << id);
+                        state.try_attack = std::make_pair(true, id);
                     }
                 } else if (state.identity.is_wolf) {
                     dbg_cout("Wolf attack");
-                    for (auto &a : animal_list) {
-                        uint32_t id = a.first;
-                        Scene::Object *obj = a.second;
-                        Scene::Transform *t = obj->transform;
-                        if (t->name == "Wolf") {  // don't check wolf itself
-                            continue;
-                        }
-                        if (glm::distance(state.wolf, glm::vec2(t->position.x, t->position.y)) < 1.0f) {
-                            dbg_cout("Try to kill id " << id << " name "<< t->name);
-                            state.try_attack = std::make_pair(true, id);
-                            break;
-                        }
-                    }  // end for
+                    uint32_t id = state.nearest_prey(state.wolf, state.wolf_id);  // don't check wolf itself
+                    if (id) {
+                        dbg_cout("Try to kill id " << id);
+                        state.try_attack = std::make_pair(true, id);
+                    }
                 }  // end else if
             }  // end if
 
             // wolf press c to change skin
             if (evt.key.keysym.scancode == SDL_SCANCODE_C && evt.type == SDL_KEYDOWN) {
                 if (client.connection && state.identity.is_wolf) {
-                    client.connection.send_raw("c", 1);
+                    send_reliable(Protocol::ChangeSkin());
 
                     auto skin = animal_skin.front();
                     animal_skin.pop();
@@ -274,68 +458,85 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void GameMode::update(float elapsed) {
-	state.update(elapsed);
+    finish_herd();
+
+    // move your character (hunter or wolf) in fixed ticks, and the other player along its interpolated path
+    uint32_t ticks = 0;
+    if (state.identity.is_hunter) {
+        ticks = prediction.update(elapsed, state.controls, &state.crosshair);
+        if (!remote.empty()) state.wolf = remote.update(elapsed);
+    } else if (state.identity.is_wolf) {
+        ticks = prediction.update(elapsed, state.controls, &state.wolf);
+        if (!remote.empty()) state.crosshair = remote.update(elapsed);
+    }
+    // the herd moves in the same ticks (once States have told us which server tick it is), at the end of update()
+    herd_ticks = ticks;
 
     // change wolf direction
     if (state.identity.is_wolf) {
         if (state.controls.move_up && state.controls.move_right) {
-            wolf_transform->rotation = scene->direction.up_right;
+            wolf_transform->set_rotation(scene->direction.up_right);
             wolf_transform->direction = 2;
         } else if (state.controls.move_up && state.controls.move_left) {
-            wolf_transform->rotation = scene->direction.up_left;
+            wolf_transform->set_rotation(scene->direction.up_left);
             wolf_transform->direction = 4;
         } else if (state.controls.move_down && state.controls.move_right) {
-            wolf_transform->rotation = scene->direction.down_right;
+            wolf_transform->set_rotation(scene->direction.down_right);
             wolf_transform->direction = 8;
         } else if (state.controls.move_down && state.controls.move_left) {
-            wolf_transform->rotation = scene->direction.down_left;
+            wolf_transform->set_rotation(scene->direction.down_left);
             wolf_transform->direction = 6;
         } else if (state.controls.move_up) {
-            wolf_transform->rotation = scene->direction.up;
+            wolf_transform->set_rotation(scene->direction.up);
             wolf_transform->direction = 3;
         } else if (state.controls.move_down) {
-            wolf_transform->rotation = scene->direction.down;
+            wolf_transform->set_rotation(scene->direction.down);
             wolf_transform->direction = 7;
         } else if (state.controls.move_right) {
-            wolf_transform->rotation = scene->direction.right;
+            wolf_transform->set_rotation(scene->direction.right);
             wolf_transform->direction = 1;
         } else if (state.controls.move_left) {
-            wolf_transform->rotation = scene->direction.left;
+            wolf_transform->set_rotation(scene->direction.left);
             wolf_transform->direction = 5;
         }
+        if (state.controls.bits() && state.herd.ids.alive(state.wolf_id)) {
+            state.herd.heading[Entities::index(state.wolf_id)] = Herd::heading_of(wolf_transform->direction);
+        }
     }
 
 
-    // send crosshair/wolf position to server when game state is changed
-	if (client.connection && state.need_to_send()) {
-        // positions
-        if (state.identity.is_hunter) {
-            // pc: Crosshair Position
-            client.connection.send_raw("pc", 2);
-            client.connection.send_raw(&state.crosshair.x, sizeof(float));
-            client.connection.send_raw(&state.crosshair.y, sizeof(float));
-        } else if (state.identity.is_wolf) {
-            // pw: Wolf Position
-            client.connection.send_raw("pw", 2);
-            client.connection.send_raw(&state.wolf.x, sizeof(float));
-            client.connection.send_raw(&state.wolf.y, sizeof(float));
-        } else {
-            std::cout << "no charactor" << std::endl;
+    // send input bits for the ticks just run to server (the server moves the crosshair/wolf)
+	if (client.connection && (state.identity.is_hunter || state.identity.is_wolf)) {
+        // (over udp, each Input also repeats recent ticks the server hasn't acknowledged, in case one is lost)
+        Protocol::Input input;
+        bool sent_input = false;
+        while (prediction.next_input(&input, udp_claimed)) {
+            send_unreliable(input);
+            sent_input = true;
         }
 
         // attack
         if (state.try_attack.first) {
             dbg_cout("send attack target id " << state.try_attack.second);
-            client.connection.send_raw("a", 1);
-            client.connection.send_raw(&state.try_attack.second, sizeof(uint32_t));
+            Protocol::Attack message;
+            message.target = state.try_attack.second;
+            send_reliable(message);
             state.try_attack = std::make_pair(false, 0);  // reset try_attack
         }
 
-        // send direction data: ["d"][id][uint32_t direction]
-        if (state.identity.is_wolf) {
-            client.connection.send_raw("d", 1);
-            client.connection.send_raw(&wolf_transform->id, sizeof(uint32_t));
-            client.connection.send_raw(&wolf_transform->direction, sizeof(uint32_t));
+        // tell the server what we can see (it only sends animal updates there)
+        if (camera->aspect != sent_view_aspect) {
+            send_message(client.connection, camera_view(*camera, Game::AttackRange));
+            sent_view_aspect = camera->aspect;
+        }
+
+        // send direction data (over udp, with every Input too, since one may be lost)
+        if (state.identity.is_wolf && (wolf_transform->direction != sent_direction || (udp_claimed && sent_input))) {
+            Protocol::Direction message;
+            message.id = wolf_transform->id;
+            message.direction = wolf_transform->direction;
+            send_unreliable(message);
+            sent_direction = wolf_transform->direction;
         }
 	}
 
@@ -345,125 +546,49 @@ void GameMode::update(float elapsed) {
 		} else if (event == Connection::OnClose) {
 			std::cerr << "Lost connection to server." << std::endl;
 		} else { assert(event == Connection::OnRecv);
-            while (!c->recv_buffer.empty()) {
-                // handle identity
-                if (!state.identity.is_hunter && !state.identity.is_wolf) {
-                    if (c->recv_buffer[0] == 'i') {  // "ih" or "iw"
-                        if (c->recv_buffer.size() < 2) {
-                            return;
-                        } else {
-                            if (c->recv_buffer[1] == 'h') {
-                                state.identity.is_hunter = true;
-                                // sent the size of animals
-                                if (client.connection) {
-                                    size_t size = state.living_animal.size();
-                                    client.connection.send_raw("l", 1);
-                                    client.connection.send_raw(&size, sizeof(size_t));
-                                }
-                            } else if (c->recv_buffer[1] == 'w') {
-                                state.identity.is_wolf = true;
-                            }
-                            c->recv_buffer.clear();
-                        }
-                    } else if (*(c->recv_buffer.begin()) == 'p' && c->recv_buffer.size() >= 10) {
-                        // ignore any data received before both of two players are registered
-
-                        // probably won't get here because server will not send position data until both
-                        // players are registered
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 10);
-                    } else if (*(c->recv_buffer.begin()) == 'a' && c->recv_buffer.size() >= 5) {
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 5);
-                    }
-                // handle position update
-                } else if (*(c->recv_buffer.begin()) == 'p') {  // [pw/pc][float x][float y]
-                    if (c->recv_buffer.size() < 2 * (sizeof(char) + sizeof(float))) {
-                        return;
-                    } else {
-                        if (*(c->recv_buffer.begin() + 1) == 'w' && state.identity.is_hunter) {
-                            memcpy(&state.wolf.x, c->recv_buffer.data() + 2, sizeof(float));
-                            memcpy(&state.wolf.y, c->recv_buffer.data() + 2 + sizeof(float), sizeof(float));
-                        } else if (*(c->recv_buffer.begin() + 1) == 'c' && state.identity.is_wolf) {
-                            memcpy(&state.crosshair.x, c->recv_buffer.data() + 2, sizeof(float));
-                            memcpy(&state.crosshair.y, c->recv_buffer.data() + 2 + sizeof(float), sizeof(float));
-                        }
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 2 * (sizeof(char) + sizeof(float)));
-                    }
-                // handle attack event
-                } else if (*(c->recv_buffer.begin()) == 'a') {
-                    if (c->recv_buffer.size() < 1 + sizeof(uint32_t)) {
-                        return;
-                    } else {
-                        uint32_t target;
-                        memcpy(&target, c->recv_buffer.data() + 1, sizeof(uint32_t));
-                        // remove from animal_list, scene, living_animal
-                        if (!animal_list.empty()) {
-                            Scene::Object *obj = animal_list[target];
-                            dbg_cout("Receive kill id " << target << " name " << obj->transform->name);
-                            if (start_with(obj->transform->name, "Pig")) {
-                                pig_dead_sound->play(obj->transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                            }
-                            non_const_scene->delete_object(obj);
-                            animal_list.erase(target);
-                        }
-                        if (!state.living_animal.empty()) {
-                            state.living_animal.erase(target);
-                        }
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 1 + sizeof(uint32_t));
-                    }
-                } else if (*(c->recv_buffer.begin()) == 'd') {
-                    if (c->recv_buffer.size() < 1 + 2 * sizeof(uint32_t)) {
-                        return;
-                    } else {
-                        if (state.identity.is_hunter) {
-                            uint32_t id, direction;
-                            memcpy(&id, c->recv_buffer.data() + 1, sizeof(uint32_t));
-                            memcpy(&direction, c->recv_buffer.data() + 1 + sizeof(uint32_t), sizeof(uint32_t));
-                            animal_list[id]->transform->rotation = *(scene->direction.direction_map.at(direction));
-                        }
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 1 + 2 * sizeof(uint32_t));
-                    }
-                } else if (*(c->recv_buffer.begin()) == 'c' && state.identity.is_hunter) {
-                    // change wolf's skin
-                    Scene::Object *obj = animal_list[wolf_transform->id];
-
-                    auto skin = animal_skin.front();
-                    animal_skin.pop();
-                    obj->start = skin.second.first;
-                    obj->count = skin.second.second;
-                    animal_skin.push(skin);
-                    if (skin.first == "Sheep") {
-                        sheep_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                    } else if (skin.first == "Cow") {
-                        cow_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), 2.0f);
-                    } else if (skin.first == "Pig") {
-                        pig_sound->play(wolf_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                    }
-
-                    c->recv_buffer.erase(c->recv_buffer.begin(),
-                                         c->recv_buffer.begin() + 1);
-                } else if (*(c->recv_buffer.begin()) == 's' && state.identity.is_wolf) {
-                    shotgun_sound->play( crosshair_transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
-                    c->recv_buffer.erase(c->recv_buffer.begin(),
-                                         c->recv_buffer.begin() + 1);
-                }
-            }
+			handlers.dispatch(c);
 		}
 
 	});
 
+	if (udp) {
+		bool lost = false;
+		udp->poll([&](UdpConnection *u, Connection::Event event) {
+			if (event == Connection::OnRecv) {
+				// (handled just as if it had come over TCP)
+				handlers.dispatch(&client.connection, u->reliable.recv_buffer);
+				handlers.dispatch(&client.connection, u->unreliable.recv_buffer);
+			} else if (event == Connection::OnClose) {
+				lost = true;
+			}
+		});
+		if (lost) {
+			std::cerr << "Lost UDP connection to server; carrying on over TCP." << std::endl;
+			udp.reset();
+			udp_claimed = false;
+		}
+	}
 
-	//copy game state to scene positions:
-    crosshair_transform->position.x = state.crosshair.x;
-    crosshair_transform->position.y = state.crosshair.y;
 
-    wolf_transform->position.x = state.wolf.x;
-    wolf_transform->position.y = state.wolf.y;
+	//copy game state to scene positions:
+    crosshair_transform->set_position(glm::vec3(state.crosshair, crosshair_transform->position.z));
+    wolf_transform->set_position(glm::vec3(state.wolf, wolf_transform->position.z));
+    if (state.herd.ids.alive(state.wolf_id)) {
+        state.herd.set_position(state.wolf_id, state.wolf);
+        state.animals.insert(state.wolf_id, state.wolf);
+    }
 
+    // draw this frame's herd while the next frame's is computed
+    // (so animals show up one frame late; the wolf and crosshair don't)
+    drawn_herd.copy_look(state.herd);
+    if (herd_ticks != 0 && state.herd.tick != 0) {
+        uint32_t ticks_due = herd_ticks;
+        jobs.run([this, ticks_due]() {
+            for (uint32_t t = 0; t < ticks_due; ++t) {
+                state.step_herd(Game::TickDt, &jobs);
+            }
+        }, &herd_stepped);
+    }
 }
 
 void GameMode::draw(glm::uvec2 const &drawable_size) {
@@ -479,15 +604,21 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glBlendEquation(GL_FUNC_ADD);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	//set up light positions:
-	glUseProgram(vertex_color_program->program);
-
-	glUniform3fv(vertex_color_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.81f, 0.81f, 0.76f)));
-	glUniform3fv(vertex_color_program->sun_direction_vec3, 1, glm::value_ptr(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f))));
-	glUniform3fv(vertex_color_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-	glUniform3fv(vertex_color_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
-
-	scene->draw(camera);
+	//set up light positions (for both programs):
+	auto set_lights = [](GLuint program, GLuint sun_color, GLuint sun_direction, GLuint sky_color, GLuint sky_direction) {
+		glUseProgram(program);
+		glUniform3fv(sun_color, 1, glm::value_ptr(glm::vec3(0.81f, 0.81f, 0.76f)));
+		glUniform3fv(sun_direction, 1, glm::value_ptr(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f))));
+		glUniform3fv(sky_color, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
+		glUniform3fv(sky_direction, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
+	};
+	set_lights(vertex_color_program->program, vertex_color_program->sun_color_vec3, vertex_color_program->sun_direction_vec3,
+		vertex_color_program->sky_color_vec3, vertex_color_program->sky_direction_vec3);
+	set_lights(vertex_color_instanced_program->program, vertex_color_instanced_program->sun_color_vec3, vertex_color_instanced_program->sun_direction_vec3,
+		vertex_color_instanced_program->sky_color_vec3, vertex_color_instanced_program->sky_direction_vec3);
+
+	scene->draw(camera, &render_queue);
+	scene->draw(camera, drawn_herd, herd_look, &jobs, &herd_queue);
 
 	GL_ERRORS();
 }
@@ -5,13 +5,20 @@
 #include "MeshBuffer.hpp"
 #include "GL.hpp"
 #include "Connection.hpp"
+#include "UdpConnection.hpp"
+#include "Message.hpp"
 #include "Game.hpp"
+#include "Prediction.hpp"
+#include "Snapshot.hpp"
+#include "Jobs.hpp"
+#include "RenderQueue.hpp"
 
 #include <SDL.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <vector>
+#include <memory>
 
 // The 'GameMode' mode is the main gameplay mode:
 
@@ -33,7 +40,42 @@ struct GameMode : public Mode {
 	//------- game state -------
 	Game state;
 
+	//------ jobs ------
+	//the herd steps on worker threads while the previous frame draws (from a copy of the herd):
+	Jobs jobs;
+	Jobs::Counter herd_stepped; //the herd step started at the end of update()
+	Herd drawn_herd = Herd(glm::vec2(0.0f), glm::vec2(0.0f)); //the herd as of then (only its look is used)
+	uint32_t herd_ticks = 0; //herd steps due at the end of update()
+	//wait for that step (anything touching state.herd or state.animals calls this first):
+	void finish_herd();
+
+	//------ drawing ------
+	RenderQueue render_queue; //scene objects, sorted each frame (kept for its buffers and counters)
+	RenderQueue herd_queue; //the animals (instanced draws)
+
 	//------ networking ------
 	Client &client; //client object; manages connection to server.
+	MessageHandlers handlers; //what to do with each type of message from the server
+	Prediction prediction; //local player movement, replayed on top of the server's States
+	Interpolation remote; //other player's positions from the server, shown slightly in the past
+	SnapshotHistory received_states; //recent States, which later ones are delta-encoded against
+	uint32_t sent_direction = 7; //last wolf direction sent to the server (7 = initial facing)
+	float sent_view_aspect = 0.0f; //camera aspect when the view was last sent to the server (0 = never sent)
+
+	//UDP connection to the server, once it has offered one (see Protocol::UdpOffer):
+	std::unique_ptr< UdpClient > udp;
+	uint64_t udp_token = 0; //token the offer was claimed with
+	bool udp_claimed = false; //the server accepted the claim, so messages below go over udp
+	//send Input and Direction on udp's unreliable channel, Attack, ChangeSkin and Shoot on its reliable one (or else over TCP):
+	template< typename T >
+	void send_unreliable(T const &message) {
+		if (udp_claimed) send_message(udp->connection.unreliable, message);
+		else send_message(client.connection, message);
+	}
+	template< typename T >
+	void send_reliable(T const &message) {
+		if (udp_claimed) send_message(udp->connection.reliable, message);
+		else send_message(client.connection, message);
+	}
 
 };
@@ -0,0 +1,432 @@
+#include "Herd.hpp"
+#include "Jobs.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HERD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HERD_TARGET(isa)
+#else
+#define HERD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+//------ helpers (the scalar versions behave exactly like the SIMD instructions) ------
+
+static uint32_t xorshift(uint32_t s) {
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+//uniform in [-1, 1), from the top 23 bits of 's':
+static float unit(uint32_t s) {
+	uint32_t bits = (s >> 9) | 0x3f800000U; //[1, 2)
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return (f - 1.5f) * 2.0f;
+}
+
+//(same operand order as _mm_max_ps / _mm_min_ps, so ties and signed zeros come out the same)
+static float max_(float a, float b) {
+	return (a > b ? a : b);
+}
+static float min_(float a, float b) {
+	return (a < b ? a : b);
+}
+
+//first generator state of animal 'id':
+static uint32_t seed_of(uint32_t seed, uint32_t id) {
+	uint32_t h = seed ^ (id * 0x9e3779b9U);
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return (h != 0 ? h : 1); //(xorshift never leaves 0)
+}
+
+//------ Herd ------
+
+Herd::Herd(glm::vec2 const &min_, glm::vec2 const &max_, uint32_t seed_) : min(min_), max(max_), seed(seed_) {
+	columns = uint32_t(std::max(1.0f, std::ceil((max.x - min.x) / CrowdCell)));
+	rows = uint32_t(std::max(1.0f, std::ceil((max.y - min.y) / CrowdCell)));
+	cells.resize(size_t(columns) * size_t(rows));
+}
+
+uint32_t Herd::add(Species species_, glm::vec2 const &at, float heading_) {
+	uint32_t id = ids.create();
+	uint32_t i = Entities::index(id);
+	if (i >= x.size()) {
+		x.resize(i + 1, 0.0f);
+		y.resize(i + 1, 0.0f);
+		vx.resize(i + 1, 0.0f);
+		vy.resize(i + 1, 0.0f);
+		heading.resize(i + 1, 0.0f);
+		species.resize(i + 1, Unknown);
+		skin.resize(i + 1, Unknown);
+		wander.resize(i + 1, 0.0f);
+		random.resize(i + 1, 1);
+	}
+	x[i] = at.x;
+	y[i] = at.y;
+	vx[i] = 0.0f;
+	vy[i] = 0.0f;
+	heading[i] = heading_;
+	species[i] = species_;
+	skin[i] = species_;
+	wander[i] = (species_ == Wolf ? 0.0f : 1.0f);
+	random[i] = seed_of(seed, id);
+	return id;
+}
+
+void Herd::remove(uint32_t id) {
+	if (!ids.alive(id)) return;
+	ids.destroy(id);
+}
+
+void Herd::set_species(uint32_t id, Species species_) {
+	if (!ids.alive(id)) return;
+	uint32_t i = Entities::index(id);
+	species[i] = species_;
+	wander[i] = (species_ == Wolf ? 0.0f : 1.0f);
+	if (species_ == Wolf) {
+		vx[i] = 0.0f;
+		vy[i] = 0.0f;
+	}
+}
+
+void Herd::copy_look(Herd const &from) {
+	ids = from.ids;
+	x = from.x;
+	y = from.y;
+	vx = from.vx;
+	vy = from.vy;
+	heading = from.heading;
+	skin = from.skin;
+	skins = from.skins;
+}
+
+uint32_t Herd::cell_of(float at_x, float at_y) const {
+	float cx = (at_x - min.x) / CrowdCell;
+	float cy = (at_y - min.y) / CrowdCell;
+	uint32_t column = (!(cx >= 0.0f) ? 0 : (cx >= float(columns) ? columns - 1 : uint32_t(cx))); //(also catches NaN)
+	uint32_t row = (!(cy >= 0.0f) ? 0 : (cy >= float(rows) ? rows - 1 : uint32_t(cy)));
+	return row * columns + column;
+}
+
+void Herd::step(float dt, Jobs *jobs) {
+	tick += 1;
+	size_t count = x.size();
+	//run 'f(begin, end)' over all animals, split between threads if there are jobs:
+	auto each = [jobs, count](std::function< void(size_t, size_t) > const &f) {
+		if (jobs) jobs->parallel_for(0, count, 4096, f);
+		else f(0, count);
+	};
+
+	//how crowded is each animal's cell (cells are only reset when first touched in a step):
+	cell_index.resize(count);
+	each([this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			cell_index[i] = cell_of(x[i], y[i]);
+		}
+	});
+	//(summed in order, on one thread, so the totals come out the same every time)
+	for (size_t i = 0; i < count; ++i) {
+		Cell &cell = cells[cell_index[i]];
+		if (cell.tick != tick) {
+			cell.tick = tick;
+			cell.count = 0.0f;
+			cell.x = 0.0f;
+			cell.y = 0.0f;
+		}
+		cell.count += wander[i];
+		cell.x += x[i] * wander[i];
+		cell.y += y[i] * wander[i];
+	}
+	crowd.resize(count);
+	center_x.resize(count);
+	center_y.resize(count);
+	each([this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			Cell const &cell = cells[cell_index[i]];
+			crowd[i] = cell.count;
+			center_x[i] = (cell.count > 0.0f ? cell.x / cell.count : x[i]);
+			center_y[i] = (cell.count > 0.0f ? cell.y / cell.count : y[i]);
+		}
+	});
+
+	//wander and move:
+	each([this, dt](size_t begin, size_t end) {
+		size_t done = begin;
+		if (kernel == AVX2 && supported(AVX2)) done = wander_avx2(dt, begin, end);
+		else if (kernel == SSE2 && supported(SSE2)) done = wander_sse2(dt, begin, end);
+		wander_scalar(dt, done, end);
+	});
+}
+
+void Herd::wander_scalar(float dt, size_t begin, size_t end) {
+	float near_x = min.x + EdgeMargin, far_x = max.x - EdgeMargin;
+	float near_y = min.y + EdgeMargin, far_y = max.y - EdgeMargin;
+	//move along one axis, bouncing off the edges:
+	auto move = [dt](float &at, float &v, float lo, float hi) {
+		float p = at + v * dt;
+		if (p < lo) {
+			p = lo + (lo - p);
+			v = -v;
+		} else if (p > hi) {
+			p = hi - (p - hi);
+			v = -v;
+		}
+		at = p;
+	};
+	for (size_t i = begin; i < end; ++i) {
+		uint32_t r = xorshift(random[i]);
+		float rx = unit(r);
+		r = xorshift(r);
+		float ry = unit(r);
+		random[i] = r;
+
+		float push = max_(crowd[i] - 1.0f, 0.0f) * CrowdAccel;
+		float ax = rx * WanderAccel + (x[i] - center_x[i]) * push + (max_(near_x - x[i], 0.0f) - max_(x[i] - far_x, 0.0f)) * EdgeAccel;
+		float ay = ry * WanderAccel + (y[i] - center_y[i]) * push + (max_(near_y - y[i], 0.0f) - max_(y[i] - far_y, 0.0f)) * EdgeAccel;
+
+		float w = wander[i] * dt;
+		float nvx = vx[i] + ax * w;
+		float nvy = vy[i] + ay * w;
+		float slow = min_(1.0f, MaxSpeed / std::sqrt(nvx * nvx + nvy * nvy));
+		nvx *= slow;
+		nvy *= slow;
+
+		move(x[i], nvx, min.x, max.x);
+		move(y[i], nvy, min.y, max.y);
+		vx[i] = nvx;
+		vy[i] = nvy;
+	}
+}
+
+#ifdef HERD_X86
+
+static bool cpu_has_avx2() {
+	#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false; //(OS must save the ymm registers)
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+	#else
+	return __builtin_cpu_supports("avx2");
+	#endif
+}
+
+static bool cpu_has_sse2() {
+	#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+	#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+	#else
+	return __builtin_cpu_supports("sse2");
+	#endif
+}
+
+bool Herd::supported(Kernel kernel_) {
+	static bool const sse2 = cpu_has_sse2();
+	static bool const avx2 = cpu_has_avx2();
+	if (kernel_ == SSE2) return sse2;
+	if (kernel_ == AVX2) return avx2;
+	return true;
+}
+
+//The SIMD versions follow wander_scalar line by line, four (SSE2) or eight (AVX2) animals at a time.
+// (helpers are plain functions rather than lambdas so they can carry the instruction set attribute)
+
+HERD_TARGET("sse2")
+static __m128i xorshift4(__m128i s) {
+	s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+	s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+	s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+	return s;
+}
+
+HERD_TARGET("sse2")
+static __m128 unit4(__m128i s) {
+	__m128 f = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(s, 9), _mm_set1_epi32(0x3f800000)));
+	return _mm_mul_ps(_mm_sub_ps(f, _mm_set1_ps(1.5f)), _mm_set1_ps(2.0f));
+}
+
+//acceleration along one axis, 'lo_edge'/'hi_edge' being the edges moved in by EdgeMargin:
+HERD_TARGET("sse2")
+static __m128 accel4(__m128 r, __m128 p, __m128 center, __m128 push, float lo_edge, float hi_edge) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 edge = _mm_sub_ps(
+		_mm_max_ps(_mm_sub_ps(_mm_set1_ps(lo_edge), p), zero),
+		_mm_max_ps(_mm_sub_ps(p, _mm_set1_ps(hi_edge)), zero)
+	);
+	return _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(Herd::WanderAccel)), _mm_mul_ps(_mm_sub_ps(p, center), push)),
+		_mm_mul_ps(edge, _mm_set1_ps(Herd::EdgeAccel))
+	);
+}
+
+//move along one axis, bouncing off the edges:
+HERD_TARGET("sse2")
+static void move4(float *at, __m128 *v, __m128 dt, float lo_, float hi_) {
+	__m128 lo = _mm_set1_ps(lo_), hi = _mm_set1_ps(hi_);
+	__m128 p = _mm_add_ps(_mm_loadu_ps(at), _mm_mul_ps(*v, dt));
+	__m128 below = _mm_cmplt_ps(p, lo);
+	__m128 above = _mm_cmpgt_ps(p, hi);
+	__m128 from_lo = _mm_add_ps(lo, _mm_sub_ps(lo, p));
+	__m128 from_hi = _mm_sub_ps(hi, _mm_sub_ps(p, hi));
+	p = _mm_or_ps(_mm_and_ps(above, from_hi), _mm_andnot_ps(above, p));
+	p = _mm_or_ps(_mm_and_ps(below, from_lo), _mm_andnot_ps(below, p));
+	*v = _mm_xor_ps(*v, _mm_and_ps(_mm_or_ps(below, above), _mm_set1_ps(-0.0f)));
+	_mm_storeu_ps(at, p);
+}
+
+HERD_TARGET("sse2")
+size_t Herd::wander_sse2(float dt, size_t begin, size_t end) {
+	end = begin + (end - begin) / 4 * 4;
+	__m128 const dt4 = _mm_set1_ps(dt);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1.0f);
+	for (size_t i = begin; i < end; i += 4) {
+		__m128i r = xorshift4(_mm_loadu_si128(reinterpret_cast< __m128i const * >(&random[i])));
+		__m128 rx = unit4(r);
+		r = xorshift4(r);
+		__m128 ry = unit4(r);
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(&random[i]), r);
+
+		__m128 push = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&crowd[i]), one), zero), _mm_set1_ps(CrowdAccel));
+		__m128 ax = accel4(rx, _mm_loadu_ps(&x[i]), _mm_loadu_ps(&center_x[i]), push, min.x + EdgeMargin, max.x - EdgeMargin);
+		__m128 ay = accel4(ry, _mm_loadu_ps(&y[i]), _mm_loadu_ps(&center_y[i]), push, min.y + EdgeMargin, max.y - EdgeMargin);
+
+		__m128 w = _mm_mul_ps(_mm_loadu_ps(&wander[i]), dt4);
+		__m128 nvx = _mm_add_ps(_mm_loadu_ps(&vx[i]), _mm_mul_ps(ax, w));
+		__m128 nvy = _mm_add_ps(_mm_loadu_ps(&vy[i]), _mm_mul_ps(ay, w));
+		__m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(nvx, nvx), _mm_mul_ps(nvy, nvy)));
+		__m128 slow = _mm_min_ps(one, _mm_div_ps(_mm_set1_ps(MaxSpeed), speed));
+		nvx = _mm_mul_ps(nvx, slow);
+		nvy = _mm_mul_ps(nvy, slow);
+
+		move4(&x[i], &nvx, dt4, min.x, max.x);
+		move4(&y[i], &nvy, dt4, min.y, max.y);
+		_mm_storeu_ps(&vx[i], nvx);
+		_mm_storeu_ps(&vy[i], nvy);
+	}
+	return end;
+}
+
+HERD_TARGET("avx2")
+static __m256i xorshift8(__m256i s) {
+	s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+	s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+	s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+	return s;
+}
+
+HERD_TARGET("avx2")
+static __m256 unit8(__m256i s) {
+	__m256 f = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(s, 9), _mm256_set1_epi32(0x3f800000)));
+	return _mm256_mul_ps(_mm256_sub_ps(f, _mm256_set1_ps(1.5f)), _mm256_set1_ps(2.0f));
+}
+
+HERD_TARGET("avx2")
+static __m256 accel8(__m256 r, __m256 p, __m256 center, __m256 push, float lo_edge, float hi_edge) {
+	__m256 zero = _mm256_setzero_ps();
+	__m256 edge = _mm256_sub_ps(
+		_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(lo_edge), p), zero),
+		_mm256_max_ps(_mm256_sub_ps(p, _mm256_set1_ps(hi_edge)), zero)
+	);
+	return _mm256_add_ps(
+		_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(Herd::WanderAccel)), _mm256_mul_ps(_mm256_sub_ps(p, center), push)),
+		_mm256_mul_ps(edge, _mm256_set1_ps(Herd::EdgeAccel))
+	);
+}
+
+HERD_TARGET("avx2")
+static void move8(float *at, __m256 *v, __m256 dt, float lo_, float hi_) {
+	__m256 lo = _mm256_set1_ps(lo_), hi = _mm256_set1_ps(hi_);
+	__m256 p = _mm256_add_ps(_mm256_loadu_ps(at), _mm256_mul_ps(*v, dt));
+	__m256 below = _mm256_cmp_ps(p, lo, _CMP_LT_OQ);
+	__m256 above = _mm256_cmp_ps(p, hi, _CMP_GT_OQ);
+	__m256 from_lo = _mm256_add_ps(lo, _mm256_sub_ps(lo, p));
+	__m256 from_hi = _mm256_sub_ps(hi, _mm256_sub_ps(p, hi));
+	p = _mm256_blendv_ps(p, from_hi, above);
+	p = _mm256_blendv_ps(p, from_lo, below);
+	*v = _mm256_xor_ps(*v, _mm256_and_ps(_mm256_or_ps(below, above), _mm256_set1_ps(-0.0f)));
+	_mm256_storeu_ps(at, p);
+}
+
+HERD_TARGET("avx2")
+size_t Herd::wander_avx2(float dt, size_t begin, size_t end) {
+	end = begin + (end - begin) / 8 * 8;
+	__m256 const dt8 = _mm256_set1_ps(dt);
+	__m256 const zero = _mm256_setzero_ps();
+	__m256 const one = _mm256_set1_ps(1.0f);
+	for (size_t i = begin; i < end; i += 8) {
+		__m256i r = xorshift8(_mm256_loadu_si256(reinterpret_cast< __m256i const * >(&random[i])));
+		__m256 rx = unit8(r);
+		r = xorshift8(r);
+		__m256 ry = unit8(r);
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(&random[i]), r);
+
+		__m256 push = _mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&crowd[i]), one), zero), _mm256_set1_ps(CrowdAccel));
+		__m256 ax = accel8(rx, _mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&center_x[i]), push, min.x + EdgeMargin, max.x - EdgeMargin);
+		__m256 ay = accel8(ry, _mm256_loadu_ps(&y[i]), _mm256_loadu_ps(&center_y[i]), push, min.y + EdgeMargin, max.y - EdgeMargin);
+
+		__m256 w = _mm256_mul_ps(_mm256_loadu_ps(&wander[i]), dt8);
+		__m256 nvx = _mm256_add_ps(_mm256_loadu_ps(&vx[i]), _mm256_mul_ps(ax, w));
+		__m256 nvy = _mm256_add_ps(_mm256_loadu_ps(&vy[i]), _mm256_mul_ps(ay, w));
+		__m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(nvx, nvx), _mm256_mul_ps(nvy, nvy)));
+		__m256 slow = _mm256_min_ps(one, _mm256_div_ps(_mm256_set1_ps(MaxSpeed), speed));
+		nvx = _mm256_mul_ps(nvx, slow);
+		nvy = _mm256_mul_ps(nvy, slow);
+
+		move8(&x[i], &nvx, dt8, min.x, max.x);
+		move8(&y[i], &nvy, dt8, min.y, max.y);
+		_mm256_storeu_ps(&vx[i], nvx);
+		_mm256_storeu_ps(&vy[i], nvy);
+	}
+	return end;
+}
+
+#else //no SIMD versions on this CPU family
+
+bool Herd::supported(Kernel kernel_) {
+	return kernel_ == Scalar;
+}
+size_t Herd::wander_sse2(float dt, size_t begin, size_t end) {
+	return begin;
+}
+size_t Herd::wander_avx2(float dt, size_t begin, size_t end) {
+	return begin;
+}
+
+#endif
+
+Herd::Kernel Herd::fastest_kernel() {
+	if (supported(AVX2)) return AVX2;
+	if (supported(SSE2)) return SSE2;
+	return Scalar;
+}
+
+float Herd::heading_of(uint32_t direction) {
+	return float(direction - 1) * float(M_PI / 4.0);
+}
+
+uint32_t Herd::direction_of(float heading_) {
+	int32_t eighths = int32_t(std::lround(heading_ / float(M_PI / 4.0))) % 8;
+	if (eighths < 0) eighths += 8;
+	return uint32_t(eighths) + 1;
+}
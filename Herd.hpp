@@ -0,0 +1,149 @@
+#pragma once
+
+#include "Entities.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct Jobs;
+
+/*
+ * Herd stores every animal (wolf included) as a struct of arrays -- one
+ * array per attribute, indexed by Entities::index(id) -- so stepping or
+ * drawing tens of thousands of animals walks a few flat arrays instead of
+ * chasing Scene::Transform/Object nodes:
+
+Herd herd(glm::vec2(-5.0f, -4.0f), glm::vec2(5.0f, 4.0f), Game::HerdSeed);
+uint32_t id = herd.add(Herd::Sheep, glm::vec2(1.0f, 2.0f), Herd::heading_of(7));
+...
+herd.step(Game::TickDt);
+...
+herd.ids.for_each([&](uint32_t id){
+	glm::vec2 at = herd.position(id);
+	...
+});
+
+ * Each step, every animal but the wolf wanders: a random walk, pushed away
+ * from crowded spots and back from the edges. The random numbers come from
+ * per-animal generators seeded from 'seed' and the animal's index, so two
+ * herds built the same way (same seed, same animals added in the same
+ * order) stay identical step after step -- that's how the server and the
+ * clients agree on where animals are without sending them.
+ * The per-animal math has SSE2 and AVX2 versions, picked at runtime; they
+ * do exactly the same float operations as the scalar version, so results
+ * don't depend on the CPU. That requires the compiler to keep multiplies
+ * and adds separate and in order, which the Jamfile enforces on every
+ * platform (-ffp-contract=off, /fp:precise): clang fuses them by default
+ * on arm64, so an Apple-silicon client built without the flag would step
+ * the herd differently from an x86 server. Never build with -ffast-math.
+ *
+ * Dead animals stay in the arrays, and keep wandering unseen, until their
+ * index is reused: that way a kill doesn't change how the rest of the herd
+ * moves, even on a client that hears of it a few steps late.
+ */
+
+struct Herd {
+	enum Species : uint8_t {
+		Cow = 0,
+		Pig,
+		Sheep,
+		Wolf,
+		Unknown, //(the server only knows which animal is the wolf)
+	};
+
+	//part of a mesh buffer an animal is drawn with (MeshBuffer::Mesh start/count):
+	struct Skin {
+		uint32_t start = 0;
+		uint32_t count = 0;
+	};
+
+	//animals stay within [min, max] (bouncing off the edges as they step):
+	Herd(glm::vec2 const &min, glm::vec2 const &max, uint32_t seed = 1);
+
+	//new animal, standing still; returns its id:
+	uint32_t add(Species species, glm::vec2 const &at, float heading);
+	//animal 'id' dies (does nothing if it isn't alive):
+	void remove(uint32_t id);
+	//change the species of animal 'id' (wolves don't wander):
+	void set_species(uint32_t id, Species species);
+
+	//wander for 'dt' seconds (see above), then move every animal by its velocity:
+	// (spread over 'jobs', if given; the result is the same either way)
+	void step(float dt, Jobs *jobs = nullptr);
+
+	//wandering:
+	static constexpr const float WanderAccel = 3.0f; //random acceleration, up to this much per axis (units/s^2)
+	static constexpr const float MaxSpeed = 0.5f; //(units/s)
+	static constexpr const float CrowdCell = 1.0f; //animals sharing a CrowdCell x CrowdCell cell push each other apart...
+	static constexpr const float CrowdAccel = 1.5f; //...this hard, per extra animal and unit from the cell's center
+	static constexpr const float EdgeMargin = 0.5f; //animals closer than this to an edge turn back...
+	static constexpr const float EdgeAccel = 8.0f; //...this hard, per unit past the margin
+
+	//per-animal math used by step() (all give identical results):
+	enum Kernel : uint8_t {
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+	static Kernel fastest_kernel(); //(best the CPU running this supports)
+	static bool supported(Kernel kernel);
+	Kernel kernel = fastest_kernel();
+
+	glm::vec2 position(uint32_t id) const {
+		uint32_t i = Entities::index(id);
+		return glm::vec2(x[i], y[i]);
+	}
+	void set_position(uint32_t id, glm::vec2 const &at) {
+		uint32_t i = Entities::index(id);
+		x[i] = at.x;
+		y[i] = at.y;
+	}
+
+	//copy what drawing needs -- which animals are alive, where, facing which way, in which skin -- from 'from':
+	// (so one copy can be drawn while the other steps)
+	void copy_look(Herd const &from);
+
+	//heading (radians counterclockwise from +x, which is how the meshes face at heading 0)
+	// <-> Protocol::Direction::direction (1 = right, 2 = up-right, ... counterclockwise):
+	static float heading_of(uint32_t direction);
+	static uint32_t direction_of(float heading);
+
+	glm::vec2 min, max;
+	uint32_t seed;
+	uint32_t tick = 0; //steps taken
+
+	Entities ids; //which animals are alive
+
+	//per-animal attributes, indexed by Entities::index(id):
+	std::vector< float > x, y; //position
+	std::vector< float > vx, vy; //velocity (units per second)
+	std::vector< float > heading; //facing, in radians (see heading_of)
+	std::vector< uint8_t > species; //Species
+	std::vector< uint8_t > skin; //index into 'skins' (starts as the animal's species)
+	std::vector< float > wander; //1 if the animal wanders, 0 if not (the wolf)
+	std::vector< uint32_t > random; //state of each animal's random number generator (xorshift32)
+
+	//mesh ranges animals are drawn with, by Species (filled in by the client):
+	std::vector< Skin > skins;
+
+	//internals:
+	struct Cell {
+		uint32_t tick = 0; //step the totals below are from
+		float count = 0.0f; //wandering animals in the cell
+		float x = 0.0f, y = 0.0f; //sum of their positions
+	};
+	std::vector< Cell > cells; //CrowdCell-sized cells covering [min, max], row by row
+	uint32_t columns = 0, rows = 0;
+	//per-animal scratch, filled in each step before the per-animal math:
+	std::vector< uint32_t > cell_index; //index in 'cells'
+	std::vector< float > crowd; //animals in the same cell (including this one, if it wanders)
+	std::vector< float > center_x, center_y; //center of those animals (or the animal's own position)
+	uint32_t cell_of(float at_x, float at_y) const;
+	//per-animal math for animals [begin, end):
+	// (the SIMD versions stop after the last whole vector and return where they stopped)
+	void wander_scalar(float dt, size_t begin, size_t end);
+	size_t wander_sse2(float dt, size_t begin, size_t end);
+	size_t wander_avx2(float dt, size_t begin, size_t end);
+};
@@ -0,0 +1,258 @@
+#include "Hierarchy.hpp"
+#include "Jobs.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HIERARCHY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HIERARCHY_TARGET(isa)
+#else
+#define HIERARCHY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+Hierarchy::Handle Hierarchy::add(Handle parent_) {
+	assert(parent_ == 0 || alive(parent_));
+	Handle node = ids.create();
+	uint32_t n = Entities::index(node);
+	if (n >= slot.size()) {
+		slot.resize(n + 1, -1U);
+		parent_of.resize(n + 1, 0);
+	}
+	parent_of[n] = parent_;
+
+	//(new nodes go at the end, out of order, until the next update sorts them)
+	slot[n] = uint32_t(handle.size());
+	parent.emplace_back(-1U);
+	position.emplace_back(0.0f);
+	rotation.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+	scale.emplace_back(1.0f);
+	world.emplace_back(1.0f);
+	changed.emplace_back(1);
+	handle.emplace_back(node);
+	restructured = true;
+	return node;
+}
+
+void Hierarchy::remove(Handle node) {
+	if (!alive(node)) return;
+	ids.destroy(node);
+	//(its entry is dropped, and its children made roots, by the next sort)
+	restructured = true;
+}
+
+bool Hierarchy::set_parent(Handle node, Handle parent_) {
+	if (!alive(node) || (parent_ != 0 && !alive(parent_))) return false;
+	//(a removed ancestor ends the chain: sort() makes its children roots)
+	for (Handle above = parent_; above != 0 && alive(above); above = parent_of[Entities::index(above)]) {
+		if (above == node) return false; //(can't move a node under itself)
+	}
+	parent_of[Entities::index(node)] = parent_;
+	changed[slot[Entities::index(node)]] = 1;
+	restructured = true;
+	return true;
+}
+
+void Hierarchy::set_position(Handle node, glm::vec3 const &position_) {
+	assert(alive(node));
+	uint32_t i = slot[Entities::index(node)];
+	position[i] = position_;
+	changed[i] = 1;
+}
+
+void Hierarchy::set_rotation(Handle node, glm::quat const &rotation_) {
+	assert(alive(node));
+	uint32_t i = slot[Entities::index(node)];
+	rotation[i] = rotation_;
+	changed[i] = 1;
+}
+
+void Hierarchy::set_scale(Handle node, glm::vec3 const &scale_) {
+	assert(alive(node));
+	uint32_t i = slot[Entities::index(node)];
+	scale[i] = scale_;
+	changed[i] = 1;
+}
+
+glm::mat4 Hierarchy::world_to_local(Handle node) const {
+	return glm::inverse(local_to_world(node));
+}
+
+void Hierarchy::update(Jobs *jobs) {
+	if (restructured) sort();
+	for (size_t d = 0; d + 1 < level_begin.size(); ++d) {
+		//(each level only reads the one before it, which is finished)
+		auto run = [this](size_t begin, size_t end) {
+			if (kernel == SSE2 && supported(SSE2)) update_sse2(begin, end);
+			else update_scalar(begin, end);
+		};
+		if (jobs) jobs->parallel_for(level_begin[d], level_begin[d + 1], 4096, run);
+		else run(level_begin[d], level_begin[d + 1]);
+	}
+	if (!changed.empty()) std::memset(changed.data(), 0, changed.size());
+}
+
+//array = [array[order[0]], array[order[1]], ...]:
+template< typename T >
+static void permute(std::vector< uint32_t > const &order, std::vector< T > *array) {
+	std::vector< T > sorted;
+	sorted.reserve(order.size());
+	for (uint32_t i : order) {
+		sorted.emplace_back((*array)[i]);
+	}
+	array->swap(sorted);
+}
+
+void Hierarchy::sort() {
+	restructured = false;
+
+	//live nodes' children, grouped by parent (in their current order):
+	std::vector< uint32_t > child_begin(slot.size() + 2, 0);
+	std::vector< uint32_t > roots;
+	for (size_t i = 0; i < handle.size(); ++i) {
+		if (!alive(handle[i])) continue;
+		Handle &above = parent_of[Entities::index(handle[i])];
+		if (above != 0 && !alive(above)) { //(parent was removed)
+			above = 0;
+			changed[i] = 1;
+		}
+		if (above == 0) roots.emplace_back(uint32_t(i));
+		else child_begin[Entities::index(above) + 2] += 1;
+	}
+	for (size_t p = 2; p < child_begin.size(); ++p) {
+		child_begin[p] += child_begin[p - 1];
+	}
+	std::vector< uint32_t > children(child_begin.back());
+	for (size_t i = 0; i < handle.size(); ++i) {
+		if (!alive(handle[i])) continue;
+		Handle above = parent_of[Entities::index(handle[i])];
+		if (above != 0) children[child_begin[Entities::index(above) + 1]++] = uint32_t(i);
+	}
+	//(now children of the node at index p are [child_begin[p], child_begin[p + 1]))
+
+	//breadth-first from the roots gives depth order, with siblings together:
+	std::vector< uint32_t > order(roots);
+	order.reserve(ids.size());
+	level_begin.assign(1, 0);
+	for (size_t at = 0; at < order.size(); ) {
+		size_t level_end = order.size();
+		level_begin.emplace_back(uint32_t(level_end));
+		for (; at < level_end; ++at) {
+			uint32_t p = Entities::index(handle[order[at]]);
+			order.insert(order.end(), children.begin() + child_begin[p], children.begin() + child_begin[p + 1]);
+		}
+	}
+	assert(order.size() == ids.size());
+
+	//rearrange the arrays in that order:
+	permute(order, &position);
+	permute(order, &rotation);
+	permute(order, &scale);
+	permute(order, &world);
+	permute(order, &changed);
+	permute(order, &handle);
+	parent.resize(order.size());
+	for (uint32_t i = 0; i < handle.size(); ++i) {
+		slot[Entities::index(handle[i])] = i;
+	}
+	for (uint32_t i = 0; i < handle.size(); ++i) {
+		Handle above = parent_of[Entities::index(handle[i])];
+		parent[i] = (above == 0 ? -1U : slot[Entities::index(above)]);
+		assert(parent[i] == -1U || parent[i] < i);
+	}
+}
+
+//Built to come out exactly as Scene::Transform::make_local_to_parent's translate * rotate * scale does:
+// those multiplies only add zeros (which turns -0.0f into 0.0f -- hence the '+ 0.0f').
+glm::mat4 Hierarchy::local_to_parent(size_t i) const {
+	glm::mat3 r = glm::mat3_cast(rotation[i]);
+	glm::vec3 const &s = scale[i];
+	return glm::mat4(
+		glm::vec4(r[0] * s.x + 0.0f, 0.0f),
+		glm::vec4(r[1] * s.y + 0.0f, 0.0f),
+		glm::vec4(r[2] * s.z + 0.0f, 0.0f),
+		glm::vec4(position[i], 1.0f)
+	);
+}
+
+void Hierarchy::update_scalar(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		uint32_t p = parent[i];
+		if (p != -1U) changed[i] |= changed[p];
+		if (!changed[i]) continue;
+		if (p == -1U) world[i] = local_to_parent(i);
+		else world[i] = world[p] * local_to_parent(i);
+	}
+}
+
+#ifdef HIERARCHY_X86
+
+static bool cpu_has_sse2() {
+	#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+	#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+	#else
+	return __builtin_cpu_supports("sse2");
+	#endif
+}
+
+bool Hierarchy::supported(Kernel kernel_) {
+	static bool const sse2 = cpu_has_sse2();
+	if (kernel_ == SSE2) return sse2;
+	return true;
+}
+
+//out = a * b, a column at a time: each column of 'a' scaled by one element of b's column, summed
+// in the same order glm sums them (so results match update_scalar bit for bit):
+HIERARCHY_TARGET("sse2")
+static void multiply4(float const *a, float const *b, float *out) {
+	__m128 a0 = _mm_loadu_ps(a + 0);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	for (uint32_t c = 0; c < 4; ++c) {
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[4 * c + 0]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[4 * c + 1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[4 * c + 2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[4 * c + 3])));
+		_mm_storeu_ps(out + 4 * c, r);
+	}
+}
+
+HIERARCHY_TARGET("sse2")
+void Hierarchy::update_sse2(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		uint32_t p = parent[i];
+		if (p != -1U) changed[i] |= changed[p];
+		if (!changed[i]) continue;
+		if (p == -1U) {
+			world[i] = local_to_parent(i);
+		} else {
+			glm::mat4 local = local_to_parent(i);
+			multiply4(&world[p][0][0], &local[0][0], &world[i][0][0]);
+		}
+	}
+}
+
+#else //no SIMD version on this CPU family
+
+bool Hierarchy::supported(Kernel kernel_) {
+	return kernel_ == Scalar;
+}
+void Hierarchy::update_sse2(size_t begin, size_t end) {
+	update_scalar(begin, end);
+}
+
+#endif
+
+Hierarchy::Kernel Hierarchy::fastest_kernel() {
+	if (supported(SSE2)) return SSE2;
+	return Scalar;
+}
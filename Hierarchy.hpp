@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Entities.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct Jobs;
+
+/*
+ * Hierarchy is a transform hierarchy stored flat: each node's local
+ * position/rotation/scale and its world matrix live in arrays sorted by
+ * depth (roots first, then their children, ...), so update() computes
+ * every world matrix in one pass front to back -- each parent's matrix is
+ * done before its children need it -- instead of chasing
+ * Scene::Transform pointers:
+
+Hierarchy hierarchy;
+Hierarchy::Handle body = hierarchy.add();
+Hierarchy::Handle head = hierarchy.add(body);
+hierarchy.set_position(head, glm::vec3(0.0f, 0.0f, 1.5f));
+...
+hierarchy.update(); //(once per frame, after moving things)
+glm::mat4 const &to_world = hierarchy.local_to_world(head);
+
+ * Nodes are named by handles (Entities ids), which stay valid while the
+ * arrays are re-sorted; Scene::Object and Scene::Camera can be attached to
+ * a node instead of a Scene::Transform.
+ *
+ * update() only recomputes nodes that changed (or whose parent did), and
+ * each depth is independent, so it can be spread over Jobs a level at a
+ * time. The 4x4 multiplies use SSE2 where the CPU has it; both versions
+ * give exactly the same matrices as glm (and Scene::Transform) do.
+ */
+
+struct Hierarchy {
+	typedef uint32_t Handle; //(0 means none)
+
+	//new node (at the origin, unrotated, unscaled), under 'parent' if given:
+	Handle add(Handle parent = 0);
+	//remove a node; its children become roots (does nothing if it isn't alive):
+	void remove(Handle node);
+	//move a node (and everything below it) under 'parent' (0 for none):
+	// returns false, leaving the node where it was, if 'parent' is the node itself or one of its
+	// descendants (which would make a cycle), or if either isn't alive.
+	bool set_parent(Handle node, Handle parent);
+
+	bool alive(Handle node) const { return ids.alive(node); }
+	size_t size() const { return ids.size(); }
+
+	//local transform, relative to the parent:
+	void set_position(Handle node, glm::vec3 const &position);
+	void set_rotation(Handle node, glm::quat const &rotation);
+	void set_scale(Handle node, glm::vec3 const &scale);
+	glm::vec3 const &position_of(Handle node) const { return position[slot[Entities::index(node)]]; }
+	glm::quat const &rotation_of(Handle node) const { return rotation[slot[Entities::index(node)]]; }
+	glm::vec3 const &scale_of(Handle node) const { return scale[slot[Entities::index(node)]]; }
+
+	//recompute the world matrices of nodes that changed since the last update (and of their descendants):
+	// (spread over 'jobs', if given; the result is the same either way)
+	void update(Jobs *jobs = nullptr);
+
+	//as of the last update():
+	glm::mat4 const &local_to_world(Handle node) const { return world[slot[Entities::index(node)]]; }
+	glm::mat4 world_to_local(Handle node) const;
+
+	//4x4 multiplies used by update() (both give identical results):
+	enum Kernel : uint8_t {
+		Scalar,
+		SSE2,
+	};
+	static Kernel fastest_kernel(); //(best the CPU running this supports)
+	static bool supported(Kernel kernel);
+	Kernel kernel = fastest_kernel();
+
+	//per-node arrays, in update order (sorted by depth):
+	std::vector< uint32_t > parent; //index of the node's parent in these arrays (-1U for roots)
+	std::vector< glm::vec3 > position;
+	std::vector< glm::quat > rotation;
+	std::vector< glm::vec3 > scale;
+	std::vector< glm::mat4 > world; //local-to-world matrix
+	std::vector< uint8_t > changed; //1 if the node's world matrix is out of date
+	std::vector< Handle > handle; //which node is at each index
+	std::vector< uint32_t > level_begin; //nodes at depth d are [level_begin[d], level_begin[d + 1])
+
+	//internals:
+	Entities ids;
+	std::vector< uint32_t > slot; //by Entities::index(handle): the node's index in the arrays above
+	std::vector< Handle > parent_of; //by Entities::index(handle): the node's parent
+	bool restructured = false; //nodes were added, removed, or moved since the arrays were last sorted
+	void sort(); //re-sort the arrays by depth (dropping removed nodes)
+	glm::mat4 local_to_parent(size_t i) const;
+	//update nodes [begin, end) of one level:
+	void update_scalar(size_t begin, size_t end);
+	void update_sse2(size_t begin, size_t end);
+};
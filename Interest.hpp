@@ -0,0 +1,83 @@
+#pragma once
+
+#include "SpatialHash.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+/*
+ * Interest management: rather than telling every client about every
+ * animal that changes, the server marks the animal in each client's
+ * Interest and, every step, sends only the marked animals that are inside
+ * the client's View (the part of the ground its camera can see), nearest
+ * to the middle of the view first, up to a byte budget. Marked animals
+ * that don't make it (out of view or over budget) stay marked for later.
+ *
+ * Animal positions come from a SpatialHash, so finding the ones in a view
+ * doesn't have to look at all of them:
+
+interest.mark(id); //animal 'id' changed
+...
+std::vector< uint32_t > send;
+interest.select(animals, cost_of, 64, &send);
+
+ */
+
+//Ground-plane rectangle a client can see:
+struct View {
+	glm::vec2 min = glm::vec2(-1e30f);
+	glm::vec2 max = glm::vec2( 1e30f);
+
+	bool contains(glm::vec2 const &at) const {
+		return at.x >= min.x && at.x <= max.x && at.y >= min.y && at.y <= max.y;
+	}
+	glm::vec2 center() const { return 0.5f * (min + max); }
+};
+
+//What one client still needs to hear about:
+struct Interest {
+	View view; //(by default, everything)
+
+	//entity 'id' changed in a way this client should hear about:
+	void mark(uint32_t id) {
+		uint32_t i = Entities::index(id);
+		if (i >= dirty.size()) dirty.resize(i + 1, 0);
+		if (!dirty[i]) {
+			dirty[i] = 1;
+			dirty_count += 1;
+		}
+	}
+
+	//pick marked entities inside 'view', nearest to its center first, as long as their
+	// cost_of(id) (in bytes) fits in 'budget' (entities not in 'positions' are never picked); those picked are appended to 'selected' and unmarked:
+	template< typename Cost >
+	void select(SpatialHash const &positions, Cost const &cost_of, uint32_t budget, std::vector< uint32_t > *selected) {
+		if (dirty_count == 0) return;
+		glm::vec2 center = view.center();
+		candidates.clear();
+		positions.query(view.min, view.max, [&](uint32_t id, glm::vec2 const &at){
+			uint32_t i = Entities::index(id);
+			if (i >= dirty.size() || !dirty[i]) return;
+			glm::vec2 to = at - center;
+			candidates.emplace_back(glm::dot(to, to), id);
+		});
+		std::sort(candidates.begin(), candidates.end());
+		for (auto const &c : candidates) {
+			uint32_t cost = cost_of(c.second);
+			if (cost > budget) break;
+			budget -= cost;
+			selected->emplace_back(c.second);
+			dirty[Entities::index(c.second)] = 0;
+			dirty_count -= 1;
+		}
+	}
+
+	//internals:
+	std::vector< uint8_t > dirty; //indexed by Entities::index(id)
+	uint32_t dirty_count = 0;
+	std::vector< std::pair< float, uint32_t > > candidates; //(scratch) squared distance, id
+};
@@ -0,0 +1,140 @@
+#include "Jobs.hpp"
+
+//which Jobs (if any) the current thread works for, and its queue there:
+static thread_local Jobs const *this_thread_jobs = nullptr;
+static thread_local uint32_t this_thread_queue = 0;
+
+Jobs::Jobs(uint32_t threads) {
+	threads = std::max(1U, threads);
+	for (uint32_t i = 0; i < threads; ++i) {
+		queues.emplace_back(new Queue);
+	}
+	workers.reserve(threads - 1);
+	for (uint32_t i = 1; i < threads; ++i) {
+		workers.emplace_back(&Jobs::work, this, i);
+	}
+}
+
+Jobs::~Jobs() {
+	while (run_one(queue_of_this_thread())) {
+	}
+	{
+		std::lock_guard< std::mutex > lock(sleep_lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+uint32_t Jobs::queue_of_this_thread() const {
+	return (this_thread_jobs == this ? this_thread_queue : 0);
+}
+
+void Jobs::run(std::function< void() > const &job, Counter *done) {
+	if (done) done->pending.fetch_add(1, std::memory_order_relaxed);
+	Job j;
+	j.function = job;
+	j.done = done;
+	push(j);
+}
+
+void Jobs::run_after(Counter *after, std::function< void() > const &job, Counter *done) {
+	if (done) done->pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard< std::mutex > lock(after->lock);
+		if (after->pending.load(std::memory_order_acquire) != 0) {
+			after->then.emplace_back(job, done);
+			return;
+		}
+	}
+	Job j;
+	j.function = job;
+	j.done = done;
+	push(j);
+}
+
+void Jobs::wait(Counter *counter) {
+	uint32_t queue = queue_of_this_thread();
+	while (!counter->finished()) {
+		if (!run_one(queue)) std::this_thread::yield();
+	}
+	//(the last job to finish may still be releasing the lock; the counter can't go away until it has)
+	std::lock_guard< std::mutex > lock(counter->lock);
+}
+
+void Jobs::push(Job const &job) {
+	Queue &queue = *queues[queue_of_this_thread()];
+	{
+		std::lock_guard< std::mutex > lock(queue.lock);
+		queue.jobs.emplace_back(job);
+	}
+	queued.fetch_add(1, std::memory_order_release);
+	if (!workers.empty()) {
+		//(taking the lock means no worker is between checking 'queued' and sleeping)
+		{ std::lock_guard< std::mutex > lock(sleep_lock); }
+		wake.notify_one();
+	}
+}
+
+bool Jobs::run_one(uint32_t index) {
+	if (queued.load(std::memory_order_acquire) == 0) return false;
+	Job job;
+	bool found = false;
+	{ //newest of our own jobs:
+		Queue &queue = *queues[index];
+		std::lock_guard< std::mutex > lock(queue.lock);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			found = true;
+		}
+	}
+	//...or the oldest job of some other thread:
+	for (uint32_t i = 1; !found && i < queues.size(); ++i) {
+		Queue &queue = *queues[(index + i) % queues.size()];
+		std::lock_guard< std::mutex > lock(queue.lock);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			found = true;
+		}
+	}
+	if (!found) return false;
+	queued.fetch_sub(1, std::memory_order_relaxed);
+	job.function();
+	finish(job.done);
+	return true;
+}
+
+void Jobs::finish(Counter *done) {
+	if (!done) return;
+	std::vector< std::pair< std::function< void() >, Counter * > > then;
+	{
+		std::lock_guard< std::mutex > lock(done->lock);
+		if (done->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			then.swap(done->then);
+		}
+	}
+	//(the counter may be gone by now; only its continuations are touched)
+	for (auto &next : then) {
+		Job j;
+		j.function = std::move(next.first);
+		j.done = next.second;
+		push(j);
+	}
+}
+
+void Jobs::work(uint32_t index) {
+	this_thread_jobs = this;
+	this_thread_queue = index;
+	while (true) {
+		if (run_one(index)) continue;
+		std::unique_lock< std::mutex > lock(sleep_lock);
+		wake.wait(lock, [this](){
+			return quit || queued.load(std::memory_order_acquire) != 0;
+		});
+		if (quit && queued.load(std::memory_order_acquire) == 0) return;
+	}
+}
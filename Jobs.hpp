@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Jobs is a fixed pool of worker threads that run small jobs (functions),
+ * for splitting per-frame work -- stepping the herd, computing matrices --
+ * across cores:
+
+Jobs jobs; //(one thread per core, counting the thread that creates it)
+jobs.parallel_for(0, herd.x.size(), 4096, [&](size_t begin, size_t end){
+	...animals [begin, end)...
+});
+
+ * Each thread has its own deque of jobs: it pushes and pops at the back
+ * (newest first, while its data is still in cache), and threads that run
+ * out of work steal from the front of another thread's deque. A thread
+ * waiting for jobs to finish runs jobs meanwhile, so jobs can wait too.
+ *
+ * Counters tie jobs into a dependency graph -- a job can be queued to run
+ * once a counter reaches zero, and a counter can be waited for -- which is
+ * how the client steps the herd for the next frame while this one draws:
+
+Jobs::Counter stepped, synced;
+jobs.run([&](){ state.herd.step(Game::TickDt); }, &stepped);
+jobs.run_after(&stepped, [&](){ update_hash(); }, &synced);
+...draw from a copy of the herd...
+jobs.wait(&synced);
+
+ */
+
+struct Jobs {
+	//'threads' counts the creating thread, so Jobs(1) starts no workers (jobs then run inside wait()):
+	explicit Jobs(uint32_t threads = std::thread::hardware_concurrency());
+	~Jobs(); //(runs any jobs still queued first; wait for counters before this, so none queue more)
+
+	//number of jobs started with it (and not yet finished), plus jobs to start when that reaches zero:
+	struct Counter {
+		Counter() = default;
+		Counter(Counter const &) = delete;
+		Counter &operator=(Counter const &) = delete;
+		bool finished() const { return pending.load(std::memory_order_acquire) == 0; }
+
+		//internals:
+		std::atomic< uint32_t > pending{0};
+		std::mutex lock; //guards 'then', and is held while 'pending' drops to zero
+		std::vector< std::pair< std::function< void() >, Counter * > > then;
+	};
+
+	//queue 'job' (counting it in 'done', if given):
+	void run(std::function< void() > const &job, Counter *done = nullptr);
+	//queue 'job' once 'after' reaches zero (right away if it already has):
+	void run_after(Counter *after, std::function< void() > const &job, Counter *done = nullptr);
+	//run jobs until 'counter' reaches zero:
+	void wait(Counter *counter);
+
+	//call 'f(b, e)' on consecutive ranges covering [begin, end), each at least 'grain' long (but the last),
+	// in parallel; returns when all are done:
+	template< typename F >
+	void parallel_for(size_t begin, size_t end, size_t grain, F const &f) {
+		if (end <= begin) return;
+		grain = std::max< size_t >(grain, 1);
+		//a few ranges per thread, so threads that finish early can steal:
+		size_t size = std::max(grain, (end - begin + 4 * threads() - 1) / (4 * threads()));
+		if (workers.empty() || size >= end - begin) {
+			f(begin, end);
+			return;
+		}
+		Counter done;
+		for (size_t b = begin + size; b < end; b += size) {
+			size_t e = std::min(end, b + size);
+			run([&f, b, e](){ f(b, e); }, &done);
+		}
+		f(begin, begin + size);
+		wait(&done);
+	}
+
+	//threads that run jobs (workers, plus the creating thread):
+	uint32_t threads() const { return uint32_t(workers.size()) + 1; }
+
+	//internals:
+	struct Job {
+		std::function< void() > function;
+		Counter *done = nullptr;
+	};
+	struct Queue {
+		std::mutex lock;
+		std::deque< Job > jobs;
+		char pad[64]; //(keep neighboring queues' locks off each other's cache lines)
+	};
+	std::vector< std::unique_ptr< Queue > > queues; //[0]: jobs queued by threads that aren't workers; [1 + i]: worker i's
+	std::vector< std::thread > workers;
+	std::atomic< uint32_t > queued{0}; //jobs in all queues
+	std::mutex sleep_lock; //idle workers wait on 'wake' with this
+	std::condition_variable wake;
+	bool quit = false; //(guarded by sleep_lock)
+
+	uint32_t queue_of_this_thread() const;
+	void push(Job const &job);
+	bool run_one(uint32_t queue); //run a job from 'queue' (or stolen from another); false if there were none
+	void finish(Counter *done);
+	void work(uint32_t queue); //worker thread body
+};
@@ -0,0 +1,78 @@
+#include "Lockstep.hpp"
+
+#include <algorithm>
+
+Lockstep::Lockstep(Player player_) : player(player_) {
+	//the first Delay ticks run with no input from anyone:
+	inputs[Hunter].assign(Delay, 0);
+	inputs[Wolf].assign(Delay, 0);
+	sent = Delay;
+}
+
+void Lockstep::local(uint8_t bits) {
+	inputs[player].emplace_back(bits);
+}
+
+void Lockstep::receive(Protocol::LockstepInput const &message) {
+	std::deque< uint8_t > &theirs = inputs[1 - player];
+	uint32_t count = std::min(uint32_t(message.count), uint32_t(Protocol::LockstepInput::MaxTicks));
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t t = message.tick + i;
+		uint32_t next = tick + uint32_t(theirs.size()) + 1;
+		if (t < next) continue; //(already have it)
+		if (t > next) break; //(gap; can't happen over an ordered connection)
+		theirs.emplace_back(message.bits[i]);
+	}
+
+	if (message.hash_tick == 0) return;
+	for (auto const &ours : hashes) {
+		if (ours.first == message.hash_tick) {
+			compare(ours.first, ours.second, message.hash);
+			return;
+		}
+	}
+	if (message.hash_tick > tick) {
+		their_hashes.emplace_back(message.hash_tick, message.hash);
+	}
+}
+
+bool Lockstep::next_message(Protocol::LockstepInput *message) {
+	uint32_t waiting = scheduled() - sent;
+	if (waiting < SendEvery) return false;
+	message->tick = sent + 1;
+	message->count = uint8_t(std::min(waiting, uint32_t(Protocol::LockstepInput::MaxTicks)));
+	message->reserved[0] = message->reserved[1] = message->reserved[2] = 0;
+	for (uint32_t i = 0; i < Protocol::LockstepInput::MaxTicks; ++i) {
+		//(inputs[player][k] is for tick 'tick + 1 + k')
+		message->bits[i] = (i < message->count ? inputs[player][sent + i - tick] : 0);
+	}
+	message->hash_tick = (hashes.empty() ? 0 : hashes.back().first);
+	message->hash = (hashes.empty() ? 0 : hashes.back().second);
+	sent += message->count;
+	return true;
+}
+
+uint32_t Lockstep::advance(Game *game) {
+	uint32_t ran = 0;
+	//(local input is only dropped once it has been sent)
+	while (!inputs[Hunter].empty() && !inputs[Wolf].empty() && sent > tick) {
+		game->tick(inputs[Hunter].front(), inputs[Wolf].front());
+		inputs[Hunter].pop_front();
+		inputs[Wolf].pop_front();
+		tick += 1;
+		ran += 1;
+
+		uint32_t hash = game->hash();
+		hashes.emplace_back(tick, hash);
+		if (hashes.size() > HashHistory) hashes.pop_front();
+		while (!their_hashes.empty() && their_hashes.front().first <= tick) {
+			if (their_hashes.front().first == tick) compare(tick, hash, their_hashes.front().second);
+			their_hashes.pop_front();
+		}
+	}
+	return ran;
+}
+
+void Lockstep::compare(uint32_t at, uint32_t ours, uint32_t theirs) {
+	if (ours != theirs && desynced_at == 0) desynced_at = at;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Game.hpp"
+#include "Protocol.hpp"
+
+#include <deque>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+/*
+ * Lockstep runs a match the other way around from the server-simulated
+ * one: peers exchange only their input bits for each tick (a few bytes,
+ * however big the herd), and every peer runs Game::tick() on both players'
+ * inputs. Since Game::tick() does the same float operations in the same
+ * order everywhere (see Herd.hpp), every peer ends up in the same state --
+ * but only if every peer was built with the same floating-point flags (the
+ * Jamfile's -ffp-contract=off, /fp:precise on Windows). A build that lets
+ * the compiler fuse or reorder float math will drift from one that doesn't.
+ * 'bench lockstep' runs both peers in one binary, so it can't catch that.
+ *
+ * Local input for tick t is applied at tick t + Delay, giving it time to
+ * reach the other peer; a peer can only run ticks whose inputs from both
+ * players have arrived. Each message also carries the hash of the
+ * sender's state after its latest tick, so peers notice if they ever
+ * disagree (staying in sync is only guaranteed between builds compiled
+ * with identical floating-point flags; a desync is reported, not repaired):
+
+Lockstep lockstep(Lockstep::Hunter);
+//each tick:
+lockstep.local(state.controls.bits() | (attacking ? Game::Controls::Attack : 0));
+Protocol::LockstepInput message;
+while (lockstep.next_message(&message)) send_message(connection, message);
+//on LockstepInput from the other peer:
+lockstep.receive(message);
+//then:
+lockstep.advance(&state);
+if (lockstep.desynced_at) ...
+
+ */
+
+struct Lockstep {
+	enum Player : uint32_t {
+		Hunter = 0,
+		Wolf = 1,
+	};
+	static constexpr const uint32_t Delay = 4; //ticks between local input and the tick it is applied at
+	static constexpr const uint32_t SendEvery = 3; //ticks of input per message
+	static constexpr const uint32_t HashHistory = 256; //ticks of hashes kept for comparing with the other peer's
+
+	explicit Lockstep(Player player);
+
+	//input for this peer's next tick (applied Delay ticks after the last one given):
+	void local(uint8_t bits);
+	//input (and a hash) from the other peer:
+	void receive(Protocol::LockstepInput const &message);
+	//fill 'message' with local input not yet sent: returns false if fewer than SendEvery ticks are waiting.
+	bool next_message(Protocol::LockstepInput *message);
+
+	//run every tick whose inputs are in; returns the number of ticks run:
+	uint32_t advance(Game *game);
+
+	Player player;
+	uint32_t tick = 0; //ticks run
+	uint32_t desynced_at = 0; //first tick at which the other peer's hash differed from ours (0 if none has)
+
+	//internals:
+	std::deque< uint8_t > inputs[2]; //inputs for ticks tick + 1, tick + 2, ..., by player
+	uint32_t sent = 0; //last tick of local input sent
+	std::deque< std::pair< uint32_t, uint32_t > > hashes; //(tick, hash) of our recent ticks, oldest first
+	std::deque< std::pair< uint32_t, uint32_t > > their_hashes; //(tick, hash) from the other peer, for ticks we haven't run yet
+	//last tick local input is known for:
+	uint32_t scheduled() const { return tick + uint32_t(inputs[player].size()); }
+	void compare(uint32_t tick, uint32_t ours, uint32_t theirs);
+};
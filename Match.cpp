@@ -0,0 +1,371 @@
+#include "Match.hpp"
+
+#include "Protocol.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+MatchManager::MatchManager() {
+	{ //UDP tokens only have to be hard to guess:
+		std::random_device device;
+		tokens.seed((uint64_t(device()) << 32) | device());
+	}
+
+	handlers.on< Protocol::Hello >([this](Connection *c, Protocol::Hello const &) {
+		if (match_of.count(c)) return; //already playing
+		Protocol::Identity identity;
+		if (waiting == NoMatch) {
+			waiting = start_match(c);
+			identity.role = 'h';
+		} else {
+			Match &match = matches[waiting];
+			match.wolf = c;
+			match_of[c] = waiting;
+			waiting = NoMatch;
+			identity.role = 'w';
+		}
+		send_message(*c, identity);
+		Match *match = match_for(c);
+		offer_udp(c, (c == match->hunter ? &match->hunter_token : &match->wolf_token));
+	});
+
+	handlers.on< Protocol::Ping >([](Connection *c, Protocol::Ping const &ping) {
+		//answered whether or not the sender is in a match:
+		Protocol::Pong pong;
+		pong.time = ping.time;
+		send_message(*c, pong);
+	});
+
+	handlers.on< Protocol::AnimalCount >([this](Connection *c, Protocol::AnimalCount const &message) {
+		Match *match = match_for(c);
+		if (!match || c != match->hunter) return;
+		// ids 1 .. count, as the client numbered them
+		Herd &herd = match->state.herd;
+		if (herd.ids.size() != 0) return; //already counted
+		if (message.count > Protocol::AnimalCount::MaxCount) return; //(every one would be stepped every tick)
+		for (uint32_t i = 0; i < message.count; i++) {
+			herd.add(Herd::Unknown, glm::vec2(0.0f), 0.0f);
+		}
+	});
+
+	handlers.on< Protocol::Placement >([this](Connection *c, Protocol::Placement const &message) {
+		// placements come from the hunter (possibly after the wolf has joined)
+		Match *match = match_for(c);
+		if (!match || c != match->hunter) return;
+		Game &state = match->state;
+		if (match->placed) return; //(the herd has started wandering)
+		if (message.kind == Protocol::Placement::Crosshair) {
+			//(sent last)
+			state.crosshair = message.position;
+			match->placed = true;
+			return;
+		}
+		if (!state.herd.ids.alive(message.id)) return; //(not counted)
+		if (message.kind == Protocol::Placement::Wolf) {
+			state.wolf_id = message.id;
+			state.wolf = message.position;
+			state.herd.set_species(message.id, Herd::Wolf);
+		}
+		state.herd.set_position(message.id, message.position);
+		state.animals.insert(message.id, message.position);
+	});
+
+	handlers.on< Protocol::View >([this](Connection *c, Protocol::View const &message) {
+		Match *match = match_for(c);
+		if (!match) return;
+		if (!(message.min.x <= message.max.x && message.min.y <= message.max.y)) return; //(also rejects NaN)
+		Interest &interest = (c == match->hunter ? match->hunter_interest : match->wolf_interest);
+		interest.view.min = message.min;
+		interest.view.max = message.max;
+	});
+
+	handlers.on< Protocol::Input >([this](Connection *c, Protocol::Input const &message) {
+		// ignore any input received before both of two players are registered
+		Match *match = match_for(c);
+		if (!match || !match->started()) return;
+		if (c == match->hunter) {
+			match->hunter_input.receive(message);
+		} else {
+			match->wolf_input.receive(message);
+		}
+	});
+
+	handlers.on< Protocol::Attack >([this](Connection *c, Protocol::Attack const &message) {
+		Match *match = match_for(c);
+		if (!match || !match->started()) return;
+		Game &state = match->state;
+		// the wolf can't eat itself
+		if (c == match->wolf && message.target == state.wolf_id) return;
+		glm::vec2 from = (c == match->hunter ? state.crosshair : state.wolf);
+		if (state.in_reach(from, message.target, AttackSlack)) {
+			//(hunter and wolf will hear about it once it is in their view, see send_animals)
+			state.herd.remove(message.target);
+			match->hunter_interest.mark(message.target);
+			match->wolf_interest.mark(message.target);
+		}
+	});
+
+	handlers.on< Protocol::Direction >([this](Connection *c, Protocol::Direction const &message) {
+		Match *match = match_for(c);
+		if (!match || !match->started() || c != match->wolf) return;
+		if (!match->state.herd.ids.alive(message.id) || message.direction < 1 || message.direction > 8) return;
+		float &heading = match->state.herd.heading[Entities::index(message.id)];
+		if (heading == Herd::heading_of(message.direction)) return; //(over UDP, the wolf repeats it)
+		heading = Herd::heading_of(message.direction);
+		match->hunter_interest.mark(message.id);
+	});
+
+	handlers.on< Protocol::ChangeSkin >([this](Connection *c, Protocol::ChangeSkin const &message) {  // wolf change skin
+		Match *match = match_for(c);
+		if (!match || !match->started() || c != match->wolf) return;
+		if (match->hunter_udp) send_message(match->hunter_udp->reliable, message);
+		else send_message(*match->hunter, message);
+	});
+
+	handlers.on< Protocol::Shoot >([this](Connection *c, Protocol::Shoot const &message) {  // hunter fires
+		Match *match = match_for(c);
+		if (!match || !match->started() || c != match->hunter) return;
+		if (match->wolf_udp) send_message(match->wolf_udp->reliable, message);
+		else send_message(*match->wolf, message);
+	});
+
+	//a UDP peer has to claim an offer before anything else it sends is handled:
+	udp_handlers.on< Protocol::UdpHello >([this](UdpConnection *u, Protocol::UdpHello const &message) {
+		if (player_of.count(u)) return; //already claimed one
+		auto f = offered.find(message.token);
+		if (f == offered.end()) return;
+		Connection *c = f->second;
+		offered.erase(f);
+		Match *match = match_for(c);
+		assert(match); //(offers are withdrawn when their match ends)
+		if (c == match->hunter) {
+			match->hunter_udp = u;
+			match->hunter_token = 0;
+		} else {
+			match->wolf_udp = u;
+			match->wolf_token = 0;
+		}
+		player_of[u] = c;
+		send_message(u->reliable, message); //(claim accepted)
+	});
+}
+
+void MatchManager::on_event(Connection *c, Connection::Event evt) {
+	if (recorder) recorder->record(c, evt);
+	if (evt == Connection::OnOpen) {
+		//nothing to do until the connection says hello
+	} else { assert(evt == Connection::OnRecv || evt == Connection::OnClose);
+		if (evt == Connection::OnRecv) dispatched += handlers.dispatch(c);
+		if (recorder) recorder->handled(c);
+		//connection closed by the peer, or by dispatch() after a malformed frame:
+		if (!*c) {
+			auto f = match_of.find(c);
+			if (f != match_of.end()) end_match(f->second);
+		}
+	}
+}
+
+void MatchManager::on_udp_event(UdpConnection *u, Connection::Event evt) {
+	if (evt == Connection::OnOpen) {
+		//nothing to do until the peer claims an offer
+	} else if (evt == Connection::OnRecv) {
+		auto f = player_of.find(u);
+		if (f == player_of.end()) {
+			uint32_t frames = udp_handlers.dispatch(u, u->reliable.recv_buffer);
+			//anything but a valid claim gets the peer told goodbye (so a client that thinks it's still
+			// connected after this end timed out finds out, and goes back to TCP):
+			if (!player_of.count(u) && (frames != 0 || !u->unreliable.recv_buffer.empty())) u->close();
+			u->unreliable.recv_buffer.clear();
+			return;
+		}
+		Connection *c = f->second;
+		on_udp_frames(c, u->reliable.recv_buffer);
+		if (*c) on_udp_frames(c, u->unreliable.recv_buffer);
+	} else { assert(evt == Connection::OnClose);
+		//peer said goodbye or timed out; the player carries on over TCP:
+		auto f = player_of.find(u);
+		if (f == player_of.end()) return;
+		Match *match = match_for(f->second);
+		if (match && match->hunter_udp == u) match->hunter_udp = nullptr;
+		if (match && match->wolf_udp == u) match->wolf_udp = nullptr;
+		player_of.erase(f);
+	}
+}
+
+void MatchManager::on_udp_frames(Connection *c, ByteBuffer &frames) {
+	if (frames.empty()) return;
+	if (recorder) recorder->record_udp(c, frames);
+	dispatched += handlers.dispatch(c, frames);
+	//a malformed frame closes the player's connection, ending its match:
+	if (!*c) {
+		auto f = match_of.find(c);
+		if (f != match_of.end()) end_match(f->second);
+	}
+}
+
+void MatchManager::update(float elapsed) {
+	accumulated += elapsed;
+	uint32_t steps = 0;
+	while (accumulated >= TickDt) {
+		if (steps == MaxStepsPerUpdate) {
+			//too far behind to catch up; drop the rest:
+			accumulated = 0.0f;
+			break;
+		}
+		accumulated -= TickDt;
+		step();
+		steps += 1;
+	}
+}
+
+void MatchManager::step() {
+	if (recorder) recorder->record_step();
+	for (auto &match : matches) {
+		if (!match.started()) continue;
+		match.hunter_input.step(&match.state.crosshair);
+		match.wolf_input.step(&match.state.wolf);
+		match.tick += 1;
+		if (match.tick % StateEvery == 0) {
+			Snapshot snapshot;
+			snapshot.tick = match.tick;
+			snapshot.crosshair = Snapshot::quantize(match.state.crosshair);
+			snapshot.wolf = Snapshot::quantize(match.state.wolf);
+			//carry on from exactly the positions sent, so clients can replay their inputs on top of them exactly:
+			match.state.crosshair = Snapshot::dequantize(snapshot.crosshair);
+			match.state.wolf = Snapshot::dequantize(snapshot.wolf);
+			send_state(*match.hunter, match.hunter_udp, match.hunter_input, &match.hunter_sent, snapshot);
+			send_state(*match.wolf, match.wolf_udp, match.wolf_input, &match.wolf_sent, snapshot);
+		}
+		//the herd takes one step per tick, starting from where the hunter placed it, just as on the clients:
+		// (so herd tick == match tick once placed)
+		while (match.placed && match.state.herd.tick < match.tick) {
+			match.state.step_herd(TickDt);
+		}
+		if (match.state.herd.ids.alive(match.state.wolf_id)) {
+			match.state.herd.set_position(match.state.wolf_id, match.state.wolf);
+			match.state.animals.insert(match.state.wolf_id, match.state.wolf);
+		}
+		send_animals(*match.hunter, match.hunter_udp, match.state, &match.hunter_interest);
+		send_animals(*match.wolf, match.wolf_udp, match.state, &match.wolf_interest);
+	}
+}
+
+//(States go on the player's unreliable UDP channel if it has one: a lost State is superseded by the next,
+// and the player only acknowledges -- so only gets deltas against -- States it has actually decoded)
+void MatchManager::send_state(Connection &to, UdpConnection *udp, PlayerInput const &input, SnapshotHistory *sent, Snapshot snapshot) {
+	snapshot.ack = input.applied;
+	encode_snapshot(snapshot, sent->find(input.state_ack), &payload);
+	sent->add(snapshot);
+	if (udp) send_frame(udp->unreliable, Protocol::State::Type, payload.data(), payload.size());
+	else send_frame(to, Protocol::State::Type, payload.data(), payload.size());
+}
+
+//send the events the player hasn't heard about yet (within its view and InterestBudget):
+// a dead animal is sent as an Attack on it, a living one as its latest Direction.
+// (over UDP, Attacks go on the reliable channel and Directions on the unreliable one; a lost Direction
+//  leaves the animal facing the old way until it turns again)
+void MatchManager::send_animals(Connection &to, UdpConnection *udp, Game const &state, Interest *interest) {
+	auto cost_of = [&state](uint32_t id) -> uint32_t {
+		//(frame header is two bytes for these small messages)
+		return 2 + uint32_t(state.herd.ids.alive(id) ? sizeof(Protocol::Direction) : sizeof(Protocol::Attack));
+	};
+	selected.clear();
+	interest->select(state.animals, cost_of, InterestBudget, &selected);
+	for (uint32_t id : selected) {
+		if (!state.herd.ids.alive(id)) {
+			Protocol::Attack message;
+			message.target = id;
+			if (udp) send_message(udp->reliable, message);
+			else send_message(to, message);
+		} else {
+			Protocol::Direction message;
+			message.id = id;
+			message.direction = Herd::direction_of(state.herd.heading[Entities::index(id)]);
+			if (udp) send_message(udp->unreliable, message);
+			else send_message(to, message);
+		}
+	}
+}
+
+void PlayerInput::receive(Protocol::Input const &message) {
+	state_ack = std::max(state_ack, message.state_ack);
+	uint32_t count = message.count;
+	if (count > Protocol::Input::MaxTicks) count = Protocol::Input::MaxTicks;
+	if (queued.empty() && message.sequence > next) {
+		//skipped ahead (only over UDP, if every message carrying some ticks was lost); carry on from here:
+		next = message.sequence;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t sequence = message.sequence + i;
+		if (sequence != next + queued.size()) continue; //already have it (or out of order)
+		queued.emplace_back(message.controls[i]);
+	}
+}
+
+void PlayerInput::step(glm::vec2 *at) {
+	uint32_t apply = (queued.size() > MatchManager::MaxQueuedInputs ? 2 : 1);
+	for (uint32_t i = 0; i < apply && !queued.empty(); ++i) {
+		Game::Controls controls;
+		controls.set_bits(queued.front());
+		Game::move(*at, controls, Game::TickDt);
+		queued.pop_front();
+		applied = next;
+		next += 1;
+	}
+}
+
+Match *MatchManager::match_for(Connection *c) {
+	auto f = match_of.find(c);
+	if (f == match_of.end()) return nullptr;
+	return &matches[f->second];
+}
+
+uint32_t MatchManager::start_match(Connection *hunter) {
+	uint32_t index;
+	if (!free_matches.empty()) {
+		index = free_matches.back();
+		free_matches.pop_back();
+	} else {
+		index = uint32_t(matches.size());
+		matches.emplace_back();
+	}
+	matches[index].hunter = hunter;
+	match_of[hunter] = index;
+	return index;
+}
+
+//offer player 'c' a UDP connection (if there's a port to offer):
+void MatchManager::offer_udp(Connection *c, uint64_t *token) {
+	if (udp_port == 0) return;
+	do {
+		*token = tokens();
+	} while (*token == 0 || offered.count(*token));
+	offered[*token] = c;
+	Protocol::UdpOffer offer;
+	offer.token = *token;
+	offer.port = udp_port;
+	memset(offer.reserved, 0, sizeof(offer.reserved));
+	send_message(*c, offer);
+}
+
+//a match ends when either player leaves; the other player is disconnected:
+void MatchManager::end_match(uint32_t index) {
+	Match &match = matches[index];
+	for (Connection *player : {match.hunter, match.wolf}) {
+		if (!player) continue;
+		match_of.erase(player);
+		if (*player) player->close();
+	}
+	for (UdpConnection *udp : {match.hunter_udp, match.wolf_udp}) {
+		if (!udp) continue;
+		player_of.erase(udp);
+		udp->close();
+	}
+	for (uint64_t token : {match.hunter_token, match.wolf_token}) {
+		if (token) offered.erase(token);
+	}
+	if (waiting == index) waiting = NoMatch;
+	match = Match();
+	free_matches.emplace_back(index);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "Connection.hpp"
+#include "UdpConnection.hpp"
+#include "Message.hpp"
+#include "Game.hpp"
+#include "Protocol.hpp"
+#include "Snapshot.hpp"
+#include "Interest.hpp"
+#include "Recording.hpp"
+
+#include <vector>
+#include <deque>
+#include <random>
+#include <unordered_map>
+
+/*
+ * A Match is one two-player game (a hunter and a wolf) hosted by the server.
+ *
+ * MatchManager pairs incoming 'h' hellos into matches -- the first player
+ * to say hello becomes the hunter of a new match, the next one its wolf --
+ * and routes every later message by looking up the sender's match, so a
+ * single server process can host many independent games.
+ *
+ * The server is authoritative: players send only their (per-tick) input
+ * bits, and update() steps every match's Game at Game::TickRate, applying
+ * each player's queued inputs in order, and sends the resulting positions
+ * (with the last input applied, for client-side reconciliation) back to
+ * both players every StateEvery ticks, delta-compressed against the latest
+ * State each player has acknowledged (see Snapshot.hpp).
+ *
+ * Animal events (kills, the wolf turning) aren't sent as they happen;
+ * they're marked in each player's Interest and, every step, those inside
+ * the part of the field the player can see (Protocol::View) are sent, up
+ * to InterestBudget bytes (see Interest.hpp).
+ *
+ * Players say hello over TCP. If the manager is given a UdpServer's port,
+ * each player is also offered a UDP connection (Protocol::UdpOffer); once a
+ * player claims it, States and Directions go to it over the unreliable
+ * channel (so a lost packet doesn't hold up the ones after it) and Attacks,
+ * ChangeSkins and Shoots over the reliable one. A player that never claims
+ * it, or whose UDP connection times out, carries on over TCP:
+
+Server server("1337");
+UdpServer udp("0");
+MatchManager matches;
+matches.udp_port = udp.port();
+auto on_udp_event = [&](UdpConnection *u, Connection::Event evt){
+	matches.on_udp_event(u, evt);
+};
+auto then = std::chrono::steady_clock::now();
+while (1) {
+	server.poll([&](Connection *c, Connection::Event evt){
+		matches.on_event(c, evt);
+	}, matches.time_to_tick());
+	udp.poll(on_udp_event);
+	auto now = std::chrono::steady_clock::now();
+	matches.update(std::chrono::duration< float >(now - then).count());
+	then = now;
+	server.flush();
+	udp.poll(on_udp_event); //(also sends)
+}
+
+ */
+
+//Inputs received from one player, waiting to be applied one per step:
+struct PlayerInput {
+	std::deque< uint8_t > queued; //Game::Controls::bits(), oldest first
+	uint32_t next = 1; //sequence number of queued.front()
+	uint32_t applied = 0; //sequence number of the last input applied (0 if none yet)
+	uint32_t state_ack = 0; //tick of the latest State the player has decoded
+
+	//add the ticks from an Input message (ticks already seen are skipped):
+	void receive(Protocol::Input const &message);
+	//apply queued input to a player's position for one step:
+	// (when no input is queued the player stands still, so every input moves it exactly one TickDt,
+	//  just as the client predicted; when too many are queued, two are applied to catch up)
+	void step(glm::vec2 *at);
+};
+
+struct Match {
+	Connection *hunter = nullptr;
+	Connection *wolf = nullptr;
+
+	//each player's UDP connection, once it has claimed the one it was offered (nullptr until then, or if it never does):
+	UdpConnection *hunter_udp = nullptr;
+	UdpConnection *wolf_udp = nullptr;
+	//token each player was offered (0 if none, or once claimed):
+	uint64_t hunter_token = 0;
+	uint64_t wolf_token = 0;
+
+	Game state;
+
+	PlayerInput hunter_input;
+	PlayerInput wolf_input;
+
+	//States sent to each player (to delta-encode later ones against):
+	SnapshotHistory hunter_sent;
+	SnapshotHistory wolf_sent;
+
+	uint32_t tick = 0; //simulation steps taken since the match started
+	bool placed = false; //the hunter has sent every Placement (the herd starts wandering from there, at herd tick 0)
+
+	//animal events each player hasn't heard about yet:
+	Interest hunter_interest;
+	Interest wolf_interest;
+
+	//both players have arrived:
+	bool started() const { return hunter && wolf; }
+};
+
+struct MatchManager {
+	MatchManager();
+
+	//call with every event from Server::poll:
+	void on_event(Connection *c, Connection::Event evt);
+
+	//if not zero, players are offered UDP connections to this port (see Protocol::UdpOffer):
+	uint16_t udp_port = 0;
+	//call with every event from that port's UdpServer::poll:
+	void on_udp_event(UdpConnection *u, Connection::Event evt);
+	//frames from player 'c' that arrived over its UDP connection (handled just like ones that came over TCP):
+	// (called by on_udp_event, and by Replay)
+	void on_udp_frames(Connection *c, ByteBuffer &frames);
+
+	//advance the simulation clock by 'elapsed' seconds, running as many fixed steps as are due:
+	// (at most MaxStepsPerUpdate; if the server falls further behind, the extra time is dropped)
+	void update(float elapsed);
+	//seconds until the next step is due (use as the poll timeout):
+	float time_to_tick() const { return TickDt - accumulated; }
+
+	//run one simulation step of every started match (sending States every StateEvery ticks):
+	void step();
+
+	static constexpr const float TickDt = Game::TickDt;
+	static constexpr const uint32_t StateEvery = 3; //(20 States per second)
+	static constexpr const uint32_t MaxQueuedInputs = 12; //more than this and inputs are applied two per step
+	static constexpr const uint32_t MaxStepsPerUpdate = 4;
+	//extra distance allowed when checking attacks, since the attacker aimed at a (slightly older) local position:
+	static constexpr const float AttackSlack = 0.25f;
+	//bytes of animal events sent to each player per step (~2 KB/s):
+	static constexpr const uint32_t InterestBudget = 32;
+
+	//if set, every event and step is appended to this recording (see Recording.hpp):
+	Recorder *recorder = nullptr;
+	//frames handled so far (for status reporting):
+	uint64_t dispatched = 0;
+
+	//match a connection belongs to (or nullptr if it hasn't said hello):
+	Match *match_for(Connection *c);
+
+	//number of matches in use (including one that may be waiting for a wolf):
+	size_t active() const { return matches.size() - free_matches.size(); }
+
+	//Match storage is contiguous; matches that end are reset and their slots reused:
+	std::vector< Match > matches;
+
+	//internals:
+	static constexpr const uint32_t NoMatch = -1U;
+	std::vector< uint32_t > free_matches; //indices of unused slots in 'matches'
+	std::unordered_map< Connection *, uint32_t > match_of; //connection -> index in 'matches'
+	std::unordered_map< uint64_t, Connection * > offered; //token -> player it was offered to (until claimed)
+	std::unordered_map< UdpConnection *, Connection * > player_of; //claimed UDP connection -> its player's connection
+	std::mt19937_64 tokens; //(seeded from std::random_device)
+	uint32_t waiting = NoMatch; //match whose hunter is waiting for a wolf
+	float accumulated = 0.0f; //simulation time not yet stepped
+	MessageHandlers handlers;
+	BasicMessageHandlers< UdpConnection > udp_handlers; //(for UDP connections that haven't claimed an offer yet)
+
+	std::vector< uint8_t > payload; //scratch space for encoding States
+	std::vector< uint32_t > selected; //scratch space for choosing animal events to send
+
+	uint32_t start_match(Connection *hunter);
+	void end_match(uint32_t index);
+	void offer_udp(Connection *c, uint64_t *token);
+	void send_state(Connection &to, UdpConnection *udp, PlayerInput const &input, SnapshotHistory *sent, Snapshot snapshot);
+	void send_animals(Connection &to, UdpConnection *udp, Game const &state, Interest *interest);
+};
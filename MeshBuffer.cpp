@@ -164,7 +164,7 @@ const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint instance_buffer) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -188,6 +188,21 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Normal", Normal);
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
+	if (instance_buffer != 0) {
+		GLint location = glGetAttribLocation(program, "InstanceToWorld");
+		if (location == -1) {
+			std::cerr << "WARNING: attribute 'InstanceToWorld' isn't active in program." << std::endl;
+		} else {
+			//(a mat4x3 attribute takes a location per column)
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			for (GLuint column = 0; column < 4; ++column) {
+				glVertexAttribPointer(location + column, 3, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (GLbyte *)0 + column * 3 * sizeof(float));
+				glEnableVertexAttribArray(location + column);
+				glVertexAttribDivisor(location + column, 1);
+			}
+			bound.insert(location);
+		}
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
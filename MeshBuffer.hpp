@@ -44,7 +44,9 @@ struct MeshBuffer {
 	//build a vertex array object that links this vbo to attributes to a program:
 	//  will throw if program defines attributes not contained in this buffer
 	//  and warn if this buffer contains attributes not active in the program
-	GLuint make_vao_for_program(GLuint program) const;
+	//if 'instance_buffer' is given, also links it to the program's per-instance 'InstanceToWorld' attribute:
+	//  one mat4x3 (twelve floats, column-major) per instance, starting at the beginning of the buffer
+	GLuint make_vao_for_program(GLuint program, GLuint instance_buffer = 0) const;
 
 	//internals:
 	std::map< std::string, Mesh > meshes;
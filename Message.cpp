@@ -0,0 +1,45 @@
+#include "Message.hpp"
+
+uint32_t encode_frame_header(uint8_t *header, uint8_t type, size_t size) {
+	assert(size <= MaxMessagePayload);
+
+	//header is the type byte followed by the size as a varint (7 bits per byte, low bits first):
+	uint32_t used = 0;
+	header[used++] = type;
+	uint32_t remain = uint32_t(size);
+	do {
+		uint8_t bits = remain & 0x7f;
+		remain >>= 7;
+		header[used++] = bits | (remain ? 0x80 : 0x00);
+	} while (remain);
+	assert(used <= MaxFrameHeader);
+	return used;
+}
+
+FrameStatus decode_frame(char const *begin, char const *end, uint8_t *type, char const **payload, uint32_t *size, char const **next) {
+	assert(begin < end);
+	char const *at = begin;
+	*type = uint8_t(*at++);
+
+	//decode payload size:
+	uint32_t got = 0;
+	bool complete = false;
+	for (uint32_t shift = 0; at < end; shift += 7) {
+		uint8_t bits = uint8_t(*at++);
+		if (shift > 28 || (shift == 28 && (bits & 0x70))) {
+			return FrameMalformed; //varint is longer than 32 bits
+		}
+		got |= uint32_t(bits & 0x7f) << shift;
+		if (!(bits & 0x80)) {
+			complete = true;
+			break;
+		}
+	}
+	if (complete && got > MaxMessagePayload) return FrameMalformed;
+	if (!complete || size_t(end - at) < got) return FramePartial;
+
+	*payload = at;
+	*size = got;
+	*next = at + got;
+	return FrameComplete;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Connection.hpp"
+
+#include <functional>
+#include <type_traits>
+#include <cstring>
+#include <iostream>
+#include <cassert>
+
+/*
+ * Messages are sent over a Connection as length-prefixed frames:
+ *
+ *   [uint8_t type][payload length as a varint][payload bytes]
+ *
+ * so a reader can always tell where a message ends, can skip messages it
+ * does not understand, and never has to guess sizes from the first byte.
+ *
+ * A message struct is a plain (trivially copyable, packed) struct with a
+ * 'Type' constant; it is sent as its raw bytes:
+
+struct Attack {
+	static constexpr uint8_t Type = 'a';
+	uint32_t target;
+};
+
+Attack attack;
+attack.target = 17;
+send_message(connection, attack);
+
+ * On the receiving end, register handlers in a MessageHandlers table and
+ * call dispatch() when data arrives:
+
+MessageHandlers handlers;
+handlers.on< Attack >([](Connection *c, Attack const &attack){ ... });
+...
+client.poll([&](Connection *c, Connection::Event evt){
+	if (evt == Connection::OnRecv) handlers.dispatch(c);
+});
+
+ */
+
+//Largest payload accepted; anything bigger is treated as a protocol error:
+constexpr const uint32_t MaxMessagePayload = 1 << 20;
+
+//write a frame header (type + varint size) into 'header', which must have room for MaxFrameHeader bytes:
+// returns the number of bytes written.
+constexpr const uint32_t MaxFrameHeader = 1 + 5;
+uint32_t encode_frame_header(uint8_t *header, uint8_t type, size_t size);
+
+//look at the frame starting at 'begin':
+enum FrameStatus {
+	FrameComplete, //whole frame is in [begin, end); type/payload/size are set and *next points just past it
+	FramePartial, //frame continues past 'end'
+	FrameMalformed //header is invalid or payload is larger than MaxMessagePayload
+};
+FrameStatus decode_frame(char const *begin, char const *end, uint8_t *type, char const **payload, uint32_t *size, char const **next);
+
+//append a frame to a connection's send buffer:
+// (works with anything that has a Connection-style send_raw(), e.g. UdpConnection channels)
+template< typename C >
+void send_frame(C &connection, uint8_t type, void const *payload, size_t size) {
+	uint8_t header[MaxFrameHeader];
+	uint32_t used = encode_frame_header(header, type, size);
+	connection.send_raw(header, used);
+	connection.send_raw(payload, size);
+}
+
+//append a message struct (as a frame) to a connection's send buffer:
+template< typename T, typename C >
+void send_message(C &connection, T const &message) {
+	static_assert(std::is_trivially_copyable< T >::value, "messages are sent as raw bytes");
+	send_frame(connection, T::Type, &message, std::is_empty< T >::value ? 0 : sizeof(T));
+}
+
+//Table of handlers for messages arriving on connections of type C:
+template< typename C >
+struct BasicMessageHandlers {
+	typedef std::function< void(C *, char const *payload, size_t size) > Handler;
+
+	//register a handler for the raw payload of frames with a given type:
+	void on(uint8_t type, Handler const &handler) {
+		handlers[type] = handler;
+	}
+
+	//register a handler for a message struct:
+	// (payloads shorter than the struct are reported and skipped; longer ones are truncated)
+	template< typename T >
+	void on(std::function< void(C *, T const &) > const &handler) {
+		static_assert(std::is_trivially_copyable< T >::value, "messages are received as raw bytes");
+		handlers[T::Type] = [handler](C *c, char const *payload, size_t size) {
+			T message;
+			if (!std::is_empty< T >::value) {
+				if (size < sizeof(T)) {
+					std::cerr << "[MessageHandlers] message of type '" << char(T::Type) << "' is too short (" << size << " < " << sizeof(T) << " bytes); skipping." << std::endl;
+					return;
+				}
+				memcpy(&message, payload, sizeof(T));
+			}
+			handler(c, message);
+		};
+	}
+
+	//decode every complete frame in 'buffer' (by default, connection->recv_buffer) and call the matching handlers:
+	// - frames with no registered handler are skipped
+	// - a trailing partial frame is left in the buffer until more data arrives
+	// - a malformed frame closes the connection
+	//returns the number of frames decoded.
+	uint32_t dispatch(C *connection) {
+		return dispatch(connection, connection->recv_buffer);
+	}
+	uint32_t dispatch(C *connection, ByteBuffer &buffer) {
+		assert(connection);
+		//walk every complete frame, then consume them all at once:
+		char const *begin = buffer.data();
+		char const *end = begin + buffer.size();
+		char const *at = begin;
+		uint32_t frames = 0;
+		while (at < end) {
+			uint8_t type;
+			char const *payload;
+			uint32_t size;
+			char const *next;
+			FrameStatus status = decode_frame(at, end, &type, &payload, &size, &next);
+			if (status == FramePartial) break;
+			if (status == FrameMalformed) {
+				std::cerr << "[MessageHandlers] malformed frame; closing connection." << std::endl;
+				connection->close();
+				return frames;
+			}
+			if (handlers[type]) {
+				handlers[type](connection, payload, size);
+			}
+			at = next;
+			frames += 1;
+
+			//handler may have dropped the connection:
+			if (!*connection) return frames;
+		}
+		buffer.consume(at - begin);
+		return frames;
+	}
+
+	Handler handlers[256];
+};
+
+typedef BasicMessageHandlers< Connection > MessageHandlers;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Pool hands out T's from slabs of SlabBytes each, instead of one 'new'
+ * per T. Freed slots go on a free list and are reused (most recently freed
+ * first, while still in cache), so create/destroy churn doesn't grow memory.
+ * Pointers stay valid until destroy(): slabs never move, and they're all
+ * released at once when the pool goes away.
+
+Pool< Scene::Object > objects;
+Scene::Object *object = objects.create(transform); //(arguments go to the constructor)
+...
+objects.destroy(object);
+
+ * The pool doesn't know which of its slots are in use, so the owner must
+ * destroy() everything it created before the pool goes away (Scene keeps
+ * its lists for this).
+ */
+
+template< typename T >
+struct Pool {
+	static constexpr const size_t SlabBytes = 64 * 1024;
+
+	Pool() = default;
+	Pool(Pool const &) = delete;
+	~Pool() {
+		assert(live() == 0 && "everything created from a pool must be destroyed before it");
+	}
+
+	template< typename... Args >
+	T *create(Args&&... args) {
+		if (!free_slots) grow();
+		Slot *slot = free_slots;
+		free_slots = slot->next_free;
+		T *t = new (slot->storage) T(std::forward< Args >(args)...);
+		allocations += 1;
+		return t;
+	}
+
+	void destroy(T *t) {
+		assert(t);
+		t->~T();
+		Slot *slot = reinterpret_cast< Slot * >(t);
+		slot->next_free = free_slots;
+		free_slots = slot;
+		frees += 1;
+	}
+
+	//counters:
+	uint64_t allocations = 0; //create() calls
+	uint64_t frees = 0; //destroy() calls
+	size_t live() const { return size_t(allocations - frees); }
+	size_t capacity() const { return slabs.size() * SlabItems; } //T's that fit without another slab
+	size_t bytes() const { return slabs.size() * SlabItems * sizeof(Slot); } //memory held in slabs
+
+	//internals:
+	union Slot {
+		Slot *next_free;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+	static_assert(alignof(T) <= alignof(std::max_align_t), "Pool's slabs come from plain 'new', which can't over-align");
+	static constexpr const size_t SlabItems = (SlabBytes / sizeof(Slot) > 1 ? SlabBytes / sizeof(Slot) : 1);
+	std::vector< std::unique_ptr< Slot[] > > slabs;
+	Slot *free_slots = nullptr;
+
+	void grow() {
+		slabs.emplace_back(new Slot[SlabItems]);
+		Slot *slab = slabs.back().get();
+		//(threaded so the slab's first slot comes out first)
+		for (size_t i = SlabItems; i > 0; --i) {
+			slab[i - 1].next_free = free_slots;
+			free_slots = &slab[i - 1];
+		}
+	}
+};
@@ -0,0 +1,102 @@
+#include "Prediction.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+uint32_t Prediction::update(float elapsed, Game::Controls const &controls, glm::vec2 *at) {
+	accumulated += elapsed;
+	uint32_t ticks = 0;
+	while (accumulated >= Game::TickDt) {
+		accumulated -= Game::TickDt;
+		sequence += 1;
+		Game::move(*at, controls, Game::TickDt);
+		Tick tick;
+		tick.sequence = sequence;
+		tick.controls = controls.bits();
+		history.emplace_back(tick);
+		if (history.size() > MaxHistory) history.pop_front();
+		ticks += 1;
+	}
+	return ticks;
+}
+
+void Prediction::reconcile(uint32_t tick, uint32_t ack, glm::vec2 const &server_at, glm::vec2 *at) {
+	state_ack = std::max(state_ack, tick);
+	while (!history.empty() && history.front().sequence <= ack) {
+		history.pop_front();
+	}
+	*at = server_at;
+	for (auto const &entry : history) {
+		Game::Controls controls;
+		controls.set_bits(entry.controls);
+		Game::move(*at, controls, Game::TickDt);
+	}
+}
+
+bool Prediction::next_input(Protocol::Input *message, bool resend) {
+	if (sequence - sent < SendEvery) return false;
+
+	//ticks that fell out of the history can't be sent any more:
+	if (!history.empty() && history.front().sequence > sent + 1) {
+		sent = history.front().sequence - 1;
+	}
+
+	//(history only holds unacknowledged ticks, so anything in it before 'sent' can be sent again)
+	uint32_t first = sent + 1;
+	if (resend && sequence - sent < Protocol::Input::MaxTicks && !history.empty()) {
+		uint32_t room = Protocol::Input::MaxTicks - (sequence - sent);
+		first = std::max(history.front().sequence, first - std::min(room, first - 1));
+	}
+
+	message->sequence = first;
+	message->state_ack = state_ack;
+	message->count = 0;
+	message->reserved[0] = message->reserved[1] = message->reserved[2] = 0;
+	for (auto const &tick : history) {
+		if (tick.sequence < first) continue;
+		if (message->count == Protocol::Input::MaxTicks) break;
+		message->controls[message->count] = tick.controls;
+		message->count += 1;
+	}
+	for (uint32_t i = message->count; i < Protocol::Input::MaxTicks; ++i) {
+		message->controls[i] = 0;
+	}
+	if (message->count == 0) return false;
+	sent = std::max(sent, first + message->count - 1);
+	return true;
+}
+
+void Interpolation::push(uint32_t tick, glm::vec2 const &at) {
+	if (!snapshots.empty() && tick <= snapshots.back().tick) return; //stale
+	Snapshot snapshot;
+	snapshot.tick = tick;
+	snapshot.at = at;
+	snapshots.emplace_back(snapshot);
+}
+
+glm::vec2 Interpolation::update(float elapsed) {
+	if (snapshots.empty()) return glm::vec2(0.0f);
+
+	//keep the playback clock Delay behind the newest State, speeding up or slowing down
+	// slightly to follow it, and jumping if it's far off (e.g., at the start):
+	double target = double(snapshots.back().tick) - Delay / Game::TickDt;
+	double behind = target - playback;
+	if (!playing || std::abs(behind) > 1.0 / Game::TickDt) {
+		playback = target;
+		playing = true;
+	} else {
+		double rate = std::max(0.9, std::min(1.1, 1.0 + 0.05 * behind));
+		playback += rate * elapsed / Game::TickDt;
+	}
+
+	//drop snapshots that are no longer needed (keeping the last one at or before playback):
+	while (snapshots.size() >= 2 && snapshots[1].tick <= playback) {
+		snapshots.pop_front();
+	}
+
+	Snapshot const &a = snapshots.front();
+	if (playback <= a.tick || snapshots.size() == 1) return a.at;
+	Snapshot const &b = snapshots[1];
+	float amt = float((playback - a.tick) / double(b.tick - a.tick));
+	return glm::mix(a.at, b.at, amt);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Game.hpp"
+#include "Protocol.hpp"
+
+#include <glm/glm.hpp>
+
+#include <deque>
+
+/*
+ * Client-side helpers for smooth movement over a slow (20 Hz) State stream.
+ *
+ * Prediction moves the local player right away, in the same fixed ticks
+ * (Game::TickDt, Game::move) the server uses, and remembers each tick's
+ * controls until a State acknowledges it. When a State arrives, the player
+ * is put where the server says and the unacknowledged ticks are replayed:
+
+Prediction prediction;
+//each frame:
+prediction.update(elapsed, state.controls, &state.wolf);
+Protocol::Input input;
+while (prediction.next_input(&input)) send_message(connection, input);
+//on State (decoded into 'snapshot'):
+prediction.reconcile(snapshot.tick, snapshot.ack, Snapshot::dequantize(snapshot.wolf), &state.wolf);
+
+ * Interpolation shows the other player Delay seconds in the past, blending
+ * between the positions from the two States around that time:
+
+Interpolation remote;
+//on State:
+remote.push(snapshot.tick, Snapshot::dequantize(snapshot.crosshair));
+//each frame:
+state.crosshair = remote.update(elapsed);
+
+ */
+
+struct Prediction {
+	//advance by 'elapsed' seconds: runs every whole tick that is due, moving '*at' by 'controls':
+	// returns the number of ticks run.
+	uint32_t update(float elapsed, Game::Controls const &controls, glm::vec2 *at);
+
+	//the server reports that at 'tick', after applying input 'ack', the player was at 'server_at':
+	// sets '*at' to that position with the not-yet-applied inputs replayed on top.
+	// ('tick' is acknowledged in the next Input message)
+	void reconcile(uint32_t tick, uint32_t ack, glm::vec2 const &server_at, glm::vec2 *at);
+
+	//fill 'message' with ticks that haven't been sent yet:
+	// returns false (and leaves 'message' alone) if fewer than SendEvery are waiting.
+	// with 'resend' (for a transport that may drop messages), whatever room is left in the message is
+	//  filled with the latest ticks already sent that no State has acknowledged yet, ahead of the new ones.
+	bool next_input(Protocol::Input *message, bool resend = false);
+
+	static constexpr const uint32_t SendEvery = 3; //ticks per Input message (20 per second)
+	static constexpr const uint32_t MaxHistory = 256; //ticks kept for replay (~4 seconds)
+
+	//internals:
+	struct Tick {
+		uint32_t sequence;
+		uint8_t controls;
+	};
+	std::deque< Tick > history; //ticks not yet acknowledged by the server, oldest first
+	uint32_t sequence = 0; //sequence number of the last tick run
+	uint32_t sent = 0; //sequence number of the last tick sent
+	uint32_t state_ack = 0; //tick of the latest State reconciled with
+	float accumulated = 0.0f; //time not yet run as ticks
+};
+
+struct Interpolation {
+	//add the position from the State for server tick 'tick':
+	void push(uint32_t tick, glm::vec2 const &at);
+
+	//advance the playback clock by 'elapsed' seconds and return the position to show:
+	glm::vec2 update(float elapsed);
+
+	//have any positions been pushed?
+	bool empty() const { return snapshots.empty(); }
+
+	static constexpr const float Delay = 0.1f; //seconds behind the newest State
+
+	//internals:
+	struct Snapshot {
+		uint32_t tick;
+		glm::vec2 at;
+	};
+	std::deque< Snapshot > snapshots; //oldest first
+	double playback = 0.0; //(in ticks) server time being shown
+	bool playing = false;
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+//Messages exchanged between server and clients.
+// each is sent as the payload of a frame (see Message.hpp) tagged with its 'Type'.
+namespace Protocol {
+
+//client -> server: request a role in the game
+struct Hello {
+	static constexpr uint8_t Type = 'h';
+};
+
+//server -> client: assigned role
+struct Identity {
+	static constexpr uint8_t Type = 'i';
+	char role; //'h' for hunter, 'w' for wolf
+};
+static_assert(sizeof(Identity) == 1, "Identity is packed.");
+
+//server -> client (right after Identity): a UDP port on the server and a token to claim it with
+// (a client that claims it -- see UdpHello -- gets States and Directions on the unreliable channel of a
+//  UdpConnection, and Attacks, ChangeSkins and Shoots on its reliable one, instead of over TCP; see
+//  UdpConnection.hpp. Everything else, and everything for a client that doesn't claim it, stays on TCP.)
+struct UdpOffer {
+	static constexpr uint8_t Type = 'u';
+	uint64_t token; //never 0
+	uint16_t port;
+	uint8_t reserved[6];
+};
+static_assert(sizeof(UdpOffer) == 8 + 2 + 6, "UdpOffer is packed.");
+
+//client -> server, first thing on the reliable channel of a UdpConnection to the offered port: claims the offer;
+// server -> client, on the same channel: the claim was accepted
+// (from then on, the client sends Input and Direction on the unreliable channel, and Attack, ChangeSkin and
+//  Shoot on the reliable one; a UDP peer that sends anything before a valid claim is told goodbye)
+struct UdpHello {
+	static constexpr uint8_t Type = 'U';
+	uint64_t token; //as offered
+};
+static_assert(sizeof(UdpHello) == 8, "UdpHello is packed.");
+
+//hunter -> server: number of animals in the scene (ids are 1 .. count)
+// (counts over MaxCount are refused; the farm scene has 11 animals, loadgen's bots announce 40)
+struct AnimalCount {
+	static constexpr uint8_t Type = 'l';
+	static constexpr uint32_t MaxCount = 256;
+	uint32_t count;
+};
+static_assert(sizeof(AnimalCount) == 4, "AnimalCount is packed.");
+
+//hunter -> server: where each animal (and the crosshair) starts; sent after AnimalCount
+// (the server never loads the scene, so this is what it simulates from and checks attacks against;
+//  the Crosshair placement comes last, and the herd starts wandering from there)
+struct Placement {
+	static constexpr uint8_t Type = 'L';
+	enum Kind : uint32_t {
+		Animal = 0,
+		Wolf = 1, //the wolf is also an animal, but its position is then simulated
+		Crosshair = 2 //(id unused)
+	};
+	uint32_t id;
+	uint32_t kind;
+	glm::vec2 position;
+};
+static_assert(sizeof(Placement) == 4 + 4 + 4*2, "Placement is packed.");
+
+//client -> server: movement keys held (Game::Controls::bits()) for consecutive simulation ticks
+// (clients batch a few ticks per message; the server applies each tick's input exactly once, in order)
+// (over UDP, spare room repeats recent ticks the server hasn't acknowledged yet, so one lost message costs nothing)
+struct Input {
+	static constexpr uint8_t Type = 'I';
+	static constexpr uint32_t MaxTicks = 8;
+	uint32_t sequence; //sequence number of controls[0] (the first tick is 1); the rest follow consecutively
+	uint32_t state_ack; //tick of the latest State decoded (0 if none yet); the server sends deltas from it
+	uint8_t count; //number of ticks used in 'controls'
+	uint8_t reserved[3];
+	uint8_t controls[MaxTicks];
+};
+static_assert(sizeof(Input) == 4 + 4 + 1 + 3 + Input::MaxTicks, "Input is packed.");
+
+//server -> client: authoritative player positions after a simulation step, and the
+// sequence number of the recipient's last Input tick applied (for reconciliation)
+// (sent every MatchManager::StateEvery ticks; the payload is a bit-packed Snapshot, see Snapshot.hpp)
+struct State {
+	static constexpr uint8_t Type = 'S';
+};
+
+//client -> server: try to kill an animal; server -> clients: animal was killed
+// (the server checks the target is within Game::AttackRange of the attacker's authoritative position)
+struct Attack {
+	static constexpr uint8_t Type = 'a';
+	uint32_t target;
+};
+static_assert(sizeof(Attack) == 4, "Attack is packed.");
+
+//wolf -> server -> hunter: facing direction (1-8, see Scene::Direction) of an animal; sent when it changes
+// (over UDP, which may lose it, the wolf also repeats it with every Input)
+struct Direction {
+	static constexpr uint8_t Type = 'd';
+	uint32_t id;
+	uint32_t direction;
+};
+static_assert(sizeof(Direction) == 4 + 4, "Direction is packed.");
+
+//wolf -> server -> hunter: wolf changed skin
+struct ChangeSkin {
+	static constexpr uint8_t Type = 'c';
+};
+
+//hunter -> server -> wolf: hunter fired
+struct Shoot {
+	static constexpr uint8_t Type = 's';
+};
+
+//peer -> other peer, in lockstep matches (see Lockstep.hpp): the sender's input for consecutive ticks,
+// and the hash of its game state after the latest tick it ran (to detect desyncs)
+// (every peer simulates the whole game from both players' inputs; the server's matches are
+//  server-simulated, so it doesn't carry these -- nothing but bench's two in-process peers sends them yet)
+struct LockstepInput {
+	static constexpr uint8_t Type = 'k';
+	static constexpr uint32_t MaxTicks = 8;
+	uint32_t tick; //tick of bits[0]; the rest follow consecutively
+	uint8_t count; //number of ticks used in 'bits'
+	uint8_t reserved[3];
+	uint8_t bits[MaxTicks]; //Game::Controls::bits(), plus Game::Controls::Attack
+	uint32_t hash_tick; //tick 'hash' is from (0 if none run yet)
+	uint32_t hash; //Game::hash() after that tick
+};
+static_assert(sizeof(LockstepInput) == 4 + 1 + 3 + LockstepInput::MaxTicks + 4 + 4, "LockstepInput is packed.");
+
+//client -> server: part of the ground (z = 0) the client's camera can see
+// (the server only sends animal updates inside it)
+struct View {
+	static constexpr uint8_t Type = 'v';
+	glm::vec2 min;
+	glm::vec2 max;
+};
+static_assert(sizeof(View) == 4*4, "View is packed.");
+
+//client -> server: round-trip time probe; server -> client: Pong with the same 'time'
+struct Ping {
+	static constexpr uint8_t Type = 'p';
+	uint64_t time; //opaque to the server (sender's clock)
+};
+static_assert(sizeof(Ping) == 8, "Ping is packed.");
+
+struct Pong {
+	static constexpr uint8_t Type = 'P';
+	uint64_t time; //copied from the Ping
+};
+static_assert(sizeof(Pong) == 8, "Pong is packed.");
+
+} //namespace Protocol
@@ -0,0 +1,220 @@
+#include "Recording.hpp"
+
+#include "Match.hpp"
+#include "Message.hpp"
+#include "read_chunk.hpp"
+#include "write_chunk.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool Recording::read(std::istream &from) {
+	if (from.peek() == std::istream::traits_type::eof()) return false;
+	read_chunk(from, "rec0", &records);
+	read_chunk(from, "dat0", &data);
+	size_t total = 0;
+	for (auto const &record : records) {
+		total += record.size;
+	}
+	if (total != data.size()) {
+		throw std::runtime_error("Recording data chunk doesn't match its records.");
+	}
+	return true;
+}
+
+void Recording::write(std::ostream &to) const {
+	write_chunk(to, "rec0", records);
+	write_chunk(to, "dat0", data);
+}
+
+//------ Recorder ------
+
+Recorder::Recorder(std::ostream &to_) : to(to_) {
+}
+
+Recorder::~Recorder() {
+	try {
+		flush();
+	} catch (std::exception &e) {
+		std::cerr << "[Recorder] " << e.what() << std::endl;
+	}
+}
+
+void Recorder::record(Connection *c, Connection::Event evt) {
+	if (evt == Connection::OnOpen) {
+		//(a new connection may reuse the address of one closed without an event)
+		streams.erase(c);
+		open(c);
+	} else if (evt == Connection::OnRecv) {
+		Stream &stream = open(c);
+		assert(stream.pending <= c->recv_buffer.size());
+		//only what arrived since the last dispatch:
+		add(Recording::Recv, stream.id, c->recv_buffer.data() + stream.pending, c->recv_buffer.size() - stream.pending);
+	} else { assert(evt == Connection::OnClose);
+		auto f = streams.find(c);
+		if (f == streams.end()) return;
+		add(Recording::Close, f->second.id, nullptr, 0);
+		streams.erase(f);
+	}
+}
+
+void Recorder::handled(Connection *c) {
+	auto f = streams.find(c);
+	if (f == streams.end()) return;
+	if (*c) f->second.pending = c->recv_buffer.size();
+	else streams.erase(f); //(closed while handling; no more events will come)
+}
+
+void Recorder::record_udp(Connection *c, ByteBuffer const &frames) {
+	//whole frames only (MessageHandlers::dispatch leaves a trailing partial one for later),
+	// but through a malformed one (which dispatch closes the connection over):
+	char const *begin = frames.data();
+	char const *end = begin + frames.size();
+	char const *at = begin;
+	while (at < end) {
+		uint8_t type;
+		char const *payload;
+		uint32_t size;
+		char const *next;
+		FrameStatus status = decode_frame(at, end, &type, &payload, &size, &next);
+		if (status == FramePartial) break;
+		if (status == FrameMalformed) {
+			at = end;
+			break;
+		}
+		at = next;
+	}
+	if (at == begin) return;
+	add(Recording::UdpRecv, open(c).id, begin, at - begin);
+}
+
+void Recorder::record_step() {
+	add(Recording::Step, 0, nullptr, 0);
+	if (buffered.records.size() * sizeof(Recording::Record) + buffered.data.size() >= FlushBytes || std::chrono::duration< float >(last_record - last_flush).count() >= FlushSeconds) {
+		flush();
+	}
+}
+
+void Recorder::flush() {
+	last_flush = Clock::now();
+	if (buffered.records.empty()) return;
+	buffered.write(to);
+	to.flush();
+	bytes_written += 2 * 8 + buffered.records.size() * sizeof(Recording::Record) + buffered.data.size();
+	buffered.clear();
+}
+
+Recorder::Stream &Recorder::open(Connection *c) {
+	Stream &stream = streams[c];
+	if (stream.id == 0) {
+		stream.id = next_id++;
+		add(Recording::Open, stream.id, nullptr, 0);
+	}
+	return stream;
+}
+
+void Recorder::add(Recording::Kind kind, uint32_t connection, void const *data, size_t size) {
+	auto now = Clock::now();
+	auto delay = std::chrono::duration_cast< std::chrono::microseconds >(now - last_record).count();
+	last_record = now;
+
+	Recording::Record record;
+	record.kind = kind;
+	record.reserved[0] = record.reserved[1] = record.reserved[2] = 0;
+	record.connection = connection;
+	record.delay = uint32_t(std::min< decltype(delay) >(delay, 0xffffffff));
+	record.size = uint32_t(size);
+	buffered.records.emplace_back(record);
+	char const *bytes = reinterpret_cast< char const * >(data);
+	buffered.data.insert(buffered.data.end(), bytes, bytes + size);
+}
+
+//------ Replay ------
+
+Replay::Replay(std::istream &from) {
+	Recording chunk;
+	while (chunk.read(from)) {
+		recording.records.insert(recording.records.end(), chunk.records.begin(), chunk.records.end());
+		recording.data.insert(recording.data.end(), chunk.data.begin(), chunk.data.end());
+	}
+	//check connection numbering up front, so step() can trust it:
+	uint32_t opened = 0;
+	for (auto const &record : recording.records) {
+		if (record.kind == Recording::Open) {
+			if (record.connection != opened + 1) throw std::runtime_error("Recording opens connections out of order.");
+			opened += 1;
+		} else if (record.kind == Recording::Recv || record.kind == Recording::Close || record.kind == Recording::UdpRecv) {
+			if (record.connection == 0 || record.connection > opened) throw std::runtime_error("Recording uses a connection before opening it.");
+		} else if (record.kind == Recording::Step) {
+			if (record.size != 0) throw std::runtime_error("Recording has a malformed step.");
+		} else {
+			throw std::runtime_error("Recording has a record of unknown kind.");
+		}
+	}
+}
+
+bool Replay::step(MatchManager *matches) {
+	assert(matches);
+	if (next_record == recording.records.size()) {
+		flush_sent();
+		return false;
+	}
+	Recording::Record const &record = recording.records[next_record++];
+	char const *data = recording.data.data() + next_data;
+	next_data += record.size;
+	played += 1;
+
+	if (record.kind == Recording::Open) {
+		connections.emplace_back(new Connection);
+		Connection &c = *connections.back();
+		c.socket = ReplaySocket;
+		c.send_queue = &send_queue;
+		matches->on_event(&c, Connection::OnOpen);
+	} else if (record.kind == Recording::Recv) {
+		Connection &c = *connections[record.connection - 1];
+		if (!c) return true; //(closed by the MatchManager, as it was when recording)
+		c.recv_buffer.append(data, record.size);
+		bytes_received += record.size;
+		matches->on_event(&c, Connection::OnRecv);
+	} else if (record.kind == Recording::UdpRecv) {
+		Connection &c = *connections[record.connection - 1];
+		if (!c) return true; //(as for Recv)
+		ByteBuffer frames;
+		frames.append(data, record.size);
+		bytes_received += record.size;
+		matches->on_udp_frames(&c, frames);
+	} else if (record.kind == Recording::Close) {
+		Connection &c = *connections[record.connection - 1];
+		c.close();
+		matches->on_event(&c, Connection::OnClose);
+	} else { assert(record.kind == Recording::Step);
+		steps += 1;
+		matches->step();
+		flush_sent();
+	}
+	return true;
+}
+
+void Replay::rewind() {
+	next_record = 0;
+	next_data = 0;
+	connections.clear();
+	send_queue.clear();
+	played = 0;
+	bytes_received = 0;
+	bytes_sent = 0;
+	sent_hash = 2166136261U;
+	steps = 0;
+}
+
+//stand-in for Server::flush:
+void Replay::flush_sent() {
+	for (Connection *c : send_queue) {
+		for (char b : c->send_buffer) {
+			sent_hash = (sent_hash ^ uint8_t(b)) * 16777619U;
+		}
+		bytes_sent += c->send_buffer.size();
+		c->send_buffer.clear();
+	}
+	send_queue.clear();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Connection.hpp"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+struct MatchManager;
+
+/*
+ * A recording is a log of everything that reaches a MatchManager --
+ * connections opening and closing, the raw bytes each one received (and
+ * the frames each player sent over UDP), and when each simulation step
+ * ran relative to those -- so that a server session can be played back
+ * offline, exactly, as fast as the code will go.
+ *
+ * The server records each worker's matches when given a path prefix
+ * (./server 1337 4 session writes session.0.rec, session.1.rec, ...):
+
+std::ofstream file("session.0.rec", std::ios::binary);
+Recorder recorder(file);
+MatchManager matches;
+matches.recorder = &recorder; //(MatchManager records its own events)
+
+ * and Replay feeds a recording back through a fresh MatchManager, using
+ * stand-in connections (whatever the server would have sent them is
+ * counted, hashed, and dropped; players' UDP connections aren't replayed,
+ * so everything sent goes to the stand-ins, and what was sent over UDP
+ * when recording isn't part of what the replay matches against):
+
+std::ifstream file("session.0.rec", std::ios::binary);
+Replay replay(file);
+MatchManager matches;
+while (replay.step(&matches)) { }
+
+ * On disk, a recording is a sequence of chunk pairs (as written by
+ * write_chunk, read by read_chunk): a "rec0" chunk of Recording::Records,
+ * then a "dat0" chunk holding their data bytes back to back.
+ */
+
+struct Recording {
+	enum Kind : uint8_t {
+		Open = 'o', //connection opened
+		Recv = 'r', //data: bytes received
+		Close = 'c', //connection closed by the server's socket code (MatchManager's own closes aren't recorded; they replay by themselves)
+		Step = 's', //MatchManager::step() ran
+		UdpRecv = 'u', //data: whole frames the connection's player sent over its UDP connection
+	};
+	struct Record {
+		uint8_t kind;
+		uint8_t reserved[3];
+		uint32_t connection; //connections are numbered from 1, in the order they opened (0 for Step)
+		uint32_t delay; //microseconds since the previous record
+		uint32_t size; //bytes of data
+	};
+	static_assert(sizeof(Record) == 16, "Record is packed.");
+
+	std::vector< Record > records;
+	std::vector< char > data;
+
+	//read or write a chunk pair:
+	// (read returns false at the end of the stream, throws if the stream is malformed)
+	bool read(std::istream &from);
+	void write(std::ostream &to) const;
+
+	void clear() {
+		records.clear();
+		data.clear();
+	}
+};
+
+struct Recorder {
+	explicit Recorder(std::ostream &to);
+	~Recorder(); //(writes anything still buffered)
+
+	//called by MatchManager::on_event, around handling each event:
+	void record(Connection *c, Connection::Event evt);
+	void handled(Connection *c);
+	//called by MatchManager::on_udp_frames, before handling them (records the frames it will consume):
+	void record_udp(Connection *c, ByteBuffer const &frames);
+	//called by MatchManager::step:
+	void record_step();
+
+	//write buffered records (also done every FlushBytes or FlushSeconds):
+	void flush();
+
+	static constexpr const size_t FlushBytes = 64 * 1024;
+	static constexpr const float FlushSeconds = 1.0f;
+
+	//for status reporting:
+	uint64_t bytes_written = 0;
+
+	//internals:
+	typedef std::chrono::steady_clock Clock;
+	std::ostream &to;
+	Recording buffered;
+	struct Stream {
+		uint32_t id = 0;
+		size_t pending = 0; //bytes left in recv_buffer after the last dispatch (already recorded)
+	};
+	std::unordered_map< Connection *, Stream > streams;
+	uint32_t next_id = 1;
+	Clock::time_point last_record = Clock::now();
+	Clock::time_point last_flush = Clock::now();
+
+	Stream &open(Connection *c);
+	void add(Recording::Kind kind, uint32_t connection, void const *data, size_t size);
+};
+
+struct Replay {
+	explicit Replay(std::istream &from); //reads the whole recording (throws if it is malformed)
+
+	//play the next record into 'matches' (after a Step, also "flush" what it sent); false once all have been played:
+	bool step(MatchManager *matches);
+	//start over (with a fresh MatchManager):
+	void rewind();
+
+	Recording recording;
+
+	//counters (since the last rewind):
+	uint64_t played = 0; //records
+	uint64_t bytes_received = 0; //bytes fed to MatchManager
+	uint64_t bytes_sent = 0; //bytes MatchManager sent back
+	uint32_t sent_hash = 2166136261U; //FNV-1a of every connection's sent bytes (in order of flushing), to compare runs
+	uint32_t steps = 0; //simulation steps run (the session lasted steps * MatchManager::TickDt)
+
+	//internals:
+	//(stand-ins never had a socket; closing one just fails harmlessly)
+	static constexpr const SOCKET ReplaySocket = SOCKET(-2);
+	size_t next_record = 0;
+	size_t next_data = 0;
+	std::vector< std::unique_ptr< Connection > > connections; //[id - 1]
+	std::vector< Connection * > send_queue; //connections that have sent something since the last Step
+	void flush_sent();
+};
@@ -0,0 +1,158 @@
+#include "RenderQueue.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+void RenderQueue::clear() {
+	items.clear();
+	local_to_worlds.clear();
+	commands.clear();
+	data.clear();
+	counters = Counters();
+}
+
+RenderQueue::Command &RenderQueue::emit(Command::Op op, GLuint name, Scene::Object const *object) {
+	commands.emplace_back();
+	Command &command = commands.back();
+	command.op = op;
+	command.name = name;
+	command.object = object;
+	return command;
+}
+
+uint32_t RenderQueue::store(float const *values, uint32_t count) {
+	uint32_t offset = uint32_t(data.size());
+	data.insert(data.end(), values, values + count);
+	return offset;
+}
+
+void RenderQueue::add(Scene::Object const &object, glm::mat4 const &local_to_world, float depth) {
+	//(non-negative floats sort the same way as their bits do)
+	if (!(depth > 0.0f)) depth = 0.0f;
+	uint32_t depth_bits;
+	std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+	Item item;
+	item.state = (uint64_t(object.program) << 32) | uint64_t(object.vao);
+	item.order = (uint64_t(object.material) << 32) | uint64_t(depth_bits);
+	item.index = uint32_t(items.size());
+	item.object = &object;
+	items.emplace_back(item);
+	local_to_worlds.emplace_back(local_to_world);
+}
+
+void RenderQueue::build(glm::mat4 const &world_to_clip) {
+	std::sort(items.begin(), items.end(), [](Item const &a, Item const &b) {
+		if (a.state != b.state) return a.state < b.state;
+		if (a.order != b.order) return a.order < b.order;
+		return a.index < b.index;
+	});
+
+	commands.clear();
+	data.clear();
+	counters = Counters();
+	counters.objects = uint32_t(items.size());
+
+	auto upload = [this](Command::Op op, GLuint location, float const *values, uint32_t count, Scene::Object const *object) {
+		uint32_t offset = store(values, count);
+		emit(op, location, object).offset = offset;
+		counters.uniform_uploads += 1;
+	};
+
+	//what the previous commands left bound:
+	bool have_program = false, have_vao = false, have_material = false;
+	GLuint program = 0, vao = 0;
+	uint32_t material = 0;
+
+	for (Item const &item : items) {
+		Scene::Object const &object = *item.object;
+
+		if (!have_program || object.program != program) {
+			emit(Command::UseProgram, object.program, &object);
+			counters.program_binds += 1;
+			have_program = true;
+			program = object.program;
+			have_material = false; //(uniforms belong to the program)
+		}
+
+		//per-object uniforms:
+		glm::mat4 const &local_to_world = local_to_worlds[item.index];
+		if (object.program_mvp_mat4 != -1U) {
+			glm::mat4 mvp = world_to_clip * local_to_world;
+			upload(Command::UniformMatrix4, object.program_mvp_mat4, glm::value_ptr(mvp), 16, &object);
+		}
+		if (object.program_mv_mat4x3 != -1U) {
+			glm::mat4x3 mv = glm::mat4x3(local_to_world);
+			upload(Command::UniformMatrix4x3, object.program_mv_mat4x3, glm::value_ptr(mv), 12, &object);
+		}
+		if (object.program_itmv_mat3 != -1U) {
+			//NOTE: inverse cancels out transpose unless there is scale involved
+			glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(local_to_world)));
+			upload(Command::UniformMatrix3, object.program_itmv_mat3, glm::value_ptr(itmv), 9, &object);
+		}
+
+		//material (objects sharing a nonzero material only need it set once per run):
+		if (object.set_uniforms && (object.material == 0 || !have_material || object.material != material)) {
+			emit(Command::SetUniforms, 0, &object);
+			counters.material_changes += 1;
+			have_material = true;
+			material = object.material;
+		}
+
+		if (!have_vao || object.vao != vao) {
+			emit(Command::BindVertexArray, object.vao, &object);
+			counters.vao_binds += 1;
+			have_vao = true;
+			vao = object.vao;
+		}
+
+		Command &draw = emit(Command::DrawArrays, 0, &object);
+		draw.first = object.start;
+		draw.count = object.count;
+		counters.draw_calls += 1;
+	}
+}
+
+void RenderQueue::execute() const {
+	for (Command const &command : commands) {
+		switch (command.op) {
+			case Command::UseProgram:
+				glUseProgram(command.name);
+				break;
+			case Command::BindVertexArray:
+				glBindVertexArray(command.name);
+				break;
+			case Command::UniformMatrix4:
+				glUniformMatrix4fv(command.name, 1, GL_FALSE, data.data() + command.offset);
+				break;
+			case Command::UniformMatrix4x3:
+				glUniformMatrix4x3fv(command.name, 1, GL_FALSE, data.data() + command.offset);
+				break;
+			case Command::UniformMatrix3:
+				glUniformMatrix3fv(command.name, 1, GL_FALSE, data.data() + command.offset);
+				break;
+			case Command::SetUniforms:
+				command.object->set_uniforms();
+				break;
+			case Command::DrawArrays:
+				glDrawArrays(GL_TRIANGLES, command.first, command.count);
+				break;
+			case Command::UploadInstances:
+				//(a new buffer each frame, so the GPU can keep drawing from the old one)
+				glBindBuffer(GL_ARRAY_BUFFER, command.name);
+				glBufferData(GL_ARRAY_BUFFER, command.count * sizeof(float), data.data() + command.offset, GL_STREAM_DRAW);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				break;
+			case Command::DrawInstanced:
+				glBindBuffer(GL_ARRAY_BUFFER, command.buffer);
+				for (GLuint column = 0; column < 4; ++column) {
+					glVertexAttribPointer(command.name + column, 3, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (GLbyte *)0 + (command.offset * 12 + column * 3) * sizeof(float));
+				}
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				glDrawArraysInstanced(GL_TRIANGLES, command.first, command.count, command.instances);
+				break;
+		}
+	}
+}
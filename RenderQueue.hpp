@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * RenderQueue turns a set of Scene::Objects into a stream of OpenGL
+ * commands, sorted by (program, vertex array, material, depth) so that
+ * objects sharing state are drawn together, and with any program bind,
+ * vertex array bind, or material (set_uniforms) call that wouldn't change
+ * anything left out. Scene::draw uses one:
+
+RenderQueue queue; //(keep it around; its buffers are reused every frame)
+scene->draw(camera, &queue);
+std::cout << queue.counters.draw_calls << " draws, " << queue.counters.program_binds << " program binds" << std::endl;
+
+ * Building the commands doesn't touch OpenGL -- only execute() does -- so
+ * the command stream can be inspected (or checked) without a GPU:
+
+scene.gather(camera, &queue); //add() every object and build(), but don't execute()
+for (RenderQueue::Command const &command : queue.commands) { ... }
+
+ */
+
+struct RenderQueue {
+	//forget everything (objects added, commands built, counters):
+	void clear();
+	//collect objects to draw ('depth' is distance in front of the camera; nearer objects go first among those sharing state):
+	void add(Scene::Object const &object, glm::mat4 const &local_to_world, float depth);
+
+	//sort what was added, and turn it into commands:
+	void build(glm::mat4 const &world_to_clip);
+
+	//send the commands to OpenGL:
+	// (assumes nothing about the current program or vertex array; leaves the last ones used bound)
+	void execute() const;
+
+	struct Command {
+		enum Op : uint8_t {
+			UseProgram, //glUseProgram(name)
+			BindVertexArray, //glBindVertexArray(name)
+			UniformMatrix4, //glUniformMatrix4fv(name, ...) from data[offset]
+			UniformMatrix4x3, //glUniformMatrix4x3fv(name, ...) from data[offset]
+			UniformMatrix3, //glUniformMatrix3fv(name, ...) from data[offset]
+			SetUniforms, //object->set_uniforms()
+			DrawArrays, //glDrawArrays(GL_TRIANGLES, first, count)
+			UploadInstances, //glBufferData(GL_ARRAY_BUFFER, ...) of 'count' floats from data[offset] into buffer 'name'
+			DrawInstanced, //point the mat4x3 attribute at location 'name' to instance 'offset' of buffer 'buffer', then glDrawArraysInstanced(GL_TRIANGLES, first, count, instances)
+		};
+		Op op;
+		GLuint name = 0; //program, vertex array, uniform location, or buffer (see above)
+		GLuint first = 0;
+		GLuint count = 0;
+		uint32_t offset = 0; //index of the matrix's first float in 'data' (or of the first instance)
+		GLuint instances = 0;
+		GLuint buffer = 0;
+		Scene::Object const *object = nullptr; //object whose draw the command is part of (if any)
+	};
+	std::vector< Command > commands;
+	std::vector< float > data; //uniform values and instance matrices
+
+	//what the last build() produced:
+	struct Counters {
+		uint32_t objects = 0;
+		uint32_t draw_calls = 0;
+		uint32_t program_binds = 0;
+		uint32_t vao_binds = 0;
+		uint32_t material_changes = 0; //set_uniforms calls
+		uint32_t uniform_uploads = 0; //glUniformMatrix* calls
+		uint32_t instances = 0; //things drawn by instanced draws
+	} counters;
+
+	//for filling 'commands' directly (as Scene does for a Herd):
+	Command &emit(Command::Op op, GLuint name, Scene::Object const *object = nullptr);
+	uint32_t store(float const *values, uint32_t count); //copy values into 'data', returning where they start
+
+	//internals:
+	struct Item {
+		uint64_t state; //program, vertex array
+		uint64_t order; //material, depth
+		uint32_t index; //order added (so equal keys sort the same way every time)
+		Scene::Object const *object;
+	};
+	std::vector< Item > items;
+	std::vector< glm::mat4 > local_to_worlds; //[Item::index]
+};
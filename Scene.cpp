@@ -1,4 +1,7 @@
 #include "Scene.hpp"
+#include "Herd.hpp"
+#include "Jobs.hpp"
+#include "RenderQueue.hpp"
 #include "read_chunk.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -6,6 +9,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <cmath>
+#include <cstring>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -43,19 +48,52 @@ glm::mat4 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4 Scene::Transform::make_local_to_world() const {
-	if (parent) {
-		return parent->make_local_to_world() * make_local_to_parent();
-	} else {
-		return make_local_to_parent();
+glm::mat4 const &Scene::Transform::make_local_to_world() const {
+	if (local_to_world_dirty) {
+		if (parent) {
+			local_to_world = parent->make_local_to_world() * make_local_to_parent();
+		} else {
+			local_to_world = make_local_to_parent();
+		}
+		local_to_world_dirty = false;
 	}
+	return local_to_world;
 }
 
-glm::mat4 Scene::Transform::make_world_to_local() const {
-	if (parent) {
-		return make_parent_to_local() * parent->make_world_to_local();
-	} else {
-		return make_parent_to_local();
+glm::mat4 const &Scene::Transform::make_world_to_local() const {
+	if (world_to_local_dirty) {
+		if (parent) {
+			world_to_local = make_parent_to_local() * parent->make_world_to_local();
+		} else {
+			world_to_local = make_parent_to_local();
+		}
+		world_to_local_dirty = false;
+	}
+	return world_to_local;
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	position = position_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	rotation = rotation_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	scale = scale_;
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	//(already dirty means everything below is too -- so moving something every frame only costs its subtree once)
+	if (local_to_world_dirty && world_to_local_dirty) return;
+	local_to_world_dirty = true;
+	world_to_local_dirty = true;
+	for (Transform *child = last_child; child != nullptr; child = child->prev_sibling) {
+		child->mark_dirty();
 	}
 }
 
@@ -98,6 +136,7 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 		}
 		if (prev_sibling) prev_sibling->next_sibling = this;
 	}
+	mark_dirty();
 	DEBUG_assert_valid_pointers();
 }
 
@@ -111,8 +150,8 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //templated helper functions to avoid having to write the same new/delete code three times:
 template< typename T, typename... Args >
-T *list_new(T * &first, Args&&... args) {
-	T *t = new T(std::forward< Args >(args)...); //"perfect forwarding"
+T *list_new(Pool< T > &pool, T * &first, Args&&... args) {
+	T *t = pool.create(std::forward< Args >(args)...); //"perfect forwarding"
 	if (first) {
 		t->alloc_next = first;
 		first->alloc_prev_next = &t->alloc_next;
@@ -123,7 +162,7 @@ T *list_new(T * &first, Args&&... args) {
 }
 
 template< typename T >
-void list_delete(T * t) {
+void list_delete(Pool< T > &pool, T * t) {
 	assert(t && "It is invalid to delete a null scene object [yes this is different than 'delete']");
 	assert(t->alloc_prev_next);
 	if (t->alloc_next) {
@@ -133,75 +172,210 @@ void list_delete(T * t) {
 	//PARANOIA:
 	t->alloc_next = nullptr;
 	t->alloc_prev_next = nullptr;
+	pool.destroy(t);
 }
 
 Scene::Transform *Scene::new_transform() {
-	return list_new< Scene::Transform >(first_transform);
+	return list_new< Scene::Transform >(transform_pool, first_transform);
 }
 
 void Scene::delete_transform(Scene::Transform *transform) {
-	list_delete< Scene::Transform >(transform);
+	list_delete< Scene::Transform >(transform_pool, transform);
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform) {
 	assert(transform && "Scene::Object must be attached to a transform.");
-	return list_new< Scene::Object >(first_object, transform);
+	return list_new< Scene::Object >(object_pool, first_object, transform);
+}
+
+Scene::Object *Scene::new_object(Hierarchy::Handle node) {
+	assert(hierarchy.alive(node) && "Scene::Object must be attached to a node.");
+	return list_new< Scene::Object >(object_pool, first_object, node);
 }
 
 void Scene::delete_object(Scene::Object *object) {
-	list_delete< Scene::Object >(object);
+	list_delete< Scene::Object >(object_pool, object);
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform) {
 	assert(transform && "Scene::Camera must be attached to a transform.");
-	return list_new< Scene::Camera >(first_camera, transform);
+	return list_new< Scene::Camera >(camera_pool, first_camera, transform);
+}
+
+Scene::Camera *Scene::new_camera(Hierarchy::Handle node) {
+	assert(hierarchy.alive(node) && "Scene::Camera must be attached to a node.");
+	return list_new< Scene::Camera >(camera_pool, first_camera, node);
 }
 
 void Scene::delete_camera(Scene::Camera *object) {
-	list_delete< Scene::Camera >(object);
+	list_delete< Scene::Camera >(camera_pool, object);
+}
+
+glm::mat4 const &Scene::local_to_world(Scene::Object const *object) const {
+	if (object->transform) return object->transform->make_local_to_world();
+	else return hierarchy.local_to_world(object->node);
+}
+
+glm::mat4 Scene::world_to_local(Scene::Camera const *camera) const {
+	if (camera->transform) return camera->transform->make_world_to_local();
+	else return hierarchy.world_to_local(camera->node);
+}
+
+void Scene::draw(Scene::Camera const *camera, RenderQueue *queue) const {
+	RenderQueue frame_queue;
+	if (!queue) queue = &frame_queue;
+	gather(camera, queue);
+	queue->execute();
 }
 
-void Scene::draw(Scene::Camera const *camera) const {
+void Scene::gather(Scene::Camera const *camera, RenderQueue *queue) const {
 	assert(camera && "Must have a camera to draw scene from.");
+	assert(queue);
 
-	glm::mat4 world_to_camera = camera->transform->make_world_to_local();
+	glm::mat4 world_to_camera = world_to_local(camera);
 	glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
 
+	queue->clear();
 	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
-
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+		if (object->program == 0 || object->count == 0) continue; //(nothing to draw)
+		glm::mat4 const &local_to_world = this->local_to_world(object);
+		//(cameras look along -z)
+		float depth = -(world_to_camera * local_to_world[3]).z;
+		queue->add(*object, local_to_world, depth);
+	}
+	queue->build(world_to_clip);
+}
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = local_to_world;
+void Scene::draw(Scene::Camera const *camera, Herd const &herd, HerdLook const &look, Jobs *jobs, RenderQueue *queue) const {
+	RenderQueue frame_queue;
+	if (!queue) queue = &frame_queue;
+	gather(camera, herd, look, queue, jobs);
+	queue->execute();
+}
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+void Scene::gather(Scene::Camera const *camera, Herd const &herd, HerdLook const &look, RenderQueue *queue, Jobs *jobs) const {
+	assert(camera && "Must have a camera to draw herd from.");
+	assert(queue);
 
-		//set up program uniforms:
-		glUseProgram(object->program);
-		if (object->program_mvp_mat4 != -1U) {
-			glUniformMatrix4fv(object->program_mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+	glm::mat4 world_to_camera = world_to_local(camera);
+	glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
+	bool instanced = (look.instanced_program != 0);
+
+	//which animals to draw (when instancing, grouped by skin -- each skin is one draw):
+	std::vector< uint32_t > drawn;
+	drawn.reserve(herd.ids.size());
+	herd.ids.for_each([&](uint32_t id) {
+		uint32_t i = Entities::index(id);
+		if (herd.skin[i] >= herd.skins.size()) return; //(nothing to draw it with)
+		drawn.emplace_back(i);
+	});
+	std::vector< uint32_t > skin_begin(herd.skins.size() + 1, 0);
+	if (instanced) {
+		for (uint32_t i : drawn) {
+			skin_begin[herd.skin[i] + 1] += 1;
 		}
-		if (object->program_mv_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(object->program_mv_mat4x3, 1, GL_FALSE, glm::value_ptr(mv));
+		for (size_t s = 1; s < skin_begin.size(); ++s) {
+			skin_begin[s] += skin_begin[s - 1];
 		}
-		if (object->program_itmv_mat3 != -1U) {
-			glUniformMatrix3fv(object->program_itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+		std::vector< uint32_t > by_skin(drawn.size());
+		std::vector< uint32_t > next(skin_begin.begin(), skin_begin.end() - 1);
+		for (uint32_t i : drawn) {
+			by_skin[next[herd.skin[i]]++] = i;
 		}
+		drawn.swap(by_skin);
+	}
 
-		if (object->set_uniforms) object->set_uniforms();
-
-		glBindVertexArray(object->vao);
-
-		//draw the object:
-		glDrawArrays(GL_TRIANGLES, object->start, object->count);
+	queue->clear();
+	queue->counters.objects = uint32_t(drawn.size());
+
+	//compute their matrices into the queue's data (spread over 'jobs', if given -- only the GL calls need this thread):
+	// (instanced: each animal's mat4x3 local-to-world; otherwise its three uniforms)
+	uint32_t const Floats = (instanced ? 12 : 16 + 12 + 9);
+	uint32_t base = uint32_t(queue->data.size());
+	queue->data.resize(base + drawn.size() * Floats);
+	float *data = queue->data.data() + base;
+	auto compute = [&](size_t begin, size_t end) {
+		for (size_t d = begin; d < end; ++d) {
+			uint32_t i = drawn[d];
+			//meshes face +x ('direction.right') at heading 0; turn that about +z:
+			// (wandering animals face the way they are walking)
+			float heading = herd.heading[i];
+			if (herd.vx[i] != 0.0f || herd.vy[i] != 0.0f) heading = std::atan2(herd.vy[i], herd.vx[i]);
+			glm::mat3 rotate = glm::mat3_cast(glm::angleAxis(heading, glm::vec3(0.0f, 0.0f, 1.0f)) * direction.right);
+			glm::mat4x3 local_to_world = glm::mat4x3(rotate[0], rotate[1], rotate[2], glm::vec3(herd.x[i], herd.y[i], 0.0f));
+			float *out = data + d * Floats;
+			if (!instanced) {
+				glm::mat4 mvp = world_to_clip * glm::mat4(local_to_world);
+				std::memcpy(out, glm::value_ptr(mvp), 16 * sizeof(float));
+				out += 16;
+			}
+			std::memcpy(out, glm::value_ptr(local_to_world), 12 * sizeof(float));
+			if (!instanced) {
+				//(no scale, so the inverse transpose is just the rotation)
+				std::memcpy(out + 12, glm::value_ptr(rotate), 9 * sizeof(float));
+			}
+		}
+	};
+	if (jobs) jobs->parallel_for(0, drawn.size(), 256, compute);
+	else compute(0, drawn.size());
+
+	if (instanced) {
+		queue->emit(RenderQueue::Command::UseProgram, look.instanced_program);
+		queue->counters.program_binds += 1;
+		if (look.instanced_program_world_to_clip_mat4 != -1U) {
+			uint32_t offset = queue->store(glm::value_ptr(world_to_clip), 16);
+			queue->emit(RenderQueue::Command::UniformMatrix4, look.instanced_program_world_to_clip_mat4).offset = offset;
+			queue->counters.uniform_uploads += 1;
+		}
+		queue->emit(RenderQueue::Command::BindVertexArray, look.instanced_vao);
+		queue->counters.vao_binds += 1;
+		RenderQueue::Command &upload = queue->emit(RenderQueue::Command::UploadInstances, look.instance_buffer);
+		upload.offset = base;
+		upload.count = uint32_t(drawn.size()) * Floats;
+		for (uint32_t s = 0; s < herd.skins.size(); ++s) {
+			if (skin_begin[s] == skin_begin[s + 1]) continue;
+			RenderQueue::Command &draw = queue->emit(RenderQueue::Command::DrawInstanced, look.instanced_program_instance_to_world_mat4x3);
+			draw.first = herd.skins[s].start;
+			draw.count = herd.skins[s].count;
+			draw.offset = skin_begin[s];
+			draw.instances = skin_begin[s + 1] - skin_begin[s];
+			draw.buffer = look.instance_buffer;
+			queue->counters.draw_calls += 1;
+			queue->counters.instances += draw.instances;
+		}
+	} else {
+		queue->emit(RenderQueue::Command::UseProgram, look.program);
+		queue->counters.program_binds += 1;
+		queue->emit(RenderQueue::Command::BindVertexArray, look.vao);
+		queue->counters.vao_binds += 1;
+		for (size_t d = 0; d < drawn.size(); ++d) {
+			uint32_t at = base + uint32_t(d) * Floats;
+			if (look.program_mvp_mat4 != -1U) {
+				queue->emit(RenderQueue::Command::UniformMatrix4, look.program_mvp_mat4).offset = at;
+				queue->counters.uniform_uploads += 1;
+			}
+			if (look.program_mv_mat4x3 != -1U) {
+				queue->emit(RenderQueue::Command::UniformMatrix4x3, look.program_mv_mat4x3).offset = at + 16;
+				queue->counters.uniform_uploads += 1;
+			}
+			if (look.program_itmv_mat3 != -1U) {
+				queue->emit(RenderQueue::Command::UniformMatrix3, look.program_itmv_mat3).offset = at + 16 + 12;
+				queue->counters.uniform_uploads += 1;
+			}
+			Herd::Skin const &skin = herd.skins[herd.skin[drawn[d]]];
+			RenderQueue::Command &draw = queue->emit(RenderQueue::Command::DrawArrays, 0);
+			draw.first = skin.start;
+			draw.count = skin.count;
+			queue->counters.draw_calls += 1;
+		}
 	}
 }
 
-
 Scene::~Scene() {
+	//(every transform is going, so skip unlinking them from each other one at a time)
+	for (Transform *t = first_transform; t != nullptr; t = t->alloc_next) {
+		t->parent = t->last_child = t->prev_sibling = t->next_sibling = nullptr;
+	}
 	while (first_camera) {
 		delete_camera(first_camera);
 	}
@@ -289,9 +463,9 @@ void Scene::load(std::string const &filename,
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		t->set_position(h.position);
+		t->set_rotation(h.rotation);
+		t->set_scale(h.scale);
 
 		hierarchy_transforms.emplace_back(t);
 	}
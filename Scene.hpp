@@ -1,6 +1,8 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Hierarchy.hpp"
+#include "Pool.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -11,6 +13,10 @@
 #include <string>
 #include <map>
 
+struct Herd;
+struct Jobs;
+struct RenderQueue;
+
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene {
 
@@ -48,11 +54,16 @@ struct Scene {
         uint32_t id = 0;  // animal ID, if 0 -> non-animal
 
 		//simple specification:
+		// (read these freely, but change them with the set_ functions below, which keep the cached matrices current)
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
 		glm::quat rotation = glm::quat(0.0f, 0.0f, 0.0f, 1.0f);
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
         uint32_t direction = 7;  // from 1-8, default 7 (facing down)
 
+		void set_position(glm::vec3 const &position);
+		void set_rotation(glm::quat const &rotation);
+		void set_scale(glm::vec3 const &scale);
+
 		//hierarchy information:
 		Transform *parent = nullptr;
 		Transform *last_child = nullptr;
@@ -69,8 +80,14 @@ struct Scene {
 		//computed from the above:
 		glm::mat4 make_local_to_parent() const;
 		glm::mat4 make_parent_to_local() const;
-		glm::mat4 make_local_to_world() const;
-		glm::mat4 make_world_to_local() const;
+		//(these two are cached, and only recomputed after this transform or one of its ancestors changes;
+		// so they aren't safe to call from several threads at once)
+		glm::mat4 const &make_local_to_world() const;
+		glm::mat4 const &make_world_to_local() const;
+
+		//mark the cached matrices of this transform and everything below it out of date:
+		// (the set_ functions do this; call it after changing position/rotation/scale directly)
+		void mark_dirty();
 
 		//constructor/destructor:
 		Transform() = default;
@@ -87,14 +104,25 @@ struct Scene {
 		//used by Scene to manage allocation:
 		Transform **alloc_prev_next = nullptr;
 		Transform *alloc_next = nullptr;
+
+		//cached matrices:
+		// (if a transform's cache is dirty, so are those of all its descendants)
+		mutable glm::mat4 local_to_world;
+		mutable glm::mat4 world_to_local;
+		mutable bool local_to_world_dirty = true;
+		mutable bool world_to_local_dirty = true;
 	};
 
 	//"Object"s contain information needed to render meshes:
 	struct Object {
-		Transform *transform; //objects must be attached to transforms.
+		Transform *transform = nullptr; //objects must be attached to transforms --
+		Hierarchy::Handle node = 0; // -- or to nodes in the scene's hierarchy.
 		Object(Transform *transform_) : transform(transform_) {
 			assert(transform);
 		}
+		Object(Hierarchy::Handle node_) : node(node_) {
+			assert(node);
+		}
 
 		//program info:
 		GLuint program = 0;
@@ -104,6 +132,7 @@ struct Scene {
 
 		//material info:
 		std::function< void() > set_uniforms; //will be called before rendering object, use to set material parameters (e.g. glossiness)
+		uint32_t material = 0; //objects with the same nonzero material (and program) have set_uniforms that do the same thing, so it is only called once for a run of them
 
 		//attribute info:
 		GLuint vao = 0;
@@ -117,10 +146,14 @@ struct Scene {
 
 	//"Camera"s contain information needed to view a scene:
 	struct Camera {
-		Transform *transform; //cameras must be attached to transforms.
+		Transform *transform = nullptr; //cameras must be attached to transforms --
+		Hierarchy::Handle node = 0; // -- or to nodes in the scene's hierarchy.
 		Camera(Transform *transform_) : transform(transform_) {
 			assert(transform);
 		}
+		Camera(Hierarchy::Handle node_) : node(node_) {
+			assert(node);
+		}
 		//NOTE: cameras look along their -z axis
 
 		//camera parameters (perspective):
@@ -143,29 +176,76 @@ struct Scene {
 	//Delete an existing transform: (NOTE: it is an error to delete a transform with an attached Object or Camera)
 	void delete_transform(Transform *);
 
-	//Create a new object attached to a transform:
+	//Create a new object attached to a transform (or hierarchy node):
 	Object *new_object(Transform *transform);
+	Object *new_object(Hierarchy::Handle node);
 	//Delete an object:
 	void delete_object(Object *);
 
-	//Create a new camera attached to a transform:
+	//Create a new camera attached to a transform (or hierarchy node):
 	Camera *new_camera(Transform *transform);
+	Camera *new_camera(Hierarchy::Handle node);
 	//Delete a camera:
 	void delete_camera(Camera *);
 
+	//"HerdLook"s contain information needed to draw the animals in a Herd (see Herd.hpp),
+	// which live in flat arrays rather than as Objects:
+	struct HerdLook {
+		//program info (as for Object):
+		GLuint program = 0;
+		GLuint program_mvp_mat4 = -1U;
+		GLuint program_mv_mat4x3 = -1U;
+		GLuint program_itmv_mat3 = -1U;
+
+		//attribute info (each Herd::Skin is a range of this vertex array):
+		GLuint vao = 0;
+
+		//instanced drawing, used instead of the above if 'instanced_program' is set (see vertex_color_instanced_program.hpp):
+		// each skin's animals are drawn by one glDrawArraysInstanced, their matrices streamed through 'instance_buffer'
+		GLuint instanced_program = 0;
+		GLuint instanced_program_world_to_clip_mat4 = -1U;
+		GLuint instanced_program_instance_to_world_mat4x3 = -1U; //(attribute location)
+		GLuint instanced_vao = 0; //the same meshes, plus the per-instance attribute (from 'instance_buffer')
+		GLuint instance_buffer = 0;
+	};
+
 	//used to manage allocated objects:
 	Transform *first_transform = nullptr;
 	Object *first_object = nullptr;
 	Camera *first_camera = nullptr;
 	//(you shouldn't be manipulating these pointers directly
 
+	//where they are allocated (see Pool.hpp; read the counters freely):
+	Pool< Transform > transform_pool;
+	Pool< Object > object_pool;
+	Pool< Camera > camera_pool;
+
+	//flat transform hierarchy, for scenes with many moving things (see Hierarchy.hpp):
+	// (objects and cameras attached to its nodes are drawn as of the last hierarchy.update())
+	Hierarchy hierarchy;
+
 	//------ functions to traverse the scene ------
 
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
 	//"camera" must be non-null!
-	void draw(Camera const *camera) const;
+	// (objects are drawn in the order 'queue' sorts them into; pass one in to reuse its buffers and read its counters)
+	void draw(Camera const *camera, RenderQueue *queue = nullptr) const;
+
+	//Fill 'queue' with the commands that draw() would send, without sending them (no OpenGL needed):
+	void gather(Camera const *camera, RenderQueue *queue) const;
+
+	//matrices of whatever an object or camera is attached to:
+	glm::mat4 const &local_to_world(Object const *object) const;
+	glm::mat4 world_to_local(Camera const *camera) const;
+
+	//Draw the living animals in 'herd' from a given camera, standing on z = 0 and facing their headings:
+	// (matrices are computed on 'jobs', if given; pass a 'queue' to reuse its buffers and read its counters)
+	void draw(Camera const *camera, Herd const &herd, HerdLook const &look, Jobs *jobs = nullptr, RenderQueue *queue = nullptr) const;
+
+	//Fill 'queue' with the commands that drawing 'herd' would send, without sending them (no OpenGL needed):
+	void gather(Camera const *camera, Herd const &herd, HerdLook const &look, RenderQueue *queue, Jobs *jobs = nullptr) const;
 
-	~Scene(); //destructor deallocates transforms, objects, cameras
+	~Scene(); //destructor deallocates transforms, objects, cameras (and the pools' memory, all at once)
 
 	//add transforms/objects/cameras from a scene file:
 	// the 'on_object' callback gives you a chance to look up a mesh by name and make an object.
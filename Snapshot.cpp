@@ -0,0 +1,206 @@
+#include "Snapshot.hpp"
+
+#include "Game.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+//------ bit packing ------
+//(bits are stored least-significant first)
+
+namespace {
+
+struct BitWriter {
+	std::vector< uint8_t > &bytes;
+	uint64_t pending = 0; //bits not yet stored in 'bytes'
+	uint32_t pending_count = 0;
+
+	explicit BitWriter(std::vector< uint8_t > &bytes_) : bytes(bytes_) { bytes.clear(); }
+
+	void write(uint32_t value, uint32_t count) {
+		assert(count <= 32);
+		pending |= uint64_t(value & uint32_t((uint64_t(1) << count) - 1)) << pending_count;
+		pending_count += count;
+		while (pending_count >= 8) {
+			bytes.emplace_back(uint8_t(pending));
+			pending >>= 8;
+			pending_count -= 8;
+		}
+	}
+
+	//store the last partial byte (zero-padded):
+	void finish() {
+		if (pending_count) bytes.emplace_back(uint8_t(pending));
+		pending = 0;
+		pending_count = 0;
+	}
+};
+
+struct BitReader {
+	uint8_t const *bytes;
+	size_t size;
+	size_t used = 0; //bits read
+	bool overflow = false; //tried to read past the end
+
+	BitReader(char const *bytes_, size_t size_) : bytes(reinterpret_cast< uint8_t const * >(bytes_)), size(size_) { }
+
+	uint32_t read(uint32_t count) {
+		if (used + count > size * 8) {
+			overflow = true;
+			return 0;
+		}
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < count; ++i, ++used) {
+			if (bytes[used / 8] & (1u << (used % 8))) value |= (1u << i);
+		}
+		return value;
+	}
+};
+
+constexpr const uint32_t QuantizeMax = (1u << Snapshot::QuantizeBits) - 1;
+
+//small counts in 7 bits, anything else in 33:
+void write_count(BitWriter &to, uint32_t value) {
+	if (value < (1u << 6)) {
+		to.write(0, 1);
+		to.write(value, 6);
+	} else {
+		to.write(1, 1);
+		to.write(value, 32);
+	}
+}
+uint32_t read_count(BitReader &from) {
+	if (from.read(1) == 0) return from.read(6);
+	else return from.read(32);
+}
+
+//quantized coordinate relative to a baseline: small steps in 8 bits, anything else in 1 + QuantizeBits:
+void write_coordinate(BitWriter &to, uint16_t value, uint16_t base) {
+	int32_t delta = int32_t(value) - int32_t(base);
+	if (delta >= -64 && delta < 64) {
+		to.write(0, 1);
+		to.write(uint32_t(delta + 64), 7);
+	} else {
+		to.write(1, 1);
+		to.write(value, Snapshot::QuantizeBits);
+	}
+}
+uint16_t read_coordinate(BitReader &from, uint16_t base) {
+	if (from.read(1) == 0) return uint16_t(int32_t(base) + int32_t(from.read(7)) - 64);
+	else return uint16_t(from.read(Snapshot::QuantizeBits));
+}
+
+void write_position(BitWriter &to, Snapshot::Quantized const &at, Snapshot::Quantized const *base) {
+	if (base) {
+		to.write(at != *base ? 1 : 0, 1);
+		if (at == *base) return;
+		write_coordinate(to, at.x, base->x);
+		write_coordinate(to, at.y, base->y);
+	} else {
+		to.write(at.x, Snapshot::QuantizeBits);
+		to.write(at.y, Snapshot::QuantizeBits);
+	}
+}
+Snapshot::Quantized read_position(BitReader &from, Snapshot::Quantized const *base) {
+	Snapshot::Quantized at;
+	if (base) {
+		if (from.read(1) == 0) return *base;
+		at.x = read_coordinate(from, base->x);
+		at.y = read_coordinate(from, base->y);
+	} else {
+		at.x = uint16_t(from.read(Snapshot::QuantizeBits));
+		at.y = uint16_t(from.read(Snapshot::QuantizeBits));
+	}
+	return at;
+}
+
+} //namespace
+
+//------ Snapshot ------
+
+Snapshot::Quantized Snapshot::quantize(glm::vec2 const &at) {
+	auto to_fixed = [](float v, float size) -> uint16_t {
+		float t = (v + 0.5f * size) / size;
+		t = std::max(0.0f, std::min(1.0f, t));
+		return uint16_t(std::round(t * QuantizeMax));
+	};
+	Quantized ret;
+	ret.x = to_fixed(at.x, Game::FrameWidth);
+	ret.y = to_fixed(at.y, Game::FrameHeight);
+	return ret;
+}
+
+glm::vec2 Snapshot::dequantize(Quantized const &at) {
+	return glm::vec2(
+		(at.x / float(QuantizeMax) - 0.5f) * Game::FrameWidth,
+		(at.y / float(QuantizeMax) - 0.5f) * Game::FrameHeight
+	);
+}
+
+Snapshot const *SnapshotHistory::find(uint32_t tick) const {
+	if (tick == 0) return nullptr;
+	Snapshot const &slot = slots[tick % Size];
+	return (slot.tick == tick ? &slot : nullptr);
+}
+
+void SnapshotHistory::add(Snapshot const &snapshot) {
+	slots[snapshot.tick % Size] = snapshot;
+}
+
+//------ State payloads ------
+//  [1 bit: has baseline]
+//  with baseline:    [5 bits: baseline.tick % SnapshotHistory::Size] [5 bits: tick - baseline.tick]
+//                    [count: ack - baseline.ack] then, per position, [1 bit: changed] and,
+//                    if changed, per coordinate, a 7-bit delta or the full value
+//  without baseline: [32 bits: tick] [32 bits: ack] [QuantizeBits per coordinate]
+//
+//(the baseline is named by its history slot; that's unambiguous as long as it is less than
+// SnapshotHistory::Size ticks older, since no later snapshot can have reused the slot yet)
+
+static_assert(SnapshotHistory::Size == 32, "baseline slot and tick offset are packed in 5 bits each");
+
+void encode_snapshot(Snapshot const &snapshot, Snapshot const *baseline, std::vector< uint8_t > *payload) {
+	//baselines must be (a little) older and can't go backward in acks:
+	if (baseline && (baseline->tick >= snapshot.tick || snapshot.tick - baseline->tick >= SnapshotHistory::Size || baseline->ack > snapshot.ack)) {
+		baseline = nullptr;
+	}
+
+	BitWriter to(*payload);
+	to.write(baseline ? 1 : 0, 1);
+	if (baseline) {
+		to.write(baseline->tick % SnapshotHistory::Size, 5);
+		to.write(snapshot.tick - baseline->tick, 5);
+		write_count(to, snapshot.ack - baseline->ack);
+		write_position(to, snapshot.crosshair, &baseline->crosshair);
+		write_position(to, snapshot.wolf, &baseline->wolf);
+	} else {
+		to.write(snapshot.tick, 32);
+		to.write(snapshot.ack, 32);
+		write_position(to, snapshot.crosshair, nullptr);
+		write_position(to, snapshot.wolf, nullptr);
+	}
+	to.finish();
+}
+
+bool decode_snapshot(char const *payload, size_t size, SnapshotHistory const &history, Snapshot *snapshot) {
+	BitReader from(payload, size);
+	Snapshot ret;
+	if (from.read(1)) {
+		Snapshot const &baseline = history.slots[from.read(5)];
+		uint32_t offset = from.read(5);
+		if (baseline.tick == 0 || offset == 0) return false;
+		ret.tick = baseline.tick + offset;
+		ret.ack = baseline.ack + read_count(from);
+		ret.crosshair = read_position(from, &baseline.crosshair);
+		ret.wolf = read_position(from, &baseline.wolf);
+	} else {
+		ret.tick = from.read(32);
+		ret.ack = from.read(32);
+		ret.crosshair = read_position(from, nullptr);
+		ret.wolf = read_position(from, nullptr);
+	}
+	if (from.overflow || ret.tick == 0) return false;
+	*snapshot = ret;
+	return true;
+}
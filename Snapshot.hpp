@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A Snapshot is what a State message carries: the tick, the recipient's
+ * last applied input, and both player positions quantized to the playfield
+ * (Game::FrameWidth x Game::FrameHeight, QuantizeBits per axis).
+ *
+ * Snapshots are bit-packed, and sent as a delta from a baseline -- the
+ * latest snapshot the recipient has acknowledged (Protocol::Input::state_ack)
+ * and less than SnapshotHistory::Size ticks old -- so an unchanged position
+ * costs one bit and a moving one about two bytes.
+ * Both ends keep the last few snapshots in a SnapshotHistory to find the
+ * baseline by tick:
+
+//server, per recipient:
+Snapshot snapshot = ...;
+std::vector< uint8_t > payload;
+encode_snapshot(snapshot, sent.find(acked_tick), &payload);
+sent.add(snapshot);
+send_frame(connection, Protocol::State::Type, payload.data(), payload.size());
+
+//client:
+Snapshot snapshot;
+if (decode_snapshot(payload, size, received, &snapshot)) received.add(snapshot);
+
+ */
+
+struct Snapshot {
+	struct Quantized {
+		uint16_t x = 0;
+		uint16_t y = 0;
+		bool operator==(Quantized const &o) const { return x == o.x && y == o.y; }
+		bool operator!=(Quantized const &o) const { return !(*this == o); }
+	};
+
+	uint32_t tick = 0; //(0 marks an unused SnapshotHistory slot)
+	uint32_t ack = 0;
+	Quantized crosshair;
+	Quantized wolf;
+
+	//playfield position <-> fixed point (positions outside the playfield are clamped to its edge):
+	static constexpr const uint32_t QuantizeBits = 12;
+	static Quantized quantize(glm::vec2 const &at);
+	static glm::vec2 dequantize(Quantized const &at);
+
+	bool operator==(Snapshot const &o) const { return tick == o.tick && ack == o.ack && crosshair == o.crosshair && wolf == o.wolf; }
+};
+
+//The last few snapshots sent to (or received from) one connection:
+struct SnapshotHistory {
+	static constexpr const uint32_t Size = 32; //(also limits how far back a baseline can be: Size - 1 ticks)
+
+	//snapshot for 'tick' (or nullptr if it isn't in the history):
+	Snapshot const *find(uint32_t tick) const;
+	void add(Snapshot const &snapshot);
+
+	Snapshot slots[Size]; //indexed by tick % Size
+};
+
+//Bit-pack 'snapshot' into 'payload' (replacing its contents), as a delta from 'baseline' if given:
+void encode_snapshot(Snapshot const &snapshot, Snapshot const *baseline, std::vector< uint8_t > *payload);
+
+//Unpack a State payload, looking up its baseline (if any) in 'history':
+// returns false if the payload is truncated or names a baseline slot that is empty in 'history'.
+bool decode_snapshot(char const *payload, size_t size, SnapshotHistory const &history, Snapshot *snapshot);
@@ -0,0 +1,66 @@
+#include "SpatialHash.hpp"
+
+#include <cassert>
+
+SpatialHash::SpatialHash(float cell_size_) : cell_size(cell_size_) {
+	assert(cell_size > 0.0f);
+}
+
+void SpatialHash::insert(uint32_t id, glm::vec2 const &at) {
+	//cell containing 'at' (far-off or NaN positions are kept to a sane range of cells):
+	auto coord = [this](float v) -> int32_t {
+		float c = std::floor(v / cell_size);
+		if (!(c >= -1e9f)) return -1000000000;
+		if (c >= 1e9f) return 1000000000;
+		return int32_t(c);
+	};
+	int32_t x = coord(at.x);
+	int32_t y = coord(at.y);
+	uint64_t key = cell_key(x, y);
+
+	uint32_t i = Entities::index(id);
+	if (i >= entries.size()) entries.resize(i + 1);
+	Entry &entry = entries[i];
+	if (entry.present) {
+		if (entry.id == id && entry.cell == key) { //(most moves stay in the same cell)
+			entry.at = at;
+			return;
+		}
+		remove(entry.id);
+	}
+
+	std::vector< uint32_t > &cell = cells[key];
+	entry.id = id;
+	entry.at = at;
+	entry.cell = key;
+	entry.slot = uint32_t(cell.size());
+	entry.present = true;
+	cell.emplace_back(i);
+	count += 1;
+
+	if (min_x > max_x) {
+		min_x = max_x = x;
+		min_y = max_y = y;
+	} else {
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+	}
+}
+
+void SpatialHash::remove(uint32_t id) {
+	uint32_t i = Entities::index(id);
+	if (i >= entries.size() || !entries[i].present || entries[i].id != id) return;
+	Entry &entry = entries[i];
+	auto f = cells.find(entry.cell);
+	assert(f != cells.end());
+	std::vector< uint32_t > &cell = f->second;
+	assert(entry.slot < cell.size() && cell[entry.slot] == i);
+	//swap the last id in the cell into the removed one's slot:
+	cell[entry.slot] = cell.back();
+	entries[cell.back()].slot = entry.slot;
+	cell.pop_back();
+	entry.present = false;
+	count -= 1;
+}
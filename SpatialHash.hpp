@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Entities.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/*
+ * SpatialHash indexes points (animals) by id and position in a uniform
+ * grid of square cells, stored sparsely in a hash map, so that "what is
+ * near here?" looks at a few cells rather than every point.
+ * Points can be added, moved, and removed one at a time:
+
+SpatialHash animals(1.0f);
+animals.insert(id, position);
+animals.insert(wolf_id, wolf_position); //(again, as it moves)
+uint32_t target = animals.nearest(crosshair, Game::AttackRange, [&](uint32_t id){
+	return living(id);
+});
+if (target) ...
+
+ * Ids are Entities ids (a dense index plus a generation); 0 means "none".
+ */
+
+struct SpatialHash {
+	explicit SpatialHash(float cell_size = 1.0f);
+
+	//add point 'id' at 'at' (or move it there if it is already present; replaces an older generation's point):
+	void insert(uint32_t id, glm::vec2 const &at);
+	//remove point 'id' (if present):
+	void remove(uint32_t id);
+
+	//position of point 'id': returns false if it isn't present.
+	bool find(uint32_t id, glm::vec2 *at) const {
+		uint32_t i = Entities::index(id);
+		if (i >= entries.size() || !entries[i].present || entries[i].id != id) return false;
+		*at = entries[i].at;
+		return true;
+	}
+
+	//number of points present:
+	size_t size() const { return count; }
+
+	//call 'f(id, at)' for every point with min <= at <= max:
+	template< typename F >
+	void query(glm::vec2 const &min, glm::vec2 const &max, F const &f) const {
+		if (count == 0) return;
+		int32_t x0, y0, x1, y1;
+		cell_coords(min, &x0, &y0);
+		cell_coords(max, &x1, &y1);
+		auto visit = [&](std::vector< uint32_t > const &cell) {
+			for (uint32_t i : cell) {
+				Entry const &entry = entries[i];
+				if (entry.at.x >= min.x && entry.at.x <= max.x && entry.at.y >= min.y && entry.at.y <= max.y) f(entry.id, entry.at);
+			}
+		};
+		//large rectangles: cheaper to walk the occupied cells than to look up every cell in range:
+		if (uint64_t(x1 - x0 + 1) * uint64_t(y1 - y0 + 1) > cells.size()) {
+			for (auto const &cell : cells) visit(cell.second);
+			return;
+		}
+		for (int32_t y = y0; y <= y1; ++y) {
+			for (int32_t x = x0; x <= x1; ++x) {
+				auto cell = cells.find(cell_key(x, y));
+				if (cell != cells.end()) visit(cell->second);
+			}
+		}
+	}
+
+	//nearest point closer than 'radius' to 'at' for which 'accept(id)' is true (or 0 if there is none):
+	// (ties go to the smaller id, so results don't depend on insertion order)
+	template< typename Accept >
+	uint32_t nearest(glm::vec2 const &at, float radius, Accept const &accept) const {
+		uint32_t best = 0;
+		float best_distance2 = 0.0f;
+		query(at - glm::vec2(radius), at + glm::vec2(radius), [&](uint32_t id, glm::vec2 const &pt) {
+			glm::vec2 to = pt - at;
+			float distance2 = glm::dot(to, to);
+			if (distance2 >= radius * radius) return;
+			if (best != 0 && (distance2 > best_distance2 || (distance2 == best_distance2 && id > best))) return;
+			if (!accept(id)) return;
+			best = id;
+			best_distance2 = distance2;
+		});
+		return best;
+	}
+	uint32_t nearest(glm::vec2 const &at, float radius) const {
+		return nearest(at, radius, [](uint32_t){ return true; });
+	}
+
+	//internals:
+	struct Entry {
+		uint32_t id = 0;
+		glm::vec2 at = glm::vec2(0.0f);
+		uint64_t cell = 0; //key in 'cells'
+		uint32_t slot = 0; //index in that cell
+		bool present = false;
+	};
+	float cell_size;
+	std::vector< Entry > entries; //indexed by Entities::index(id)
+	std::unordered_map< uint64_t, std::vector< uint32_t > > cells; //cell_key -> indices of the entries in that cell
+	size_t count = 0;
+	//range of cell coordinates ever used (queries are clamped to it):
+	int32_t min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+
+	static uint64_t cell_key(int32_t x, int32_t y) {
+		return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+	}
+	//cell containing 'at', clamped to the range of cells in use:
+	void cell_coords(glm::vec2 const &at, int32_t *x, int32_t *y) const {
+		auto clamp = [this](float v, int32_t lo, int32_t hi) -> int32_t {
+			float c = std::floor(v / cell_size);
+			if (!(c >= float(lo))) return lo; //(also catches NaN)
+			if (c >= float(hi)) return hi;
+			return int32_t(c);
+		};
+		*x = clamp(at.x, min_x, max_x);
+		*y = clamp(at.y, min_y, max_y);
+	}
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Fixed-size lock-free queue for handing items from exactly one producer thread
+// to exactly one consumer thread (e.g., accepted sockets to a server worker):
+template< typename T, uint32_t Size >
+struct SpscQueue {
+	static_assert(Size != 0 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+	//producer: returns false if the queue is full
+	bool push(T const &item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Size) return false;
+		items[h & (Size - 1)] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer: returns false if the queue is empty
+	bool pop(T *item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		*item = items[t & (Size - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//internals:
+	//(head and tail are padded onto separate cache lines so the two threads don't contend;
+	// padding rather than alignas, since C++11 'new' can't honor over-alignment)
+	std::atomic< uint32_t > head{0}; //next slot to write; only changed by the producer
+	char pad_head[64 - sizeof(std::atomic< uint32_t >)];
+	std::atomic< uint32_t > tail{0}; //next slot to read; only changed by the consumer
+	char pad_tail[64 - sizeof(std::atomic< uint32_t >)];
+	T items[Size];
+};
@@ -0,0 +1,458 @@
+#include "UdpConnection.hpp"
+
+#include "Message.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+//Datagrams are a one-byte kind followed by kind-specific data:
+// 'c' [] -- keepalive
+// 'x' [] -- goodbye
+// 'r' [uint32_t seq][bytes] -- reliable channel chunk
+// 'k' [uint32_t next_expected_seq] -- reliable channel acknowledgement
+// 'u' [uint32_t seq][frames] -- unreliable channel datagram
+
+//keep datagrams under a typical path MTU to avoid IP fragmentation:
+constexpr const uint32_t MaxDatagram = 1200;
+constexpr const uint32_t MaxChunk = MaxDatagram - 1 - 4;
+constexpr const uint32_t Window = 64; //most reliable chunks in flight at once
+constexpr const double ResendDelay = 0.1; //seconds before an unacknowledged chunk is sent again
+constexpr const double KeepaliveInterval = 0.5; //seconds of silence before sending a keepalive
+constexpr const double Timeout = 5.0; //seconds of silence from the peer before the connection is closed
+
+static double now_seconds() {
+	return std::chrono::duration< double >(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//sequence numbers wrap, so compare them by signed difference:
+static int32_t seq_diff(uint32_t a, uint32_t b) {
+	return int32_t(a - b);
+}
+
+//identify a peer by family, port, and address:
+static std::string address_key(sockaddr_storage const &address, socklen_t address_size) {
+	if (address.ss_family == AF_INET) {
+		sockaddr_in const &in = reinterpret_cast< sockaddr_in const & >(address);
+		return std::string("4") + std::string(reinterpret_cast< char const * >(&in.sin_port), sizeof(in.sin_port))
+			+ std::string(reinterpret_cast< char const * >(&in.sin_addr), sizeof(in.sin_addr));
+	} else if (address.ss_family == AF_INET6) {
+		sockaddr_in6 const &in6 = reinterpret_cast< sockaddr_in6 const & >(address);
+		return std::string("6") + std::string(reinterpret_cast< char const * >(&in6.sin6_port), sizeof(in6.sin6_port))
+			+ std::string(reinterpret_cast< char const * >(&in6.sin6_addr), sizeof(in6.sin6_addr));
+	} else {
+		return std::string(reinterpret_cast< char const * >(&address), address_size);
+	}
+}
+
+static void send_to(SOCKET s, sockaddr_storage const &address, socklen_t address_size, char const *data, size_t size) {
+	#ifdef _WIN32
+	sendto(s, data, int(size), 0, reinterpret_cast< sockaddr const * >(&address), address_size);
+	#else
+	sendto(s, data, size, MSG_DONTWAIT, reinterpret_cast< sockaddr const * >(&address), address_size);
+	#endif
+	//NOTE: errors are ignored; to the peer it looks like packet loss, which the protocol already handles.
+}
+
+//send a datagram to a connection's peer, by way of the loss/latency shim:
+static void send_datagram(SOCKET s, UdpShim &shim, UdpConnection &c, char const *data, size_t size, double now) {
+	assert(size <= MaxDatagram);
+	c.last_send_time = now;
+	if (shim.loss > 0.0f && std::uniform_real_distribution< float >(0.0f, 1.0f)(shim.rng) < shim.loss) {
+		return;
+	}
+	if (shim.latency > 0.0f || shim.jitter > 0.0f) {
+		shim.delayed.emplace_back();
+		UdpShim::Delayed &d = shim.delayed.back();
+		d.time = now + shim.latency + shim.jitter * std::uniform_real_distribution< float >(0.0f, 1.0f)(shim.rng);
+		d.address = c.address;
+		d.address_size = c.address_size;
+		d.data.assign(data, data + size);
+		return;
+	}
+	send_to(s, c.address, c.address_size, data, size);
+}
+
+//send any delayed datagrams that are due:
+static void release_delayed(SOCKET s, UdpShim &shim, double now) {
+	size_t kept = 0;
+	for (size_t i = 0; i < shim.delayed.size(); ++i) {
+		UdpShim::Delayed &d = shim.delayed[i];
+		if (d.time <= now) {
+			send_to(s, d.address, d.address_size, d.data.data(), d.data.size());
+		} else {
+			if (kept != i) shim.delayed[kept] = std::move(d);
+			++kept;
+		}
+	}
+	shim.delayed.resize(kept);
+}
+
+//send everything a connection has queued (plus resends, acks, keepalives):
+static void send_pending(SOCKET s, UdpShim &shim, UdpConnection &c, double now) {
+	char packet[MaxDatagram];
+
+	if (c.closing) {
+		//goodbye isn't acknowledged, so send a few copies (the peer's timeout catches the rest):
+		packet[0] = 'x';
+		for (uint32_t i = 0; i < 3; ++i) {
+			send_datagram(s, shim, c, packet, 1, now);
+		}
+		c.closing = false;
+		return;
+	}
+	if (!c.open) return;
+
+	{ //reliable channel: cut queued bytes into chunks, then send new and overdue chunks:
+		ByteBuffer &queued = c.reliable.send_buffer;
+		while (!queued.empty() && c.unacked.size() < Window) {
+			size_t size = std::min< size_t >(MaxChunk, queued.size());
+			c.unacked.emplace_back();
+			UdpConnection::Chunk &chunk = c.unacked.back();
+			chunk.seq = c.next_chunk_seq++;
+			chunk.data.assign(queued.data(), queued.data() + size);
+			chunk.sent_time = -ResendDelay; //i.e., send right away
+			queued.consume(size);
+		}
+		for (auto &chunk : c.unacked) {
+			if (now - chunk.sent_time < ResendDelay) continue;
+			packet[0] = 'r';
+			memcpy(packet + 1, &chunk.seq, 4);
+			memcpy(packet + 1 + 4, chunk.data.data(), chunk.data.size());
+			send_datagram(s, shim, c, packet, 1 + 4 + chunk.data.size(), now);
+			chunk.sent_time = now;
+		}
+	}
+
+	if (!c.unreliable.send_buffer.empty()) { //unreliable channel: pack whole frames into datagrams
+		ByteBuffer &queued = c.unreliable.send_buffer;
+		char const *at = queued.data();
+		char const *end = at + queued.size();
+		size_t used = 0;
+		auto emit = [&]() {
+			if (used == 0) return;
+			packet[0] = 'u';
+			memcpy(packet + 1, &c.next_datagram_seq, 4);
+			c.next_datagram_seq += 1;
+			send_datagram(s, shim, c, packet, 1 + 4 + used, now);
+			used = 0;
+		};
+		while (at < end) {
+			uint8_t type;
+			char const *payload;
+			uint32_t size;
+			char const *next;
+			if (decode_frame(at, end, &type, &payload, &size, &next) != FrameComplete) {
+				std::cerr << "[UdpConnection] unreliable channel contains a partial or malformed frame; dropping it." << std::endl;
+				break;
+			}
+			size_t length = next - at;
+			if (length > MaxChunk) {
+				std::cerr << "[UdpConnection] frame of " << length << " bytes is too large for the unreliable channel; dropping it." << std::endl;
+			} else {
+				if (used + length > MaxChunk) emit();
+				memcpy(packet + 1 + 4 + used, at, length);
+				used += length;
+			}
+			at = next;
+		}
+		emit();
+		queued.clear();
+	}
+
+	if (c.need_ack) {
+		packet[0] = 'k';
+		memcpy(packet + 1, &c.next_expected_seq, 4);
+		send_datagram(s, shim, c, packet, 1 + 4, now);
+		c.need_ack = false;
+	}
+
+	if (now - c.last_send_time >= KeepaliveInterval) {
+		packet[0] = 'c';
+		send_datagram(s, shim, c, packet, 1, now);
+	}
+}
+
+//handle one datagram from a connection's peer; returns true if it delivered data to a channel:
+static bool receive_datagram(UdpConnection &c, char const *data, size_t size, double now) {
+	c.last_recv_time = now;
+	char kind = data[0];
+	if (kind == 'c') {
+		//keepalive; nothing else to do
+	} else if (kind == 'x') {
+		c.open = false;
+	} else if (kind == 'k' && size >= 1 + 4) {
+		uint32_t next_expected;
+		memcpy(&next_expected, data + 1, 4);
+		while (!c.unacked.empty() && seq_diff(next_expected, c.unacked.front().seq) > 0) {
+			c.unacked.pop_front();
+		}
+	} else if (kind == 'r' && size >= 1 + 4) {
+		uint32_t seq;
+		memcpy(&seq, data + 1, 4);
+		c.need_ack = true; //(even duplicates, in case the earlier ack was lost)
+		int32_t ahead = seq_diff(seq, c.next_expected_seq);
+		if (ahead == 0) {
+			c.reliable.recv_buffer.append(data + 1 + 4, size - 1 - 4);
+			c.next_expected_seq += 1;
+			//deliver anything that was waiting on this chunk:
+			for (auto f = c.out_of_order.find(c.next_expected_seq); f != c.out_of_order.end(); f = c.out_of_order.find(c.next_expected_seq)) {
+				c.reliable.recv_buffer.append(f->second.data(), f->second.size());
+				c.out_of_order.erase(f);
+				c.next_expected_seq += 1;
+			}
+			return true;
+		} else if (ahead > 0 && ahead < int32_t(Window)) {
+			c.out_of_order[seq].assign(data + 1 + 4, data + size);
+		}
+	} else if (kind == 'u' && size >= 1 + 4) {
+		uint32_t seq;
+		memcpy(&seq, data + 1, 4);
+		if (!c.got_datagram || seq_diff(seq, c.newest_datagram_seq) > 0) {
+			c.unreliable.recv_buffer.append(data + 1 + 4, size - 1 - 4);
+			c.newest_datagram_seq = seq;
+			c.got_datagram = true;
+			return true;
+		}
+		//else: stale datagram; drop it
+	}
+	return false;
+}
+
+//Polling helper used by both server and client:
+// 'by_address' is non-null for servers (which accept new peers) and null for clients.
+static void poll_udp(
+	char const *where,
+	SOCKET s,
+	std::list< UdpConnection > &connections,
+	std::map< std::string, UdpConnection * > *by_address,
+	UdpShim &shim,
+	std::function< void(UdpConnection *, Connection::Event event) > const &on_event,
+	double timeout) {
+
+	double now = now_seconds();
+
+	//anything queued between polls can go out right away:
+	for (auto &c : connections) {
+		send_pending(s, shim, c, now);
+	}
+	release_delayed(s, shim, now);
+
+	{ //wait (until timeout, or until a delayed datagram is due) for data:
+		for (auto const &d : shim.delayed) {
+			timeout = std::min(timeout, std::max(0.0, d.time - now));
+		}
+		fd_set read_fds;
+		FD_ZERO(&read_fds);
+		FD_SET(s, &read_fds);
+		struct timeval tv;
+		tv.tv_sec = std::lround(std::floor(timeout));
+		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
+		if (select(int(s) + 1, &read_fds, NULL, NULL, &tv) < 0) {
+			std::cerr << "[" << where << "] select returned an error; will attempt to read anyway." << std::endl;
+		}
+	}
+
+	now = now_seconds();
+
+	static thread_local std::vector< UdpConnection * > opened;
+	static thread_local std::vector< UdpConnection * > received;
+	static thread_local std::vector< UdpConnection * > said_goodbye;
+	opened.clear();
+	received.clear();
+	said_goodbye.clear();
+
+	static thread_local char buffer[MaxDatagram];
+	std::string client_key;
+	if (!by_address) {
+		client_key = address_key(connections.front().address, connections.front().address_size);
+	}
+
+	//read every datagram waiting on the socket:
+	while (true) {
+		sockaddr_storage from;
+		memset(&from, 0, sizeof(from));
+		socklen_t from_size = sizeof(from);
+		#ifdef _WIN32
+		int ret = recvfrom(s, buffer, MaxDatagram, 0, reinterpret_cast< sockaddr * >(&from), &from_size);
+		#else
+		ssize_t ret = recvfrom(s, buffer, MaxDatagram, MSG_DONTWAIT, reinterpret_cast< sockaddr * >(&from), &from_size);
+		#endif
+		if (ret < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				std::cerr << "[" << where << "] recvfrom() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+			}
+			break;
+		}
+		if (ret == 0) continue;
+
+		UdpConnection *c = nullptr;
+		std::string key = address_key(from, from_size);
+		if (by_address) {
+			auto f = by_address->find(key);
+			if (f != by_address->end()) {
+				c = f->second;
+			} else if (buffer[0] != 'x') {
+				//new peer (any datagram opens a connection, since the first one may have been lost):
+				connections.emplace_back();
+				c = &connections.back();
+				c->address = from;
+				c->address_size = from_size;
+				c->last_recv_time = now;
+				by_address->insert(std::make_pair(key, c));
+				opened.emplace_back(c);
+				std::cerr << "[" << where << "] new peer." << std::endl; //INFO
+			}
+		} else if (key == client_key) {
+			c = &connections.front();
+		}
+		if (!c || !c->open) continue;
+
+		if (receive_datagram(*c, buffer, ret, now) && std::find(received.begin(), received.end(), c) == received.end()) {
+			received.emplace_back(c);
+		}
+		if (!c->open) {
+			std::cerr << "[" << where << "] peer said goodbye." << std::endl; //INFO
+			said_goodbye.emplace_back(c);
+		}
+	}
+
+	for (UdpConnection *c : opened) {
+		if (on_event) on_event(c, Connection::OnOpen);
+	}
+	for (UdpConnection *c : received) {
+		if (on_event) on_event(c, Connection::OnRecv);
+	}
+	for (UdpConnection *c : said_goodbye) {
+		if (on_event) on_event(c, Connection::OnClose);
+	}
+
+	//close connections that went quiet:
+	for (auto &c : connections) {
+		if (c.open && now - c.last_recv_time > Timeout) {
+			std::cerr << "[" << where << "] peer timed out, disconnecting." << std::endl;
+			c.open = false;
+			if (on_event) on_event(&c, Connection::OnClose);
+		}
+	}
+
+	//send replies queued by the callbacks:
+	for (auto &c : connections) {
+		send_pending(s, shim, c, now);
+	}
+	release_delayed(s, shim, now);
+
+	//reap closed peers (servers only; a client keeps its connection object):
+	if (by_address) {
+		for (auto c = connections.begin(); c != connections.end(); /*later*/) {
+			auto old = c;
+			++c;
+			if (!old->open && !old->closing) {
+				by_address->erase(address_key(old->address, old->address_size));
+				connections.erase(old);
+			}
+		}
+	}
+}
+
+//---------------------------------
+
+//make a non-blocking UDP socket for the first address that works:
+static SOCKET make_udp_socket(char const *where, std::string const &host, std::string const &port, bool bind_it, sockaddr_storage *address, socklen_t *address_size) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	if (bind_it) hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(bind_it ? NULL : host.c_str(), port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+
+	//UDP can't tell whether an address "works" the way connect() can, so a
+	// server binds a dual-stack IPv6 socket when possible to hear both families:
+	std::vector< struct addrinfo * > order;
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		if (bind_it && info->ai_family == AF_INET6) order.insert(order.begin(), info);
+		else order.emplace_back(info);
+	}
+
+	SOCKET s = INVALID_SOCKET;
+	for (struct addrinfo *info : order) {
+		s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == INVALID_SOCKET) {
+			std::cout << "[" << where << "] (failed to create socket: " << strerror(errno) << ")" << std::endl;
+			continue;
+		}
+		if (bind_it && info->ai_family == AF_INET6) {
+			int zero = 0;
+			setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char const * >(&zero), sizeof(zero));
+		}
+		if (bind_it && bind(s, info->ai_addr, int(info->ai_addrlen)) < 0) {
+			std::cout << "[" << where << "] (failed to bind: " << strerror(errno) << ")" << std::endl;
+			closesocket(s);
+			s = INVALID_SOCKET;
+			continue;
+		}
+		if (address) {
+			memset(address, 0, sizeof(*address));
+			memcpy(address, info->ai_addr, info->ai_addrlen);
+			*address_size = socklen_t(info->ai_addrlen);
+		}
+		break;
+	}
+	freeaddrinfo(res);
+
+	if (s == INVALID_SOCKET) {
+		throw std::runtime_error("Failed to create UDP socket for " + host + ":" + port);
+	}
+
+	#ifdef _WIN32
+	unsigned long one = 1;
+	ioctlsocket(s, FIONBIO, &one);
+	#endif
+
+	return s;
+}
+
+UdpServer::UdpServer(std::string const &port) {
+	socket = make_udp_socket("UdpServer::UdpServer", "", port, true, nullptr, nullptr);
+	std::cout << "[UdpServer::UdpServer] bound to " << this->port() << "." << std::endl; //(port may have been "0")
+}
+
+uint16_t UdpServer::port() const {
+	sockaddr_storage address;
+	socklen_t address_size = sizeof(address);
+	if (getsockname(socket, reinterpret_cast< sockaddr * >(&address), &address_size) != 0) return 0;
+	if (address.ss_family == AF_INET) return ntohs(reinterpret_cast< sockaddr_in const & >(address).sin_port);
+	if (address.ss_family == AF_INET6) return ntohs(reinterpret_cast< sockaddr_in6 const & >(address).sin6_port);
+	return 0;
+}
+
+void UdpServer::poll(std::function< void(UdpConnection *, Connection::Event event) > const &on_event, double timeout) {
+	poll_udp("UdpServer::poll", socket, connections, &by_address, shim, on_event, timeout);
+}
+
+UdpClient::UdpClient(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+	socket = make_udp_socket("UdpClient::UdpClient", host, port, false, &connection.address, &connection.address_size);
+	connection.last_recv_time = now_seconds(); //(start timeout clock now)
+	std::cout << "[UdpClient::UdpClient] sending to " << host << ":" << port << "." << std::endl;
+}
+
+void UdpClient::poll(std::function< void(UdpConnection *, Connection::Event event) > const &on_event, double timeout) {
+	poll_udp("UdpClient::poll", socket, connections, nullptr, shim, on_event, timeout);
+}
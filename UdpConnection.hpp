@@ -0,0 +1,153 @@
+#pragma once
+
+//UDP counterpart to Connection.hpp; uses the same socket headers and ByteBuffer:
+#include "Connection.hpp"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * UdpConnection is a connection to a peer over UDP with two channels:
+ *
+ *  - 'reliable': bytes appended to reliable.send_buffer arrive, in order,
+ *    in the peer's reliable.recv_buffer. They are sent as numbered chunks
+ *    which are acknowledged by the receiver and resent until they are.
+ *    Use this for events that must not be lost (kills, skin changes, shots).
+ *
+ *  - 'unreliable': carries frames (see Message.hpp). Each poll/flush packs
+ *    the queued frames into sequence-numbered datagrams; the receiver drops
+ *    datagrams that are lost or that arrive after a newer one. Use this for
+ *    state that the next update supersedes anyway (positions).
+ *
+ * As with Connection, you don't create these yourself; a UdpServer or
+ * UdpClient manages them and reports events through the same poll() shape:
+
+UdpServer server("1337");
+BasicMessageHandlers< UdpConnection > handlers;
+...
+server.poll([&](UdpConnection *c, Connection::Event evt){
+	if (evt == Connection::OnRecv) {
+		handlers.dispatch(c, c->reliable.recv_buffer);
+		handlers.dispatch(c, c->unreliable.recv_buffer);
+	}
+}, 0.01);
+
+ * Both ends can inject packet loss and latency on their outgoing packets
+ * with the 'shim' member, which makes loopback testing meaningful.
+ */
+
+//Loss/latency injection for outgoing datagrams:
+struct UdpShim {
+	float loss = 0.0f; //probability that a datagram is silently dropped
+	float latency = 0.0f; //seconds each datagram is held before sending
+	float jitter = 0.0f; //additional random [0,jitter) seconds of delay
+
+	std::mt19937 rng; //(seed this for repeatable runs)
+
+	//internals:
+	struct Delayed {
+		double time; //when to actually send
+		sockaddr_storage address;
+		socklen_t address_size;
+		std::vector< char > data;
+	};
+	std::vector< Delayed > delayed;
+};
+
+//One stream of bytes or frames in a UdpConnection:
+struct UdpChannel {
+	//same helpers as Connection, so that send_message() works on a channel:
+	template< typename T >
+	void send(T const &t) {
+		send_raw(&t, sizeof(T));
+	}
+	void send_raw(void const *data, size_t size) {
+		send_buffer.append(data, size);
+	}
+
+	ByteBuffer send_buffer;
+	ByteBuffer recv_buffer;
+};
+
+struct UdpConnection {
+	UdpConnection() = default;
+	UdpConnection(UdpConnection const &) = delete;
+
+	UdpChannel reliable;
+	UdpChannel unreliable;
+
+	//Call 'close' to tell the peer goodbye and mark the connection for discard:
+	void close() {
+		if (open) {
+			open = false;
+			closing = true;
+		}
+	}
+
+	//so you can if(connection) ... to check for validity:
+	explicit operator bool() { return open; }
+
+	//internals:
+	sockaddr_storage address;
+	socklen_t address_size = 0;
+	bool open = true;
+	bool closing = false; //close() was called; goodbye still needs to be sent
+	double last_recv_time = 0.0;
+	double last_send_time = 0.0;
+
+	//reliable channel state:
+	struct Chunk {
+		uint32_t seq;
+		std::vector< char > data;
+		double sent_time;
+	};
+	uint32_t next_chunk_seq = 0; //sequence number for the next chunk cut from reliable.send_buffer
+	std::deque< Chunk > unacked; //sent chunks awaiting acknowledgement, in order
+	uint32_t next_expected_seq = 0; //next in-order chunk to deliver to reliable.recv_buffer
+	std::map< uint32_t, std::vector< char > > out_of_order; //chunks that arrived early
+	bool need_ack = false;
+
+	//unreliable channel state:
+	uint32_t next_datagram_seq = 0;
+	uint32_t newest_datagram_seq = 0;
+	bool got_datagram = false;
+};
+
+struct UdpServer {
+	UdpServer(std::string const &port); //pass the port number to listen on, as a string
+
+	//poll() sends queued data, receives datagrams, and reports connection events to your callback:
+	void poll(
+		std::function< void(UdpConnection *, Connection::Event event) > const &connection_event = nullptr,
+		double timeout = 0.0 //timeout (seconds)
+	);
+
+	//port the socket is bound to (e.g., the one picked for a server made with port "0"):
+	uint16_t port() const;
+
+	std::list< UdpConnection > connections;
+	SOCKET socket = INVALID_SOCKET;
+	UdpShim shim;
+
+	//internals:
+	std::map< std::string, UdpConnection * > by_address;
+};
+
+struct UdpClient {
+	UdpClient(std::string const &host, std::string const &port);
+
+	//poll() sends queued data, receives datagrams, and reports connection events to your callback:
+	void poll(
+		std::function< void(UdpConnection *, Connection::Event event) > const &connection_event = nullptr,
+		double timeout = 0.0 //timeout (seconds)
+	);
+
+	std::list< UdpConnection > connections; //will only ever contain exactly one connection
+	UdpConnection &connection; //reference to the only connection in the connections list
+	SOCKET socket = INVALID_SOCKET;
+	UdpShim shim;
+};
@@ -0,0 +1,2173 @@
+#include "Connection.hpp"
+#include "Match.hpp"
+#include "Game.hpp"
+#include "Prediction.hpp"
+#include "Snapshot.hpp"
+#include "Interest.hpp"
+#include "SpatialHash.hpp"
+#include "Entities.hpp"
+#include "Herd.hpp"
+#include "Jobs.hpp"
+#include "Lockstep.hpp"
+#include "Recording.hpp"
+#include "Scene.hpp"
+#include "Hierarchy.hpp"
+#include "RenderQueue.hpp"
+#include "Message.hpp"
+#include "UdpConnection.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <sys/wait.h>
+#include <poll.h>
+#endif
+
+/*
+ * bench runs offline (no window, and no sockets except loopback ones) microbenchmarks of
+ * the server-side code (and of the client's scene code that doesn't need OpenGL):
+
+./bench            #run all benchmarks
+./bench ticks      #run just one
+
+ * Benchmarks that also check results (e.g., encode/decode round trips)
+ * throw on a mismatch, and bench exits with an error.
+
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point then) {
+	return std::chrono::duration< double >(Clock::now() - then).count();
+}
+
+//every heap allocation bench (or anything it calls) makes is counted, so benchmarks can check that a path doesn't allocate:
+// (these are kept out of line, since gcc warns about a mismatch if it sees the malloc() and free() inside them)
+static std::atomic< uint64_t > heap_allocations(0);
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void *operator new(std::size_t size) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, std::size_t) noexcept {
+	operator delete(p);
+}
+#endif
+
+//------ ticks: how many matches can one core simulate at Game::TickRate? ------
+static void bench_ticks() {
+	std::cout << "ticks: MatchManager::step() with every match moving (includes queueing Inputs and building States)" << std::endl;
+	for (uint32_t count : {1000, 10000, 100000}) {
+		MatchManager manager;
+		std::vector< Connection > players(2 * count);
+		std::mt19937 mt(0xfeed);
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t index = manager.start_match(&players[2 * i]);
+			Match &match = manager.matches[index];
+			match.wolf = &players[2 * i + 1];
+		}
+
+		//every player sends a batch of Prediction::SendEvery ticks of (random) input as often as a client would:
+		std::vector< Protocol::Input > inputs(2 * count);
+		for (auto &input : inputs) {
+			input.sequence = 1;
+			input.count = Prediction::SendEvery;
+			for (uint32_t t = 0; t < Protocol::Input::MaxTicks; ++t) {
+				input.controls[t] = uint8_t(mt() & 0xf);
+			}
+		}
+
+		//run about a second's worth of work:
+		uint32_t steps = 0;
+		double elapsed = 0.0;
+		while (elapsed < 1.0) {
+			auto before = Clock::now();
+			if (steps % Prediction::SendEvery == 0) {
+				for (uint32_t i = 0; i < count; ++i) {
+					Match &match = manager.matches[i];
+					match.hunter_input.receive(inputs[2 * i]);
+					match.wolf_input.receive(inputs[2 * i + 1]);
+					inputs[2 * i].sequence += Prediction::SendEvery;
+					inputs[2 * i + 1].sequence += Prediction::SendEvery;
+				}
+			}
+			manager.step();
+			elapsed += seconds_since(before);
+			steps += 1;
+			//(stand-in for Server::flush, not timed)
+			for (auto &p : players) {
+				p.send_buffer.clear();
+			}
+		}
+
+		double per_match = elapsed / (double(steps) * count);
+		std::cout << "  " << std::setw(7) << count << " matches: "
+			<< std::fixed << std::setprecision(1) << per_match * 1e9 << " ns/match/step, "
+			<< std::setprecision(0) << 1.0 / (per_match * Game::TickRate) << " matches per core at " << Game::TickRate << " Hz"
+			<< std::endl;
+	}
+}
+
+//------ snapshots: State bytes per match, raw vs. quantized + delta-compressed ------
+static void bench_snapshots() {
+	std::cout << "snapshots: State bandwidth per match (both players, " << Game::TickRate / MatchManager::StateEvery << " States/s), with encode/decode round-trip check" << std::endl;
+
+	//bytes a frame header adds to a payload of 'size' bytes:
+	auto header_size = [](size_t size) -> size_t {
+		uint8_t header[MaxFrameHeader];
+		return encode_frame_header(header, Protocol::State::Type, size);
+	};
+	//the State message before this encoding: tick, ack, and two raw glm::vec2s:
+	size_t raw_payload = 4 + 4 + 4*2 + 4*2;
+	double raw_per_second = 2.0 * (raw_payload + header_size(raw_payload)) * Game::TickRate / MatchManager::StateEvery;
+
+	struct Scenario {
+		char const *name;
+		uint32_t move_percent; //chance each player is holding keys in a given tick
+		uint32_t ack_lag; //States between a State being sent and its ack reaching the server
+	};
+	for (Scenario const &scenario : {
+		Scenario{"idle", 0, 2},
+		Scenario{"both moving", 100, 2},
+		Scenario{"mixed", 50, 2},
+		Scenario{"mixed, 300ms acks", 50, 6},
+		Scenario{"mixed, 600ms acks", 50, 12}}) { //(too old for a baseline: full States)
+
+		std::mt19937 mt(0xbeef);
+		glm::vec2 crosshair(0.0f, 0.0f), wolf(2.0f, 1.0f);
+		Game::Controls hunter_controls, wolf_controls;
+		SnapshotHistory sent, received;
+		std::deque< uint32_t > acks; //ticks decoded by the client, on their way back to the server
+		uint32_t state_ack = 0;
+		uint32_t applied = 0;
+		std::vector< uint8_t > payload;
+		uint64_t bytes = 0;
+		uint32_t states = 0;
+		double encode_time = 0.0;
+
+		for (uint32_t tick = 1; tick <= 600000; ++tick) {
+			//a new set of keys every ~half second:
+			if (tick % 30 == 1) {
+				hunter_controls.set_bits(mt() % 100 < scenario.move_percent ? uint8_t(1 + mt() % 15) : 0);
+				wolf_controls.set_bits(mt() % 100 < scenario.move_percent ? uint8_t(1 + mt() % 15) : 0);
+			}
+			Game::move(crosshair, hunter_controls, Game::TickDt);
+			Game::move(wolf, wolf_controls, Game::TickDt);
+			applied += 1;
+			if (tick % MatchManager::StateEvery != 0) continue;
+
+			Snapshot snapshot;
+			snapshot.tick = tick;
+			snapshot.ack = applied;
+			snapshot.crosshair = Snapshot::quantize(crosshair);
+			snapshot.wolf = Snapshot::quantize(wolf);
+			crosshair = Snapshot::dequantize(snapshot.crosshair);
+			wolf = Snapshot::dequantize(snapshot.wolf);
+
+			auto before = Clock::now();
+			encode_snapshot(snapshot, sent.find(state_ack), &payload);
+			encode_time += seconds_since(before);
+			sent.add(snapshot);
+			bytes += payload.size() + header_size(payload.size());
+			states += 1;
+
+			Snapshot decoded;
+			if (!decode_snapshot(reinterpret_cast< char const * >(payload.data()), payload.size(), received, &decoded) || !(decoded == snapshot)) {
+				throw std::runtime_error("snapshot at tick " + std::to_string(tick) + " did not survive an encode/decode round trip");
+			}
+			received.add(decoded);
+
+			acks.emplace_back(decoded.tick);
+			if (acks.size() > scenario.ack_lag) {
+				state_ack = acks.front();
+				acks.pop_front();
+			}
+		}
+
+		double per_second = 2.0 * double(bytes) / states * Game::TickRate / MatchManager::StateEvery;
+		std::cout << "  " << std::setw(20) << std::left << scenario.name << std::right
+			<< std::fixed << std::setprecision(0) << std::setw(5) << raw_per_second << " -> " << std::setw(4) << per_second << " bytes/s per match"
+			<< " (" << std::setprecision(1) << double(bytes) / states << " bytes/State, "
+			<< encode_time / states * 1e9 << " ns to encode)" << std::endl;
+	}
+
+	//quantization error stays within half a step:
+	float step_x = Game::FrameWidth / ((1 << Snapshot::QuantizeBits) - 1);
+	float step_y = Game::FrameHeight / ((1 << Snapshot::QuantizeBits) - 1);
+	std::mt19937 mt(0xf00d);
+	for (uint32_t i = 0; i < 100000; ++i) {
+		glm::vec2 at(
+			std::uniform_real_distribution< float >(-0.5f, 0.5f)(mt) * Game::FrameWidth,
+			std::uniform_real_distribution< float >(-0.5f, 0.5f)(mt) * Game::FrameHeight
+		);
+		glm::vec2 back = Snapshot::dequantize(Snapshot::quantize(at));
+		if (std::abs(back.x - at.x) > 0.51f * step_x || std::abs(back.y - at.y) > 0.51f * step_y) {
+			throw std::runtime_error("quantization error larger than half a step");
+		}
+	}
+	std::cout << std::setprecision(4) << "  (positions quantized to " << step_x << " x " << step_y << " units)" << std::endl;
+}
+
+//------ interest: animal-event bytes per client for a large herd, broadcast vs. view-filtered ------
+static void bench_interest() {
+	//a 200 x 200 field with 10k animals, 1% of which turn each tick; each client sees a 20 x 16 patch:
+	glm::vec2 field_min(-100.0f), field_max(100.0f);
+	uint32_t const Animals = 10000;
+	uint32_t const Clients = 100;
+	uint32_t const Ticks = 600;
+	uint32_t const TurnsPerTick = Animals / 100;
+	uint32_t const EventBytes = 2 + sizeof(Protocol::Direction);
+	std::cout << "interest: " << Animals << " animals on a " << (field_max.x - field_min.x) << "-unit square field, " << TurnsPerTick * Game::TickRate << " turns/s, "
+		<< Clients << " clients with 20 x 16 views, " << EventBytes << " bytes per event" << std::endl;
+
+	std::mt19937 mt(0xca77);
+	std::uniform_real_distribution< float > coord(field_min.x, field_max.x);
+	std::vector< glm::vec2 > positions(Animals + 1);
+	SpatialHash hash(4.0f);
+	for (uint32_t id = 1; id <= Animals; ++id) {
+		positions[id] = glm::vec2(coord(mt), coord(mt));
+		hash.insert(id, positions[id]);
+	}
+	auto cost_of = [EventBytes](uint32_t) { return EventBytes; };
+
+	for (uint32_t budget : {-1U, 256U, MatchManager::InterestBudget}) {
+		std::vector< Interest > interests(Clients);
+		for (auto &interest : interests) {
+			glm::vec2 at(coord(mt), coord(mt));
+			interest.view.min = at - glm::vec2(10.0f, 8.0f);
+			interest.view.max = at + glm::vec2(10.0f, 8.0f);
+		}
+		std::vector< uint32_t > selected;
+		uint64_t sent = 0;
+		double select_time = 0.0;
+		for (uint32_t tick = 0; tick < Ticks; ++tick) {
+			for (uint32_t i = 0; i < TurnsPerTick; ++i) {
+				uint32_t id = 1 + mt() % Animals;
+				for (auto &interest : interests) interest.mark(id);
+			}
+			for (auto &interest : interests) {
+				//with no budget, everything marked in view should be picked (and nothing else):
+				std::vector< uint32_t > expected;
+				if (budget == -1U) {
+					for (uint32_t id = 1; id <= Animals; ++id) {
+						if (id < interest.dirty.size() && interest.dirty[id] && interest.view.contains(positions[id])) expected.emplace_back(id);
+					}
+				}
+				selected.clear();
+				auto before = Clock::now();
+				interest.select(hash, cost_of, budget, &selected);
+				select_time += seconds_since(before);
+				sent += selected.size();
+				if (budget == -1U) {
+					std::sort(selected.begin(), selected.end());
+					if (selected != expected) throw std::runtime_error("interest selection doesn't match a brute-force scan of the view");
+				} else if (selected.size() * EventBytes > budget) {
+					throw std::runtime_error("interest selection went over budget");
+				}
+			}
+		}
+		double seconds = double(Ticks) / Game::TickRate;
+		double broadcast = double(TurnsPerTick) * Game::TickRate * EventBytes;
+		std::cout << "  budget " << std::setw(10) << (budget == -1U ? std::string("none") : std::to_string(budget) + " B/tick")
+			<< std::fixed << std::setprecision(0) << ": " << std::setw(6) << broadcast << " -> " << std::setw(5) << double(sent) * EventBytes / Clients / seconds << " bytes/s per client"
+			<< " (" << std::setprecision(1) << select_time / (double(Ticks) * Clients) * 1e9 << " ns to select)" << std::endl;
+	}
+}
+
+//------ hits: finding the animal an attack hits, map scan vs. SpatialHash ------
+static void bench_hits() {
+	std::cout << "hits: nearest living animal within Game::AttackRange, std::map scan vs. SpatialHash (~0.25 animals per square unit)" << std::endl;
+	for (uint32_t count : {1000, 10000, 100000}) {
+		float side = std::sqrt(count / 0.25f);
+		std::mt19937 mt(0x5ee7);
+		std::uniform_real_distribution< float > coord(-0.5f * side, 0.5f * side);
+
+		Game game;
+		std::map< uint32_t, glm::vec2 > positions; //(how the client kept them)
+		for (uint32_t i = 0; i < count; ++i) {
+			glm::vec2 at(coord(mt), coord(mt));
+			uint32_t id = game.herd.add(Herd::Sheep, at, 0.0f);
+			positions[id] = at;
+			game.animals.insert(id, at);
+		}
+		for (uint32_t id = 1; id <= count; ++id) {
+			if (mt() % 10 == 0) game.herd.remove(id); //(a few have been eaten)
+		}
+
+		uint32_t const Queries = 2000;
+		std::vector< glm::vec2 > queries;
+		for (uint32_t i = 0; i < Queries; ++i) queries.emplace_back(coord(mt), coord(mt));
+
+		//nearest by scanning every animal (ties to the smaller id, as SpatialHash::nearest):
+		std::vector< uint32_t > expected;
+		auto before = Clock::now();
+		for (auto const &at : queries) {
+			uint32_t best = 0;
+			float best_distance = Game::AttackRange;
+			for (auto const &p : positions) {
+				float distance = glm::distance(at, p.second);
+				if (distance < best_distance && game.herd.ids.alive(p.first)) {
+					best = p.first;
+					best_distance = distance;
+				}
+			}
+			expected.emplace_back(best);
+		}
+		double scan_time = seconds_since(before) / Queries;
+
+		before = Clock::now();
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < Queries; ++i) {
+			uint32_t id = game.nearest_prey(queries[i]);
+			if (id != expected[i]) {
+				throw std::runtime_error("SpatialHash found animal " + std::to_string(id) + " where a scan found " + std::to_string(expected[i]));
+			}
+			hits += (id != 0);
+		}
+		double hash_time = seconds_since(before) / Queries;
+
+		//keeping the index up to date as animals wander (small steps, mostly within a cell):
+		std::uniform_real_distribution< float > step(-0.05f, 0.05f);
+		uint32_t const Moves = 200000;
+		std::vector< std::pair< uint32_t, glm::vec2 > > moves;
+		for (uint32_t i = 0; i < Moves; ++i) {
+			uint32_t id = 1 + mt() % count;
+			positions[id] += glm::vec2(step(mt), step(mt));
+			moves.emplace_back(id, positions[id]);
+		}
+		before = Clock::now();
+		for (auto const &m : moves) game.animals.insert(m.first, m.second);
+		double move_time = seconds_since(before) / Moves;
+
+		std::cout << "  " << std::setw(6) << count << " animals: scan " << std::fixed << std::setprecision(0) << std::setw(8) << scan_time * 1e9 << " ns, hash "
+			<< std::setw(4) << hash_time * 1e9 << " ns per attack (" << std::setprecision(1) << 100.0 * hits / Queries << "% hit); "
+			<< move_time * 1e9 << " ns per move" << std::endl;
+	}
+}
+
+//------ ids: living-animal bookkeeping, std::set + std::map vs. Entities + EntityArray ------
+static void bench_ids() {
+	std::cout << "ids: animal ids and liveness, std::set< uint32_t > + std::map< id, object > vs. Entities + EntityArray (ns per operation)" << std::endl;
+	std::cout << "  " << std::setw(14) << "" << std::setw(16) << "create" << std::setw(16) << "alive?" << std::setw(16) << "lookup" << std::setw(16) << "kill" << std::setw(16) << "iterate" << std::endl;
+	for (uint32_t count : {1000, 10000, 100000}) {
+		std::mt19937 mt(0x1d5);
+		uint32_t const Probes = 1000000;
+		std::vector< uint32_t > probes; //ids to check (some past the end)
+		for (uint32_t i = 0; i < Probes; ++i) probes.emplace_back(1 + mt() % (count + count / 8));
+		std::vector< uint32_t > kills; //half the animals, in random order
+		for (uint32_t id = 1; id <= count; ++id) kills.emplace_back(id);
+		std::shuffle(kills.begin(), kills.end(), mt);
+		kills.resize(count / 2);
+		std::vector< int > objects(count + 1); //(stand-ins for Scene::Objects)
+
+		double times[2][5];
+		uint64_t checks[2] = {0, 0};
+
+		{ //the containers Game and GameMode used:
+			std::set< uint32_t > living;
+			std::map< uint32_t, int * > object_of;
+			auto before = Clock::now();
+			for (uint32_t id = 1; id <= count; ++id) {
+				living.insert(id);
+				object_of[id] = &objects[id];
+			}
+			times[0][0] = seconds_since(before) / count;
+			before = Clock::now();
+			for (uint32_t id : probes) checks[0] += living.count(id);
+			times[0][1] = seconds_since(before) / Probes;
+			before = Clock::now();
+			for (uint32_t id : probes) {
+				auto f = object_of.find(id);
+				if (f != object_of.end()) checks[0] += uint64_t(*f->second);
+			}
+			times[0][2] = seconds_since(before) / Probes;
+			before = Clock::now();
+			for (uint32_t id : kills) {
+				living.erase(id);
+				object_of.erase(id);
+			}
+			times[0][3] = seconds_since(before) / kills.size();
+			before = Clock::now();
+			for (uint32_t id : living) checks[0] += id + uint64_t(*object_of[id]);
+			times[0][4] = seconds_since(before) / living.size();
+		}
+
+		{ //Entities + EntityArray:
+			Entities living;
+			EntityArray< int * > object_of;
+			auto before = Clock::now();
+			for (uint32_t i = 0; i < count; ++i) {
+				uint32_t id = living.create();
+				object_of[id] = &objects[id];
+			}
+			times[1][0] = seconds_since(before) / count;
+			before = Clock::now();
+			for (uint32_t id : probes) checks[1] += living.alive(id);
+			times[1][1] = seconds_since(before) / Probes;
+			before = Clock::now();
+			for (uint32_t id : probes) {
+				if (living.alive(id)) checks[1] += uint64_t(*object_of[id]);
+			}
+			times[1][2] = seconds_since(before) / Probes;
+			before = Clock::now();
+			for (uint32_t id : kills) {
+				living.destroy(id);
+				object_of[id] = nullptr;
+			}
+			times[1][3] = seconds_since(before) / kills.size();
+			before = Clock::now();
+			living.for_each([&](uint32_t id) { checks[1] += id + uint64_t(*object_of[id]); });
+			times[1][4] = seconds_since(before) / living.size();
+
+			//old ids stay dead when their indices are reused:
+			for (uint32_t id : kills) {
+				if (living.alive(id)) throw std::runtime_error("destroyed id " + std::to_string(id) + " is still alive");
+			}
+			uint32_t reused = living.create();
+			if (Entities::index(reused) != kills[0] || reused == kills[0] || living.alive(kills[0])) {
+				throw std::runtime_error("reused index didn't get a new generation");
+			}
+		}
+		if (checks[0] != checks[1]) throw std::runtime_error("Entities disagrees with std::set");
+
+		for (uint32_t k = 0; k < 2; ++k) {
+			std::cout << "  " << std::setw(6) << count << (k == 0 ? " set/map" : " Entities");
+			if (k == 0) std::cout << " ";
+			for (uint32_t op = 0; op < 5; ++op) {
+				std::cout << std::fixed << std::setprecision(1) << std::setw(16) << times[k][op] * 1e9;
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+//------ herd: stepping a big herd, Herd's arrays vs. one heap node per animal ------
+static void bench_herd() {
+	std::cout << "herd: moving every animal one step (ns per animal), Herd arrays vs. Scene::Transform-like heap nodes" << std::endl;
+	for (uint32_t count : {10000, 100000, 1000000}) {
+		float side = std::sqrt(count / 0.25f);
+		std::mt19937 mt(0x4e4d);
+		std::uniform_real_distribution< float > coord(-0.5f * side, 0.5f * side);
+		std::uniform_real_distribution< float > speed(-0.35f, 0.35f); //(under Herd::MaxSpeed)
+
+		Game game;
+		game.herd = Herd(glm::vec2(-0.5f * side), glm::vec2(0.5f * side));
+		//(roughly what each animal cost before: a node with a name, transform, and hierarchy/allocation links)
+		struct Node {
+			std::string name;
+			uint32_t id = 0;
+			float position[3];
+			float rotation[4];
+			float scale[3];
+			uint32_t direction = 7;
+			Node *parent = nullptr, *last_child = nullptr, *prev_sibling = nullptr, *next_sibling = nullptr;
+			Node **alloc_prev_next = nullptr;
+			Node *alloc_next = nullptr;
+			float velocity[2];
+		};
+		Node *first = nullptr;
+		for (uint32_t i = 0; i < count; ++i) {
+			glm::vec2 at(coord(mt), coord(mt));
+			glm::vec2 velocity(speed(mt), speed(mt));
+			uint32_t id = game.herd.add(Herd::Wolf, at, 0.0f); //(wolves don't wander, so they move like the nodes)
+			game.herd.vx[Entities::index(id)] = velocity.x;
+			game.herd.vy[Entities::index(id)] = velocity.y;
+			game.animals.insert(id, at);
+
+			Node *node = new Node;
+			node->name = "Sheep." + std::to_string(i);
+			node->id = id;
+			node->position[0] = at.x;
+			node->position[1] = at.y;
+			node->position[2] = 0.0f;
+			node->velocity[0] = velocity.x;
+			node->velocity[1] = velocity.y;
+			node->alloc_next = first;
+			first = node;
+		}
+
+		uint32_t const Steps = 20;
+		auto before = Clock::now();
+		for (uint32_t step = 0; step < Steps; ++step) {
+			for (Node *node = first; node != nullptr; node = node->alloc_next) {
+				for (uint32_t a = 0; a < 2; ++a) {
+					float p = node->position[a] + node->velocity[a] * Game::TickDt;
+					if (p < -0.5f * side) { p = -side - p; node->velocity[a] = -node->velocity[a]; }
+					else if (p > 0.5f * side) { p = side - p; node->velocity[a] = -node->velocity[a]; }
+					node->position[a] = p;
+				}
+			}
+		}
+		double node_time = seconds_since(before) / (double(Steps) * count);
+
+		before = Clock::now();
+		for (uint32_t step = 0; step < Steps; ++step) {
+			game.herd.step(Game::TickDt);
+		}
+		double herd_time = seconds_since(before) / (double(Steps) * count);
+
+		before = Clock::now();
+		for (uint32_t step = 0; step < Steps; ++step) {
+			game.step_herd(Game::TickDt);
+		}
+		double game_time = seconds_since(before) / (double(Steps) * count);
+
+		//both ways of stepping agree:
+		for (Node *node = first; node != nullptr; node = node->alloc_next) {
+			glm::vec2 at = game.herd.position(node->id);
+			if (std::abs(at.x - node->position[0]) > 0.5f || std::abs(at.y - node->position[1]) > 0.5f) {
+				//(Herd has taken Steps more steps; each moves less than TickDt units)
+				throw std::runtime_error("herd position of animal " + std::to_string(node->id) + " is far from the node's");
+			}
+		}
+		while (first) {
+			Node *next = first->alloc_next;
+			delete first;
+			first = next;
+		}
+
+		std::cout << "  " << std::setw(7) << count << " animals: nodes " << std::fixed << std::setprecision(2) << std::setw(6) << node_time * 1e9
+			<< " ns, Herd::step " << std::setw(5) << herd_time * 1e9 << " ns, Game::step_herd (with SpatialHash updates) " << std::setw(6) << game_time * 1e9 << " ns"
+			<< " (" << std::setprecision(0) << 1.0 / (herd_time * count) << " herd steps/s)" << std::endl;
+	}
+}
+
+//------ wander: the herd's random walk, scalar vs. SIMD ------
+static void bench_wander() {
+	std::cout << "wander: one Herd::step of a wandering herd (ns per animal), by per-animal math version" << std::endl;
+	std::vector< Herd::Kernel > kernels;
+	for (Herd::Kernel kernel : {Herd::Scalar, Herd::SSE2, Herd::AVX2}) {
+		if (Herd::supported(kernel)) kernels.emplace_back(kernel);
+	}
+	char const *names[] = {"scalar", "SSE2", "AVX2"};
+	for (uint32_t count : {10000, 100000, 1000000}) {
+		float side = std::sqrt(float(count)); //(about one animal per unit square)
+		std::mt19937 mt(0x3a4d);
+		std::uniform_real_distribution< float > coord(-0.5f * side, 0.5f * side);
+		Herd start(glm::vec2(-0.5f * side), glm::vec2(0.5f * side), Game::HerdSeed);
+		for (uint32_t i = 0; i < count; ++i) {
+			start.add(Herd::Sheep, glm::vec2(coord(mt), coord(mt)), 0.0f);
+		}
+		//(a few wolves, and a few dead animals, like in a game)
+		for (uint32_t id = 1; id <= count; id += 997) start.set_species(id, Herd::Wolf);
+		for (uint32_t id = 2; id <= count; id += 101) start.remove(id);
+
+		uint32_t const Steps = 30;
+		std::vector< Herd > herds;
+		std::cout << "  " << std::setw(7) << count << " animals:";
+		for (Herd::Kernel kernel : kernels) {
+			herds.emplace_back(start);
+			Herd &herd = herds.back();
+			herd.kernel = kernel;
+
+			auto before = Clock::now();
+			for (uint32_t step = 0; step < Steps; ++step) {
+				herd.step(Game::TickDt);
+			}
+			double step_time = seconds_since(before) / (double(Steps) * count);
+
+			//just the per-animal math (crowding is left as the last step found it):
+			before = Clock::now();
+			for (uint32_t step = 0; step < Steps; ++step) {
+				size_t done = 0;
+				if (kernel == Herd::AVX2) done = herd.wander_avx2(Game::TickDt, 0, herd.x.size());
+				else if (kernel == Herd::SSE2) done = herd.wander_sse2(Game::TickDt, 0, herd.x.size());
+				herd.wander_scalar(Game::TickDt, done, herd.x.size());
+			}
+			double math_time = seconds_since(before) / (double(Steps) * count);
+
+			std::cout << "  " << names[kernel] << " " << std::fixed << std::setprecision(2) << std::setw(5) << step_time * 1e9
+				<< " ns (math " << std::setw(4) << math_time * 1e9 << " ns)";
+		}
+		std::cout << std::endl;
+
+		//every version gives exactly the same herd (what keeps server and clients in agreement):
+		for (Herd const &herd : herds) {
+			Herd const &a = herds[0];
+			if (herd.x != a.x || herd.y != a.y || herd.vx != a.vx || herd.vy != a.vy || herd.random != a.random) {
+				throw std::runtime_error(std::string("wander: ") + names[herd.kernel] + " herd differs from the " + names[a.kernel] + " one");
+			}
+			for (size_t i = 0; i < herd.x.size(); ++i) {
+				if (!(herd.x[i] >= herd.min.x && herd.x[i] <= herd.max.x && herd.y[i] >= herd.min.y && herd.y[i] <= herd.max.y)) {
+					throw std::runtime_error("wander: animal " + std::to_string(i) + " left the herd's bounds");
+				}
+			}
+		}
+	}
+}
+
+//------ jobs: the herd step spread over 1 .. N threads, and a frame pipeline ------
+static void bench_jobs() {
+	uint32_t cores = std::max(1U, std::thread::hardware_concurrency());
+	std::vector< uint32_t > thread_counts;
+	for (uint32_t t = 1; t <= std::max(4U, cores); t *= 2) thread_counts.emplace_back(t);
+	if (thread_counts.back() != std::max(4U, cores)) thread_counts.emplace_back(std::max(4U, cores));
+	std::cout << "jobs: Herd::step on Jobs (ns per animal; " << cores << " hardware threads"
+		<< (cores < thread_counts.back() ? ", so the larger counts are oversubscribed" : "") << ")" << std::endl;
+
+	auto make_herd = [](uint32_t count) {
+		float side = std::sqrt(float(count));
+		std::mt19937 mt(0x10b5);
+		std::uniform_real_distribution< float > coord(-0.5f * side, 0.5f * side);
+		Herd herd(glm::vec2(-0.5f * side), glm::vec2(0.5f * side), Game::HerdSeed);
+		for (uint32_t i = 0; i < count; ++i) {
+			herd.add(Herd::Sheep, glm::vec2(coord(mt), coord(mt)), 0.0f);
+		}
+		return herd;
+	};
+
+	for (uint32_t count : {100000, 1000000}) {
+		Herd start = make_herd(count);
+		uint32_t const Steps = 20;
+		std::vector< Herd > herds;
+		double one_thread = 0.0;
+		std::cout << "  " << std::setw(7) << count << " animals:";
+		for (uint32_t threads : thread_counts) {
+			Jobs jobs(threads);
+			herds.emplace_back(start);
+			Herd &herd = herds.back();
+			auto before = Clock::now();
+			for (uint32_t step = 0; step < Steps; ++step) {
+				herd.step(Game::TickDt, &jobs);
+			}
+			double time = seconds_since(before) / (double(Steps) * count);
+			if (threads == 1) one_thread = time;
+			std::cout << "  " << threads << (threads == 1 ? " thread " : " threads ") << std::fixed << std::setprecision(2) << time * 1e9
+				<< " ns (x" << std::setprecision(2) << one_thread / time << ")";
+			//(same herd however many threads stepped it)
+			Herd const &a = herds[0];
+			if (herd.x != a.x || herd.y != a.y || herd.vx != a.vx || herd.vy != a.vy || herd.random != a.random) {
+				throw std::runtime_error("jobs: herd stepped on " + std::to_string(threads) + " threads differs from the single-threaded one");
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	//a client-like frame: step the herd, then compute a matrix per animal to draw it with;
+	// pipelined, the next frame's step runs alongside this frame's matrices (drawn from a copy):
+	std::cout << "  frames of 100000 animals (ms per frame): step, then matrices vs. step alongside matrices of a copy" << std::endl;
+	for (uint32_t threads : thread_counts) {
+		Jobs jobs(threads);
+		Herd herd = make_herd(100000);
+		Herd drawn = Herd(glm::vec2(0.0f), glm::vec2(0.0f));
+		std::vector< float > matrices;
+		float const clip[16] = {1.2f, 0.0f, 0.0f, 0.0f, 0.0f, 1.5f, 0.3f, 0.3f, 0.0f, 0.2f, -1.0f, -1.0f, 0.0f, 0.0f, 8.0f, 10.0f};
+		auto build = [&](Herd const &look) {
+			matrices.resize(look.x.size() * 16);
+			jobs.parallel_for(0, look.x.size(), 1024, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					float heading = std::atan2(look.vy[i], look.vx[i]);
+					float c = std::cos(heading), s = std::sin(heading);
+					float local[16] = {c, s, 0.0f, 0.0f, -s, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, look.x[i], look.y[i], 0.0f, 1.0f};
+					float *out = &matrices[i * 16];
+					for (uint32_t col = 0; col < 4; ++col) {
+						for (uint32_t row = 0; row < 4; ++row) {
+							float sum = 0.0f;
+							for (uint32_t k = 0; k < 4; ++k) sum += clip[k * 4 + row] * local[col * 4 + k];
+							out[col * 4 + row] = sum;
+						}
+					}
+				}
+			});
+		};
+		uint32_t const Frames = 30;
+		auto before = Clock::now();
+		for (uint32_t frame = 0; frame < Frames; ++frame) {
+			herd.step(Game::TickDt, &jobs);
+			build(herd);
+		}
+		double serial = seconds_since(before) / Frames;
+
+		before = Clock::now();
+		Jobs::Counter stepped;
+		for (uint32_t frame = 0; frame < Frames; ++frame) {
+			jobs.wait(&stepped);
+			drawn.copy_look(herd);
+			jobs.run([&](){ herd.step(Game::TickDt, &jobs); }, &stepped);
+			build(drawn);
+		}
+		jobs.wait(&stepped);
+		double pipelined = seconds_since(before) / Frames;
+		std::cout << "    " << std::setw(2) << threads << (threads == 1 ? " thread: " : " threads:") << std::fixed << std::setprecision(2)
+			<< " serial " << serial * 1e3 << " ms, pipelined " << pipelined * 1e3 << " ms" << std::endl;
+	}
+}
+
+//------ lockstep: two peers in one process, exchanging only inputs over a laggy link ------
+struct LockstepRun {
+	uint32_t ticks = 0; //ticks run (by each peer)
+	uint64_t bytes = 0; //sent by both peers
+	uint32_t desynced_at = 0; //first desync either peer noticed (0 if none)
+	uint32_t animals_left = 0;
+	double seconds = 0.0;
+};
+//run 'iterations' ticks of input; 'perturb_at': nudge one animal on the wolf's peer then (0 = never):
+static LockstepRun run_lockstep(uint32_t animals, uint32_t iterations, uint32_t perturb_at = 0) {
+	uint32_t const Latency = 3; //ticks for a message to reach the other peer (under Lockstep::Delay, so no stalls)
+	struct Peer {
+		Game game;
+		Lockstep lockstep;
+		std::mt19937 mt;
+		uint8_t held = 0; //movement keys held
+		std::deque< std::pair< uint32_t, Protocol::LockstepInput > > outbox; //(arrival, message)
+		Peer(Lockstep::Player player, uint32_t seed) : lockstep(player), mt(seed) { }
+	};
+	Peer peers[2] = {Peer(Lockstep::Hunter, 0x4a11), Peer(Lockstep::Wolf, 0x301f)};
+	for (Peer &peer : peers) {
+		//both peers start from the same placement (as if loaded from the same scene):
+		Game &game = peer.game;
+		std::mt19937 mt(0x5ce4e);
+		std::uniform_real_distribution< float > x(-0.5f * Game::FrameWidth, 0.5f * Game::FrameWidth);
+		std::uniform_real_distribution< float > y(-0.5f * Game::FrameHeight, 0.5f * Game::FrameHeight);
+		for (uint32_t i = 0; i < animals; ++i) {
+			glm::vec2 at(x(mt), y(mt));
+			uint32_t id = game.herd.add(i + 1 == animals ? Herd::Wolf : Herd::Species(i % 3), at, 0.0f);
+			game.animals.insert(id, at);
+			if (i + 1 == animals) {
+				game.wolf_id = id;
+				game.wolf = at;
+			}
+		}
+	}
+
+	uint32_t attack_every = std::max(200U, iterations / 20); //(so the herd lasts most of the run)
+	LockstepRun run;
+	auto before = Clock::now();
+	for (uint32_t iteration = 1; iteration <= iterations; ++iteration) {
+		for (uint32_t p = 0; p < 2; ++p) {
+			Peer &peer = peers[p];
+			//keys change every half second or so; now and then, an attack:
+			if (peer.mt() % 30 == 0) peer.held = uint8_t(peer.mt() % 16);
+			uint8_t bits = peer.held | (peer.mt() % attack_every == 0 ? Game::Controls::Attack : 0);
+			peer.lockstep.local(bits);
+			Protocol::LockstepInput message;
+			while (peer.lockstep.next_message(&message)) {
+				peer.outbox.emplace_back(iteration + Latency, message);
+				run.bytes += 2 + sizeof(message); //(frame header + payload)
+			}
+		}
+		for (uint32_t p = 0; p < 2; ++p) {
+			Peer &peer = peers[p];
+			while (!peer.outbox.empty() && peer.outbox.front().first <= iteration) {
+				peers[1 - p].lockstep.receive(peer.outbox.front().second);
+				peer.outbox.pop_front();
+			}
+		}
+		for (Peer &peer : peers) {
+			peer.lockstep.advance(&peer.game);
+		}
+		if (iteration == perturb_at) {
+			Herd &herd = peers[Lockstep::Wolf].game.herd;
+			herd.x[1] = std::nextafter(herd.x[1], herd.max.x);
+		}
+	}
+	run.seconds = seconds_since(before);
+
+	run.ticks = std::min(peers[0].lockstep.tick, peers[1].lockstep.tick);
+	for (Peer const &peer : peers) {
+		if (peer.lockstep.desynced_at && (!run.desynced_at || peer.lockstep.desynced_at < run.desynced_at)) {
+			run.desynced_at = peer.lockstep.desynced_at;
+		}
+	}
+	if (!perturb_at && peers[0].lockstep.tick == peers[1].lockstep.tick && peers[0].game.hash() != peers[1].game.hash()) {
+		throw std::runtime_error("lockstep: peers' final states differ, but no desync was noticed");
+	}
+	run.animals_left = uint32_t(peers[0].game.herd.ids.size());
+	return run;
+}
+
+static void bench_lockstep() {
+	std::cout << "lockstep: two peers running Game::tick on exchanged inputs (3-tick link), checking state hashes" << std::endl;
+	for (auto const &test : {std::make_pair(24U, 2000000U), std::make_pair(10000U, 3000U)}) {
+		LockstepRun run = run_lockstep(test.first, test.second);
+		if (run.desynced_at) {
+			throw std::runtime_error("lockstep: peers desynced at tick " + std::to_string(run.desynced_at));
+		}
+		std::cout << "  " << std::setw(5) << test.first << " animals: " << std::setw(7) << run.ticks << " ticks in sync, "
+			<< std::fixed << std::setprecision(2) << run.seconds * 1e6 / run.ticks << " us per tick (both peers), "
+			<< double(run.bytes) / (2.0 * run.ticks) << " bytes per tick per peer, "
+			<< (test.first - run.animals_left) << " animals eaten or shot" << std::endl;
+	}
+	//a one-ulp nudge to one animal on one peer has to be noticed within a few ticks:
+	uint32_t const PerturbAt = 2000;
+	LockstepRun run = run_lockstep(24, 4000, PerturbAt);
+	if (run.desynced_at <= PerturbAt || run.desynced_at > PerturbAt + 2 * Lockstep::SendEvery + 3 + 1) {
+		throw std::runtime_error("lockstep: a desync at tick " + std::to_string(PerturbAt) + " was noticed at tick " + std::to_string(run.desynced_at));
+	}
+	std::cout << "  desync introduced after tick " << PerturbAt << " noticed at tick " << run.desynced_at << std::endl;
+}
+
+//------ replay: a recorded session plays back exactly (and much faster than it was played) ------
+struct Session {
+	uint32_t sent_hash = 2166136261U; //(same as Replay::sent_hash)
+	uint64_t bytes_sent = 0;
+	double seconds = 0.0;
+};
+//a scripted session -- 'count' matches, 'ticks' steps -- sent to 'matches' as clients would (inputs, views, pings, a few players leaving):
+static Session run_session(MatchManager *matches, uint32_t count, uint32_t ticks) {
+	uint32_t const Animals = 24;
+	struct Player {
+		Connection connection; //(the server's end)
+		Connection wire; //messages sent but not yet delivered, in its send_buffer
+		uint32_t sequence = 1; //of the next Input
+	};
+	std::vector< Player > players(2 * count);
+	std::vector< Connection * > sent;
+	std::mt19937 mt(0x2ec0);
+	Session session;
+	auto flush = [&](){
+		for (Connection *c : sent) {
+			for (char b : c->send_buffer) {
+				session.sent_hash = (session.sent_hash ^ uint8_t(b)) * 16777619U;
+			}
+			session.bytes_sent += c->send_buffer.size();
+			c->send_buffer.clear();
+		}
+		sent.clear();
+	};
+
+	auto before = Clock::now();
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		Player &player = players[i];
+		player.connection.socket = Replay::ReplaySocket;
+		player.connection.send_queue = &sent;
+		matches->on_event(&player.connection, Connection::OnOpen);
+		send_message(player.wire, Protocol::Hello());
+		if (i % 2 == 0) { //(hunter)
+			Protocol::AnimalCount message;
+			message.count = Animals;
+			send_message(player.wire, message);
+			for (uint32_t id = 1; id <= Animals + 1; ++id) {
+				Protocol::Placement placement;
+				placement.id = (id <= Animals ? id : 0);
+				placement.kind = (id <= Animals ? (id == Animals ? Protocol::Placement::Wolf : Protocol::Placement::Animal) : Protocol::Placement::Crosshair);
+				placement.position = glm::vec2(float(id % 8) - 3.5f, float(id / 8) - 2.5f);
+				send_message(player.wire, placement);
+			}
+		}
+	}
+	for (uint32_t tick = 1; tick <= ticks; ++tick) {
+		for (auto &player : players) {
+			Connection &c = player.connection;
+			if (!c) continue;
+			if (tick % Prediction::SendEvery == 0) {
+				Protocol::Input input;
+				input.sequence = player.sequence;
+				input.state_ack = 0;
+				input.count = Prediction::SendEvery;
+				for (uint32_t t = 0; t < Protocol::Input::MaxTicks; ++t) {
+					input.controls[t] = uint8_t(mt() & 0xf);
+				}
+				send_message(player.wire, input);
+				player.sequence += Prediction::SendEvery;
+			}
+			if (mt() % 30 == 0) {
+				Protocol::View view;
+				view.min = glm::vec2(-4.0f, -3.0f) + 0.1f * glm::vec2(float(mt() % 10), float(mt() % 10));
+				view.max = view.min + glm::vec2(8.0f, 6.0f);
+				send_message(player.wire, view);
+			}
+			if (tick % Game::TickRate == 0) {
+				Protocol::Ping ping;
+				ping.time = tick;
+				send_message(player.wire, ping);
+			}
+			//deliver what's on the wire, sometimes stopping mid-frame (as TCP might):
+			// (everything on the first tick, so players pair up in order)
+			ByteBuffer &wire = player.wire.send_buffer;
+			if (wire.empty()) continue;
+			size_t deliver = (tick > 1 && mt() % 4 == 0 ? 1 + mt() % wire.size() : wire.size());
+			c.recv_buffer.append(wire.data(), deliver);
+			wire.consume(deliver);
+			matches->on_event(&c, Connection::OnRecv);
+		}
+		//partway through, one player in fifty leaves:
+		if (tick == ticks / 2) {
+			for (uint32_t i = 0; i < players.size(); i += 50) {
+				Connection &c = players[i].connection;
+				if (!c) continue;
+				c.close();
+				matches->on_event(&c, Connection::OnClose);
+			}
+		}
+		matches->step();
+		flush();
+	}
+	session.seconds = seconds_since(before);
+	return session;
+}
+
+static void bench_replay() {
+	std::cout << "replay: a scripted session through MatchManager, recorded, then played back" << std::endl;
+	for (uint32_t count : {100, 1000}) {
+		uint32_t const Ticks = 10 * Game::TickRate;
+
+		Session plain;
+		{
+			MatchManager matches;
+			plain = run_session(&matches, count, Ticks);
+		}
+
+		std::stringstream log;
+		Session recorded;
+		{
+			MatchManager matches;
+			Recorder recorder(log);
+			matches.recorder = &recorder;
+			recorded = run_session(&matches, count, Ticks);
+			recorder.flush();
+		}
+		if (recorded.sent_hash != plain.sent_hash || recorded.bytes_sent != plain.bytes_sent) {
+			throw std::runtime_error("replay: recording changed what the server sent");
+		}
+
+		Replay replay(log);
+		double best = 0.0;
+		uint64_t frames = 0;
+		for (uint32_t run = 0; run < 3; ++run) {
+			replay.rewind();
+			MatchManager matches;
+			auto before = Clock::now();
+			while (replay.step(&matches)) {
+			}
+			double seconds = seconds_since(before);
+			if (replay.sent_hash != plain.sent_hash || replay.bytes_sent != plain.bytes_sent) {
+				throw std::runtime_error("replay: played-back session sent different bytes than the original");
+			}
+			if (run == 0 || seconds < best) best = seconds;
+			frames = matches.dispatched;
+		}
+
+		double recording_bytes = double(log.str().size());
+		std::cout << "  " << std::setw(4) << count << " matches, " << Ticks / Game::TickRate << " s: "
+			<< std::fixed << std::setprecision(1) << recording_bytes / 1024.0 << " KiB recorded ("
+			<< recording_bytes / 1024.0 / (Ticks / double(Game::TickRate) * count) << " KiB per match-second); "
+			<< "live " << std::setprecision(3) << plain.seconds << " s, recording " << recorded.seconds << " s, "
+			<< "replay " << best << " s (" << std::setprecision(0) << frames / best << " frames/s); identical output" << std::endl;
+	}
+
+	//a hunter can't make the server allocate (and step) more than AnimalCount::MaxCount animals:
+	for (uint32_t count : {Protocol::AnimalCount::MaxCount + 1, Entities::IndexMask, Protocol::AnimalCount::MaxCount}) {
+		MatchManager matches;
+		Connection hunter, wire;
+		hunter.socket = Replay::ReplaySocket;
+		matches.on_event(&hunter, Connection::OnOpen);
+		send_message(wire, Protocol::Hello());
+		Protocol::AnimalCount message;
+		message.count = count;
+		send_message(wire, message);
+		hunter.recv_buffer.append(wire.send_buffer.data(), wire.send_buffer.size());
+		matches.on_event(&hunter, Connection::OnRecv);
+		Match *match = matches.match_for(&hunter);
+		uint32_t got = (match ? uint32_t(match->state.herd.ids.size()) : 0);
+		uint32_t want = (count <= Protocol::AnimalCount::MaxCount ? count : 0);
+		if (!match || got != want) {
+			throw std::runtime_error("replay: an AnimalCount of " + std::to_string(count) + " made " + std::to_string(got) + " animals");
+		}
+		std::cout << "  AnimalCount of " << std::setw(8) << count << ": " << (got ? "accepted" : "refused") << " (MaxCount is " << Protocol::AnimalCount::MaxCount << ")" << std::endl;
+	}
+}
+
+//------ transforms: per-frame cost of world matrices in a deep Scene hierarchy ------
+//what make_local_to_world() did before matrices were cached -- the whole chain, every call:
+static glm::mat4 uncached_local_to_world(Scene::Transform const *t) {
+	if (t->parent) return uncached_local_to_world(t->parent) * t->make_local_to_parent();
+	else return t->make_local_to_parent();
+}
+
+static void bench_transforms() {
+	uint32_t const Levels = 8;
+	uint32_t const Branching = 5; //(1 + 5 + ... + 5^7 = 97656 transforms)
+	std::cout << "transforms: world matrices of every transform (as Scene::draw needs them), " << Levels << "-level hierarchy" << std::endl;
+
+	Scene scene;
+	std::vector< std::vector< Scene::Transform * > > levels(Levels);
+	std::mt19937 mt(0x7f0);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	for (uint32_t level = 0; level < Levels; ++level) {
+		uint32_t count = (level == 0 ? 1 : uint32_t(levels[level - 1].size()) * Branching);
+		for (uint32_t i = 0; i < count; ++i) {
+			Scene::Transform *t = scene.new_transform();
+			if (level > 0) t->set_parent(levels[level - 1][i / Branching]);
+			t->set_position(glm::vec3(unit(mt), unit(mt), unit(mt)));
+			t->set_rotation(glm::normalize(glm::quat(1.0f, 0.1f * unit(mt), 0.1f * unit(mt), 0.1f * unit(mt))));
+			t->set_scale(glm::vec3(1.0f + 0.01f * unit(mt)));
+			levels[level].emplace_back(t);
+		}
+	}
+	std::vector< Scene::Transform * > all;
+	for (auto const &level : levels) {
+		all.insert(all.end(), level.begin(), level.end());
+	}
+	std::vector< Scene::Transform * > const &leaves = levels.back();
+
+	//run 'frame' for about half a second, returning seconds per frame:
+	float checksum = 0.0f; //(so the matrices aren't optimized away)
+	auto time_frames = [&](std::function< void() > const &frame) {
+		uint32_t frames = 0;
+		auto before = Clock::now();
+		double elapsed = 0.0;
+		while (elapsed < 0.5) {
+			frame();
+			frames += 1;
+			elapsed = seconds_since(before);
+		}
+		return elapsed / frames;
+	};
+	auto report = [&](char const *name, double seconds) {
+		std::cout << "  " << std::setw(28) << std::left << name << std::right << std::fixed
+			<< std::setprecision(3) << seconds * 1e3 << " ms per frame ("
+			<< std::setprecision(1) << seconds * 1e9 / all.size() << " ns per transform)" << std::endl;
+	};
+
+	report("uncached (whole chain):", time_frames([&](){
+		for (Scene::Transform const *t : all) {
+			checksum += uncached_local_to_world(t)[3][0];
+		}
+	}));
+	report("cached, nothing moves:", time_frames([&](){
+		for (Scene::Transform const *t : all) {
+			checksum += t->make_local_to_world()[3][0];
+		}
+	}));
+	uint32_t step = 0;
+	report("cached, 1% of leaves move:", time_frames([&](){
+		for (uint32_t i = 0; i < leaves.size() / 100; ++i) {
+			Scene::Transform *t = leaves[(step * 7919 + i * 101) % leaves.size()];
+			t->set_position(t->position + glm::vec3(0.001f, 0.0f, 0.0f));
+		}
+		step += 1;
+		for (Scene::Transform const *t : all) {
+			checksum += t->make_local_to_world()[3][0];
+		}
+	}));
+	report("cached, one subtree moves:", time_frames([&](){ //(a level-1 transform: a fifth of the scene)
+		Scene::Transform *t = levels[1][step % Branching];
+		t->set_rotation(glm::normalize(t->rotation * glm::quat(1.0f, 0.0f, 0.0f, 0.001f)));
+		step += 1;
+		for (Scene::Transform const *t : all) {
+			checksum += t->make_local_to_world()[3][0];
+		}
+	}));
+	report("cached, root moves:", time_frames([&](){
+		Scene::Transform *root = levels[0][0];
+		root->set_position(root->position + glm::vec3(0.0f, 0.001f, 0.0f));
+		for (Scene::Transform const *t : all) {
+			checksum += t->make_local_to_world()[3][0];
+		}
+	}));
+
+	//cached matrices have to be exactly what recomputing them gives (same operations, same order):
+	for (Scene::Transform const *t : all) {
+		if (t->make_local_to_world() != uncached_local_to_world(t)) {
+			throw std::runtime_error("transforms: cached local_to_world differs from the recomputed one");
+		}
+	}
+	//...including after reparenting:
+	Scene::Transform *moved = levels[2][0];
+	moved->set_parent(levels[1][Branching - 1]);
+	for (Scene::Transform const *t : all) {
+		if (t->make_local_to_world() != uncached_local_to_world(t)) {
+			throw std::runtime_error("transforms: cached local_to_world is stale after set_parent");
+		}
+	}
+	if (checksum == 1.0f) std::cout << "  (checksum " << checksum << ")" << std::endl;
+}
+
+//------ hierarchy: full update of a flat, depth-sorted Hierarchy vs. Scene::Transform pointers ------
+static void bench_hierarchy() {
+	uint32_t const Levels = 8;
+	Jobs jobs;
+	std::cout << "hierarchy: every world matrix recomputed (all roots move), " << Levels << " levels, parents picked at random from the level above" << std::endl;
+
+	for (uint32_t count : {10000, 100000, 1000000}) {
+		//the same random hierarchy both ways:
+		// (transforms are allocated in level order, which is kind to the pointer version)
+		Scene scene;
+		Hierarchy hierarchy;
+		std::vector< Scene::Transform * > transforms;
+		std::vector< Hierarchy::Handle > nodes;
+		std::mt19937 mt(0x41e2);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		uint32_t const per_level = count / Levels;
+		for (uint32_t i = 0; i < per_level * Levels; ++i) {
+			uint32_t level = i / per_level;
+			uint32_t parent = (level == 0 ? -1U : (level - 1) * per_level + uint32_t(mt() % per_level));
+			glm::vec3 position(unit(mt), unit(mt), unit(mt));
+			glm::quat rotation = glm::normalize(glm::quat(1.0f, 0.1f * unit(mt), 0.1f * unit(mt), 0.1f * unit(mt)));
+			glm::vec3 scale(1.0f + 0.01f * unit(mt));
+
+			Scene::Transform *t = scene.new_transform();
+			if (parent != -1U) t->set_parent(transforms[parent]);
+			t->set_position(position);
+			t->set_rotation(rotation);
+			t->set_scale(scale);
+			transforms.emplace_back(t);
+
+			Hierarchy::Handle node = hierarchy.add(parent == -1U ? 0 : nodes[parent]);
+			hierarchy.set_position(node, position);
+			hierarchy.set_rotation(node, rotation);
+			hierarchy.set_scale(node, scale);
+			nodes.emplace_back(node);
+		}
+		std::vector< glm::vec3 > roots; //(where the roots start)
+		for (uint32_t i = 0; i < per_level; ++i) {
+			roots.emplace_back(transforms[i]->position);
+		}
+		auto before = Clock::now();
+		hierarchy.update();
+		double first = seconds_since(before);
+
+		//move every root, then recompute; seconds per frame:
+		uint32_t step = 0;
+		auto time_frames = [&](std::function< void() > const &frame) {
+			uint32_t frames = 0;
+			auto before = Clock::now();
+			double elapsed = 0.0;
+			while (elapsed < 0.5 || frames < 3) {
+				frame();
+				step += 1;
+				frames += 1;
+				elapsed = seconds_since(before);
+			}
+			return elapsed / frames;
+		};
+		float checksum = 0.0f;
+		double pointers = time_frames([&](){
+			glm::vec3 nudge(0.0f, 0.0f, 0.001f * float(step % 8));
+			for (uint32_t i = 0; i < per_level; ++i) {
+				transforms[i]->set_position(roots[i] + nudge);
+			}
+			for (Scene::Transform const *t : transforms) {
+				checksum += t->make_local_to_world()[3][0];
+			}
+		});
+		double flat[3];
+		for (uint32_t way = 0; way < 3; ++way) {
+			hierarchy.kernel = (way == 0 ? Hierarchy::Scalar : Hierarchy::fastest_kernel());
+			flat[way] = time_frames([&](){
+				glm::vec3 nudge(0.0f, 0.0f, 0.001f * float(step % 8));
+				for (uint32_t i = 0; i < per_level; ++i) {
+					hierarchy.set_position(nodes[i], roots[i] + nudge);
+				}
+				hierarchy.update(way == 2 ? &jobs : nullptr);
+			});
+		}
+		checksum += hierarchy.local_to_world(nodes.back())[3][0];
+
+		size_t total = transforms.size();
+		std::cout << "  " << std::setw(7) << total << " nodes (first sort+update " << std::fixed << std::setprecision(1) << first * 1e3 << " ms), ns per node:"
+			<< " pointers " << std::setprecision(1) << pointers * 1e9 / total
+			<< ", flat scalar " << flat[0] * 1e9 / total << " (x" << std::setprecision(2) << pointers / flat[0] << ")"
+			<< ", flat " << (Hierarchy::fastest_kernel() == Hierarchy::SSE2 ? "SSE2 " : "scalar ") << std::setprecision(1) << flat[1] * 1e9 / total << " (x" << std::setprecision(2) << pointers / flat[1] << ")"
+			<< ", on " << jobs.threads() << (jobs.threads() == 1 ? " thread " : " threads ") << std::setprecision(1) << flat[2] * 1e9 / total << " (x" << std::setprecision(2) << pointers / flat[2] << ")"
+			<< std::endl;
+
+		//both kernels have to give exactly what Scene::Transform does:
+		auto check = [&](char const *when) {
+			for (Hierarchy::Kernel kernel : {Hierarchy::Scalar, Hierarchy::fastest_kernel()}) {
+				hierarchy.kernel = kernel;
+				for (uint32_t i = 0; i < per_level; ++i) {
+					transforms[i]->set_position(roots[i]);
+					hierarchy.set_position(nodes[i], roots[i]); //(so everything is recomputed)
+				}
+				hierarchy.update();
+				for (size_t i = 0; i < total; ++i) {
+					if (!hierarchy.alive(nodes[i])) continue;
+					if (hierarchy.local_to_world(nodes[i]) != transforms[i]->make_local_to_world()) {
+						throw std::runtime_error(std::string("hierarchy: world matrix differs from Scene::Transform's ") + when);
+					}
+				}
+			}
+		};
+		check("after moving roots");
+		//...and after the structure changes (a subtree moves; a node goes, leaving its children as roots):
+		uint32_t moved = per_level * 2 + 5, under = per_level + 7, removed = per_level * 3 + 11;
+		transforms[moved]->set_parent(transforms[under]);
+		if (!hierarchy.set_parent(nodes[moved], nodes[under])) throw std::runtime_error("hierarchy: set_parent refused a valid move");
+		//(moves that would make cycles are refused, and change nothing)
+		if (hierarchy.set_parent(nodes[under], nodes[moved]) || hierarchy.set_parent(nodes[moved], nodes[moved])) {
+			throw std::runtime_error("hierarchy: set_parent allowed a cycle");
+		}
+		while (transforms[removed]->last_child) {
+			transforms[removed]->last_child->set_parent(nullptr);
+		}
+		hierarchy.remove(nodes[removed]);
+		check("after set_parent and remove");
+		if (checksum == 1.0f) std::cout << "  (checksum " << checksum << ")" << std::endl;
+	}
+}
+
+//------ pool: Scene object churn (an object and its transform made and deleted per kill) ------
+static void bench_pool() {
+	uint32_t const Live = 10000; //objects in the scene at once
+	uint32_t const Groups = 100; //(each object's transform hangs under one of these)
+	uint32_t const Churn = 2000000;
+	std::cout << "pool: " << Churn << " times, delete a random one of " << Live << " objects (and its transform) and make a new one" << std::endl;
+
+	//'make(i)' creates object i (in a fresh transform), 'remove(i)' deletes it; returns seconds per delete+create:
+	std::mt19937 mt(0x9001);
+	auto churn = [&](std::function< void(uint32_t) > const &make, std::function< void(uint32_t) > const &remove) {
+		for (uint32_t i = 0; i < Live; ++i) {
+			make(i);
+		}
+		auto before = Clock::now();
+		for (uint32_t n = 0; n < Churn; ++n) {
+			uint32_t i = mt() % Live;
+			remove(i);
+			make(i);
+		}
+		return seconds_since(before) / Churn;
+	};
+
+	double pooled = 0.0;
+	{
+		Scene scene;
+		std::vector< Scene::Transform * > groups;
+		for (uint32_t g = 0; g < Groups; ++g) {
+			groups.emplace_back(scene.new_transform());
+		}
+		std::vector< Scene::Object * > objects(Live, nullptr);
+		size_t warm_bytes = 0;
+		pooled = churn([&](uint32_t i) {
+			Scene::Transform *t = scene.new_transform();
+			t->set_parent(groups[i % Groups]);
+			objects[i] = scene.new_object(t);
+			if (warm_bytes == 0 && i + 1 == Live) {
+				warm_bytes = scene.transform_pool.bytes() + scene.object_pool.bytes();
+			}
+		}, [&](uint32_t i) {
+			Scene::Transform *t = objects[i]->transform;
+			scene.delete_object(objects[i]);
+			scene.delete_transform(t);
+		});
+		size_t bytes = scene.transform_pool.bytes() + scene.object_pool.bytes();
+		std::cout << "  pooled: " << std::fixed << std::setprecision(1) << pooled * 1e9 << " ns per delete+create; "
+			<< scene.object_pool.allocations << " objects and " << scene.transform_pool.allocations << " transforms allocated, "
+			<< scene.object_pool.live() << " and " << scene.transform_pool.live() << " live, in "
+			<< bytes / 1024 << " KiB of slabs (" << warm_bytes / 1024 << " KiB before the churn)" << std::endl;
+		if (bytes != warm_bytes) {
+			throw std::runtime_error("pool: slab memory grew under churn; freed slots aren't being reused");
+		}
+		if (scene.object_pool.live() != Live || scene.transform_pool.live() != Live + Groups) {
+			throw std::runtime_error("pool: live counts don't match the scene");
+		}
+	}
+
+	//the same churn with a 'new' and 'delete' per scene thing, for comparison:
+	{
+		std::vector< std::unique_ptr< Scene::Transform > > groups;
+		for (uint32_t g = 0; g < Groups; ++g) {
+			groups.emplace_back(new Scene::Transform);
+		}
+		std::vector< Scene::Object * > objects(Live, nullptr);
+		double plain = churn([&](uint32_t i) {
+			Scene::Transform *t = new Scene::Transform;
+			t->set_parent(groups[i % Groups].get());
+			objects[i] = new Scene::Object(t);
+		}, [&](uint32_t i) {
+			Scene::Transform *t = objects[i]->transform;
+			delete objects[i];
+			delete t;
+		});
+		for (Scene::Object *object : objects) {
+			delete object->transform;
+			delete object;
+		}
+		std::cout << "  new/delete: " << std::fixed << std::setprecision(1) << plain * 1e9 << " ns per delete+create (pooled is x"
+			<< std::setprecision(2) << plain / pooled << ")" << std::endl;
+	}
+}
+
+//------ queue: sorting scene objects into draw commands (recorded, so no GPU needed) ------
+static void bench_queue() {
+	uint32_t const Programs = 4, Vaos = 16, Materials = 8;
+	std::cout << "queue: Scene objects (" << Programs << " programs, " << Vaos << " vertex arrays, " << Materials << " materials, in random order) into draw commands" << std::endl;
+	for (uint32_t count : {1000, 10000, 100000}) {
+		Scene scene;
+		std::mt19937 mt(0x5e7);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		for (uint32_t i = 0; i < count; ++i) {
+			Scene::Transform *t = scene.new_transform();
+			t->set_position(glm::vec3(50.0f * unit(mt), 50.0f * unit(mt), unit(mt)));
+			Scene::Object *object = scene.new_object(t);
+			//(made-up GL names; nothing is sent to GL)
+			object->program = 1 + mt() % Programs;
+			object->program_mvp_mat4 = 0;
+			object->program_mv_mat4x3 = (object->program % 2 ? 1 : -1U);
+			object->program_itmv_mat3 = (object->program % 2 ? 2 : -1U);
+			object->vao = 1 + mt() % Vaos;
+			object->start = 3 * (mt() % 100);
+			object->count = 36;
+			object->material = mt() % Materials; //(0: set_uniforms every time)
+			if (object->material != 0 || mt() % 4 == 0) object->set_uniforms = [](){ };
+		}
+		Scene::Transform *eye = scene.new_transform();
+		eye->set_position(glm::vec3(0.0f, -60.0f, 40.0f));
+		eye->set_rotation(glm::angleAxis(glm::radians(50.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+		Scene::Camera *camera = scene.new_camera(eye);
+
+		RenderQueue queue;
+		uint32_t frames = 0;
+		auto before = Clock::now();
+		double elapsed = 0.0;
+		while (elapsed < 0.5 || frames < 3) {
+			scene.gather(camera, &queue);
+			frames += 1;
+			elapsed = seconds_since(before);
+		}
+
+		//what Scene::draw used to send: a program bind, uniforms, set_uniforms, a vertex array bind, and a draw per object:
+		uint32_t naive = 0;
+		for (Scene::Object *object = scene.first_object; object != nullptr; object = object->alloc_next) {
+			naive += 3 + (object->program_mvp_mat4 != -1U) + (object->program_mv_mat4x3 != -1U) + (object->program_itmv_mat3 != -1U) + (object->set_uniforms ? 1 : 0);
+		}
+		RenderQueue::Counters const &c = queue.counters;
+		std::cout << "  " << std::setw(6) << count << " objects: " << std::fixed << std::setprecision(3) << elapsed / frames * 1e3 << " ms per frame; "
+			<< c.draw_calls << " draws, " << c.program_binds << " program binds, " << c.vao_binds << " vertex array binds, "
+			<< c.material_changes << " set_uniforms, " << c.uniform_uploads << " uniform uploads; "
+			<< queue.commands.size() << " commands (was " << naive << ")" << std::endl;
+
+		//play the commands against a pretend GL, checking each draw sees exactly its object's state:
+		GLuint program = 0, vao = 0;
+		std::map< GLuint, std::map< GLuint, std::vector< float > > > uniforms; //program -> location -> value
+		std::map< GLuint, Scene::Object const * > material_set; //program -> object whose set_uniforms ran last
+		std::set< Scene::Object const * > drawn;
+		for (RenderQueue::Command const &command : queue.commands) {
+			if (command.op == RenderQueue::Command::UseProgram) {
+				program = command.name;
+				material_set.erase(program); //(a program bind counts as losing the material, as build() assumes)
+			} else if (command.op == RenderQueue::Command::BindVertexArray) {
+				vao = command.name;
+			} else if (command.op == RenderQueue::Command::SetUniforms) {
+				material_set[program] = command.object;
+			} else if (command.op == RenderQueue::Command::DrawArrays) {
+				Scene::Object const &object = *command.object;
+				if (program != object.program || vao != object.vao || command.first != object.start || command.count != object.count) {
+					throw std::runtime_error("queue: draw with the wrong program or vertex array bound");
+				}
+				if (object.set_uniforms) {
+					auto f = material_set.find(program);
+					if (f == material_set.end() || (object.material == 0 ? f->second != &object : f->second->material != object.material)) {
+						throw std::runtime_error("queue: draw without its material set");
+					}
+				}
+				glm::mat4 const &local_to_world = object.transform->make_local_to_world();
+				glm::mat4 mvp = camera->make_projection() * eye->make_world_to_local() * local_to_world;
+				std::vector< float > const &value = uniforms[program][object.program_mvp_mat4];
+				if (value.size() != 16 || std::memcmp(value.data(), &mvp[0][0], sizeof(mvp)) != 0) {
+					throw std::runtime_error("queue: draw with another object's matrix");
+				}
+				if (!drawn.insert(&object).second) throw std::runtime_error("queue: object drawn twice");
+			} else {
+				uint32_t floats = (command.op == RenderQueue::Command::UniformMatrix4 ? 16 : command.op == RenderQueue::Command::UniformMatrix4x3 ? 12 : 9);
+				std::vector< float > &value = uniforms[program][command.name];
+				value.assign(queue.data.begin() + command.offset, queue.data.begin() + command.offset + floats);
+			}
+		}
+		if (drawn.size() != count) throw std::runtime_error("queue: not every object was drawn");
+	}
+}
+
+//------ instancing: commands to draw a big herd, one draw per animal vs. one instanced draw per species ------
+static void bench_instancing() {
+	uint32_t const Animals = 100000;
+	std::cout << "instancing: " << Animals << " animals (4 species), commands to draw them (matrices and all, as Scene::draw sends)" << std::endl;
+
+	float side = std::sqrt(float(Animals));
+	Herd herd(glm::vec2(-0.5f * side), glm::vec2(0.5f * side), Game::HerdSeed);
+	std::mt19937 mt(0x1457);
+	std::uniform_real_distribution< float > coord(-0.5f * side, 0.5f * side);
+	Herd::Species const species[4] = {Herd::Cow, Herd::Pig, Herd::Sheep, Herd::Wolf};
+	for (uint32_t i = 0; i < Animals; ++i) {
+		herd.add(species[mt() % 4], glm::vec2(coord(mt), coord(mt)), float(mt() % 628) * 0.01f);
+	}
+	for (uint32_t step = 0; step < 3; ++step) {
+		herd.step(Game::TickDt); //(so wandering animals face the way they walk)
+	}
+	for (Herd::Species s : species) {
+		if (herd.skins.size() <= s) herd.skins.resize(s + 1);
+		herd.skins[s].start = 1000 * s;
+		herd.skins[s].count = 900;
+	}
+
+	Scene scene;
+	Scene::Transform *eye = scene.new_transform();
+	eye->set_position(glm::vec3(0.0f, -0.6f * side, 0.4f * side));
+	eye->set_rotation(glm::angleAxis(glm::radians(50.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+	Scene::Camera *camera = scene.new_camera(eye);
+
+	//(made-up GL names; nothing is sent to GL)
+	Scene::HerdLook one_by_one;
+	one_by_one.program = 1;
+	one_by_one.program_mvp_mat4 = 0;
+	one_by_one.program_mv_mat4x3 = 1;
+	one_by_one.program_itmv_mat3 = 2;
+	one_by_one.vao = 1;
+	Scene::HerdLook instanced = one_by_one;
+	instanced.instanced_program = 2;
+	instanced.instanced_program_world_to_clip_mat4 = 0;
+	instanced.instanced_program_instance_to_world_mat4x3 = 3;
+	instanced.instanced_vao = 2;
+	instanced.instance_buffer = 1;
+
+	Jobs jobs;
+	RenderQueue queues[2];
+	for (uint32_t way = 0; way < 2; ++way) {
+		Scene::HerdLook const &look = (way == 0 ? one_by_one : instanced);
+		RenderQueue &queue = queues[way];
+		for (Jobs *on : {(Jobs *)nullptr, &jobs}) {
+			uint32_t frames = 0;
+			auto before = Clock::now();
+			double elapsed = 0.0;
+			while (elapsed < 0.5 || frames < 3) {
+				scene.gather(camera, herd, look, &queue, on);
+				frames += 1;
+				elapsed = seconds_since(before);
+			}
+			std::cout << "  " << std::setw(12) << std::left << (way == 0 ? "per animal:" : "instanced:") << std::right
+				<< std::fixed << std::setprecision(2) << elapsed / frames * 1e3 << " ms per frame "
+				<< (on ? "on Jobs (" + std::to_string(jobs.threads()) + (jobs.threads() == 1 ? " thread); " : " threads); ") : std::string("inline; "))
+				<< queue.counters.draw_calls << " draw calls, " << queue.counters.uniform_uploads << " uniform uploads, "
+				<< queue.commands.size() << " commands, " << std::setprecision(0) << queue.data.size() * sizeof(float) / 1024.0 << " KiB of matrices" << std::endl;
+		}
+	}
+
+	//both ways must draw each species with the same matrices (instanced: each species' animals in the order drawn one by one):
+	std::map< GLuint, std::vector< float > > expected; //skin start -> mat4x3s
+	RenderQueue const &by_one = queues[0];
+	uint32_t mv = -1U;
+	for (RenderQueue::Command const &command : by_one.commands) {
+		if (command.op == RenderQueue::Command::UniformMatrix4x3) mv = command.offset;
+		if (command.op == RenderQueue::Command::DrawArrays) {
+			std::vector< float > &to = expected[command.first];
+			to.insert(to.end(), by_one.data.begin() + mv, by_one.data.begin() + mv + 12);
+		}
+	}
+	RenderQueue const &by_instance = queues[1];
+	uint32_t instances = 0, upload = -1U;
+	for (RenderQueue::Command const &command : by_instance.commands) {
+		if (command.op == RenderQueue::Command::UploadInstances) upload = command.offset;
+		if (command.op != RenderQueue::Command::DrawInstanced) continue;
+		std::vector< float > const &want = expected[command.first];
+		if (upload == -1U || want.size() != command.instances * 12
+		 || !std::equal(want.begin(), want.end(), by_instance.data.begin() + upload + command.offset * 12)) {
+			throw std::runtime_error("instancing: instance matrices differ from the per-animal ones");
+		}
+		instances += command.instances;
+	}
+	if (instances != by_one.counters.draw_calls || instances != Animals) {
+		throw std::runtime_error("instancing: not every animal was drawn");
+	}
+}
+
+//------ poll: Server::poll with many idle connections and a few busy ones, select vs. epoll ------
+#ifndef _WIN32
+//a listen socket on a free loopback port (made here rather than by Server, so that
+// thousands of connections can queue up without waiting on Server's accept loop):
+static SOCKET listen_loopback(uint16_t *port) {
+	SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) throw std::system_error(errno, std::system_category(), "failed to create socket");
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0; //(any free port)
+	socklen_t size = sizeof(address);
+	struct timeval timeout;
+	timeout.tv_sec = 10; //(so accept() gives up rather than hanging if connections never arrive)
+	timeout.tv_usec = 0;
+	if (bind(s, reinterpret_cast< sockaddr * >(&address), size) != 0
+	 || listen(s, SOMAXCONN) != 0
+	 || getsockname(s, reinterpret_cast< sockaddr * >(&address), &size) != 0
+	 || setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+		int error = errno;
+		closesocket(s);
+		throw std::system_error(error, std::system_category(), "failed to listen on loopback");
+	}
+	*port = ntohs(address.sin_port);
+	return s;
+}
+
+//a (blocking, TCP_NODELAY) connection to a loopback port, or INVALID_SOCKET:
+static SOCKET connect_loopback(uint16_t port) {
+	SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) return INVALID_SOCKET;
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	int one = 1;
+	if (connect(s, reinterpret_cast< sockaddr * >(&address), sizeof(address)) != 0
+	 || setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+	return s;
+}
+
+static SOCKET accept_loopback(SOCKET listener) {
+	SOCKET got = accept(listener, NULL, NULL);
+	if (got == INVALID_SOCKET) throw std::system_error(errno, std::system_category(), "failed to accept loopback connection");
+	return got;
+}
+
+//'count' connections to 'port', held open (and silent) by a child process until this goes away:
+// (so this process only spends one descriptor per connection -- the server's end)
+struct IdlePeers {
+	IdlePeers(uint16_t port, uint32_t count) {
+		int fds[2];
+		if (pipe(fds) != 0) throw std::system_error(errno, std::system_category(), "failed to create pipe");
+		child = fork();
+		if (child < 0) {
+			int error = errno;
+			::close(fds[0]);
+			::close(fds[1]);
+			throw std::system_error(error, std::system_category(), "failed to fork");
+		}
+		if (child == 0) {
+			::close(fds[1]);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (connect_loopback(port) == INVALID_SOCKET) _exit(1);
+			}
+			//wait for the parent to close its end of the pipe (or to exit):
+			char c;
+			while (read(fds[0], &c, 1) > 0) { }
+			_exit(0);
+		}
+		::close(fds[0]);
+		release = fds[1];
+	}
+	IdlePeers(IdlePeers const &) = delete;
+	~IdlePeers() {
+		::close(release);
+		waitpid(child, nullptr, 0);
+	}
+	pid_t child = -1;
+	int release = -1; //(write end of the pipe the child waits on)
+};
+
+//a Server with 'idle' silent loopback connections and 'busy' ones whose other ends are kept here:
+struct PollRig {
+	PollRig(Server::Backend backend, uint32_t idle, uint32_t busy) : server(backend) {
+		uint16_t port;
+		listener = listen_loopback(&port);
+		if (idle) peers.reset(new IdlePeers(port, idle));
+		for (uint32_t i = 0; i < idle + busy; ++i) {
+			if (i >= idle) {
+				busy_ends.emplace_back(connect_loopback(port));
+				if (busy_ends.back() == INVALID_SOCKET) throw std::runtime_error("poll: failed to open a busy connection");
+			}
+			SOCKET got = accept_loopback(listener);
+			if (backend == Server::Select && got >= FD_SETSIZE) {
+				closesocket(got);
+				throw std::runtime_error("poll: descriptor past FD_SETSIZE given to select()");
+			}
+			if (!server.adopt(got)) throw std::runtime_error("poll: Server::adopt failed");
+		}
+	}
+	PollRig(PollRig const &) = delete;
+	~PollRig() {
+		for (auto &c : server.connections) {
+			c.close();
+		}
+		for (SOCKET s : busy_ends) {
+			closesocket(s);
+		}
+		closesocket(listener);
+	}
+
+	Server server;
+	SOCKET listener = INVALID_SOCKET;
+	std::unique_ptr< IdlePeers > peers;
+	std::vector< SOCKET > busy_ends;
+};
+#endif
+
+static void bench_poll() {
+	#ifdef _WIN32
+	std::cout << "poll: skipped (its idle connections are held open by a fork()ed process)" << std::endl;
+	#else
+	uint32_t const Busy = 4;
+	uint32_t const MessageBytes = 32;
+	std::cout << "poll: Server::poll (not waiting) with idle loopback connections and " << Busy << " busy ones, each sent " << MessageBytes << " bytes before every poll"
+		<< " (steady-state polls must not allocate)" << std::endl;
+	std::vector< Server::Backend > backends{Server::Select};
+	#ifdef __linux__
+	backends.emplace_back(Server::Epoll);
+	#endif
+
+	std::function< void(Connection *, Connection::Event) > ignore = [](Connection *, Connection::Event){ };
+
+	//polling idle connections must not allocate (nor, per Server::stats, copy anything):
+	for (Server::Backend backend : backends) {
+		uint32_t const Idle = 100;
+		uint32_t const Polls = 1000;
+		PollRig rig(backend, Idle, 0);
+		rig.server.poll(ignore, 0.0); //(first poll on this thread sets up its recv buffer)
+		PollStats before = rig.server.stats;
+		uint64_t allocations = heap_allocations.load();
+		for (uint32_t i = 0; i < Polls; ++i) {
+			rig.server.poll(ignore, 0.0);
+		}
+		allocations = heap_allocations.load() - allocations;
+		PollStats const &after = rig.server.stats;
+		if (allocations != 0 || after.allocations != before.allocations || after.bytes_copied != before.bytes_copied) {
+			throw std::runtime_error(std::string("poll: ") + (backend == Server::Epoll ? "epoll" : "select") + " backend allocated while polling idle connections ("
+				+ std::to_string(allocations) + " heap allocations; PollStats says " + std::to_string(after.allocations - before.allocations) + " allocations, "
+				+ std::to_string(after.bytes_copied - before.bytes_copied) + " bytes copied)");
+		}
+		if (after.polls != before.polls + Polls) throw std::runtime_error("poll: PollStats::polls miscounted");
+		std::cout << "  " << std::setw(5) << Idle << " idle, " << std::setw(7) << std::left << (backend == Server::Epoll ? "epoll:" : "select:") << std::right
+			<< " no heap allocations in " << Polls << " polls" << std::endl;
+	}
+
+	for (uint32_t idle : {1000, 10000}) {
+		for (Server::Backend backend : backends) {
+			std::cout << "  " << std::setw(5) << idle << " idle, " << std::setw(7) << std::left << (backend == Server::Epoll ? "epoll:" : "select:") << std::right << " ";
+			std::cout.flush();
+			//(leaving room for stdio, the listen socket, the busy connections' other ends, ...)
+			if (backend == Server::Select && idle + 2 * Busy + 16 > FD_SETSIZE) {
+				std::cout << "n/a (select() can't watch descriptors past FD_SETSIZE = " << FD_SETSIZE << ")" << std::endl;
+				continue;
+			}
+			PollRig rig(backend, idle, Busy);
+
+			uint64_t sent = 0, received = 0;
+			bool closed = false;
+			std::function< void(Connection *, Connection::Event) > on_event = [&](Connection *c, Connection::Event evt){
+				if (evt == Connection::OnRecv) {
+					received += c->recv_buffer.size();
+					c->recv_buffer.clear();
+				} else if (evt == Connection::OnClose) {
+					closed = true;
+				}
+			};
+
+			char message[MessageBytes] = {};
+			auto send_busy = [&](){
+				for (SOCKET s : rig.busy_ends) {
+					if (send(s, message, MessageBytes, 0) != ssize_t(MessageBytes)) throw std::runtime_error("poll: send on a busy connection failed");
+					sent += MessageBytes;
+				}
+			};
+			//(a few polls first, so the busy connections' recv_buffers have grown)
+			for (uint32_t i = 0; i < 10; ++i) {
+				send_busy();
+				rig.server.poll(on_event, 0.0);
+			}
+
+			PollStats before = rig.server.stats;
+			uint64_t allocations = heap_allocations.load();
+			uint64_t received_before = received;
+			uint32_t polls = 0;
+			double elapsed = 0.0;
+			while (elapsed < 0.5 || polls < 100) {
+				send_busy();
+				auto before = Clock::now();
+				rig.server.poll(on_event, 0.0);
+				elapsed += seconds_since(before);
+				polls += 1;
+			}
+			allocations = heap_allocations.load() - allocations;
+			PollStats const &after = rig.server.stats;
+			if (allocations != 0 || after.allocations != before.allocations) {
+				throw std::runtime_error("poll: " + std::to_string(allocations) + " heap allocations while polling busy connections in steady state");
+			}
+			if (after.bytes_copied - before.bytes_copied != received - received_before) {
+				throw std::runtime_error("poll: PollStats::bytes_copied doesn't match the bytes received");
+			}
+
+			for (uint32_t wait = 0; wait < 100 && received < sent; ++wait) {
+				rig.server.poll(on_event, 0.01);
+			}
+			if (closed) throw std::runtime_error("poll: a connection closed");
+			if (received != sent) throw std::runtime_error("poll: " + std::to_string(sent - received) + " bytes sent on busy connections never arrived");
+
+			std::cout << std::fixed << std::setprecision(2) << elapsed / polls * 1e6 << " us/poll (no heap allocations)" << std::endl;
+		}
+	}
+	#endif
+}
+
+//------ buffers: draining a burst of frames from a ByteBuffer vs. erasing each from the front of a vector ------
+static void bench_buffers() {
+	std::cout << "buffers: a burst of Input frames through MessageHandlers::dispatch (ByteBuffer), vs. decoding each and erasing it from the front of a std::vector (as recv_buffer used to be)" << std::endl;
+	MessageHandlers handlers;
+	uint64_t sum = 0;
+	handlers.on< Protocol::Input >([&sum](Connection *, Protocol::Input const &input) {
+		sum += input.sequence;
+	});
+
+	Connection connection;
+	connection.socket = Replay::ReplaySocket; //(a valid-looking socket, so dispatch() keeps going)
+
+	for (uint32_t count : {1000, 10000}) {
+		//the burst, as it would arrive:
+		Connection wire;
+		uint64_t expected = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			Protocol::Input input;
+			memset(&input, 0, sizeof(input));
+			input.sequence = 1 + i * Prediction::SendEvery;
+			input.count = Prediction::SendEvery;
+			send_message(wire, input);
+			expected += input.sequence;
+		}
+		ByteBuffer const &burst = wire.send_buffer;
+
+		double per_message[2];
+		for (uint32_t way = 0; way < 2; ++way) {
+			uint32_t runs = 0;
+			double elapsed = 0.0;
+			while (elapsed < 0.25 || runs < 3) {
+				sum = 0;
+				if (way == 0) {
+					std::vector< char > buffer(burst.begin(), burst.end());
+					auto before = Clock::now();
+					while (!buffer.empty()) {
+						uint8_t type;
+						char const *payload;
+						uint32_t size;
+						char const *next;
+						if (decode_frame(buffer.data(), buffer.data() + buffer.size(), &type, &payload, &size, &next) != FrameComplete) break;
+						if (handlers.handlers[type]) handlers.handlers[type](&connection, payload, size);
+						buffer.erase(buffer.begin(), buffer.begin() + (next - buffer.data()));
+					}
+					elapsed += seconds_since(before);
+				} else {
+					connection.recv_buffer.clear();
+					connection.recv_buffer.append(burst.data(), burst.size());
+					auto before = Clock::now();
+					handlers.dispatch(&connection);
+					elapsed += seconds_since(before);
+					if (!connection.recv_buffer.empty()) throw std::runtime_error("buffers: dispatch() left frames in recv_buffer");
+				}
+				if (sum != expected) throw std::runtime_error("buffers: not every frame was handled (exactly once)");
+				runs += 1;
+			}
+			per_message[way] = elapsed / (double(runs) * count);
+		}
+		std::cout << "  " << std::setw(5) << count << " frames (" << burst.size() << " bytes): "
+			<< std::fixed << std::setprecision(1) << per_message[0] * 1e9 << " ns/message erasing from a vector, "
+			<< per_message[1] * 1e9 << " ns/message with ByteBuffer ("
+			<< std::setprecision(0) << per_message[0] / per_message[1] << "x)" << std::endl;
+	}
+}
+
+//------ latency: one-way message latency over loopback, Nagle's algorithm vs. TCP_NODELAY and explicit flushes ------
+static void bench_latency() {
+	#ifdef _WIN32
+	std::cout << "latency: skipped (uses POSIX poll() for its bots)" << std::endl;
+	#else
+	uint32_t const Bots = 16;
+	double const Seconds = 2.0;
+	std::cout << "latency: one-way loopback latency between a server loop (a message to every bot each tick, at " << Game::TickRate << " Hz)"
+		<< " and " << Bots << " bots on another thread (a message each every " << Prediction::SendEvery << " ticks)" << std::endl;
+
+	auto timestamp = [](){
+		return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now().time_since_epoch()).count());
+	};
+	auto percentile = [](std::vector< double > &latencies, uint32_t p) {
+		std::sort(latencies.begin(), latencies.end());
+		return latencies[std::min(latencies.size() - 1, latencies.size() * p / 100)];
+	};
+
+	for (uint32_t mode = 0; mode < 2; ++mode) {
+		bool nodelay = (mode == 1);
+		#ifdef __linux__
+		PollRig rig(Server::Epoll, 0, Bots); //(as server.cpp runs)
+		#else
+		PollRig rig(Server::Select, 0, Bots);
+		#endif
+		if (!nodelay) {
+			//Nagle's algorithm back on, at both ends:
+			int zero = 0;
+			for (SOCKET s : rig.busy_ends) {
+				setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &zero, sizeof(zero));
+			}
+			for (auto &c : rig.server.connections) {
+				setsockopt(c.socket, IPPROTO_TCP, TCP_NODELAY, &zero, sizeof(zero));
+			}
+		}
+
+		//bots -> server: Pings carrying the time they were sent
+		std::vector< double > to_server;
+		MessageHandlers handlers;
+		handlers.on< Protocol::Ping >([&](Connection *, Protocol::Ping const &ping) {
+			to_server.emplace_back((timestamp() - ping.time) * 1e-9);
+		});
+		std::function< void(Connection *, Connection::Event) > on_event = [&](Connection *c, Connection::Event evt){
+			if (evt == Connection::OnRecv) handlers.dispatch(c);
+		};
+
+		//server -> bots: Pongs carrying the time they were queued
+		std::vector< double > to_bots;
+		std::atomic< bool > stop(false);
+		std::thread bots([&](){
+			std::vector< pollfd > fds(Bots);
+			std::vector< ByteBuffer > received(Bots);
+			for (uint32_t i = 0; i < Bots; ++i) {
+				fds[i].fd = rig.busy_ends[i];
+				fds[i].events = POLLIN;
+			}
+			auto next_send = Clock::now();
+			while (!stop.load()) {
+				if (Clock::now() >= next_send) {
+					next_send += std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(Prediction::SendEvery * Game::TickDt));
+					for (SOCKET s : rig.busy_ends) {
+						Protocol::Ping ping;
+						ping.time = timestamp();
+						uint8_t frame[MaxFrameHeader + sizeof(ping)];
+						uint32_t used = encode_frame_header(frame, Protocol::Ping::Type, sizeof(ping));
+						memcpy(frame + used, &ping, sizeof(ping));
+						send(s, frame, used + sizeof(ping), 0);
+					}
+				}
+				if (::poll(fds.data(), fds.size(), 1) <= 0) continue;
+				for (uint32_t i = 0; i < Bots; ++i) {
+					if (!(fds[i].revents & POLLIN)) continue;
+					char buffer[4096];
+					ssize_t got = recv(fds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+					if (got <= 0) continue;
+					ByteBuffer &at = received[i];
+					at.append(buffer, got);
+					uint8_t type;
+					char const *payload, *next;
+					uint32_t size;
+					while (!at.empty() && decode_frame(at.begin(), at.end(), &type, &payload, &size, &next) == FrameComplete) {
+						Protocol::Pong pong;
+						if (type == Protocol::Pong::Type && size == sizeof(pong)) {
+							memcpy(&pong, payload, sizeof(pong));
+							to_bots.emplace_back((timestamp() - pong.time) * 1e-9);
+						}
+						at.consume(next - at.begin());
+					}
+				}
+			}
+		});
+
+		//server loop, as in server.cpp:
+		auto start = Clock::now();
+		auto next_tick = start;
+		while (seconds_since(start) < Seconds) {
+			double wait = std::chrono::duration< double >(next_tick - Clock::now()).count();
+			rig.server.poll(on_event, std::max(0.0, wait));
+			if (Clock::now() >= next_tick) {
+				next_tick += std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(Game::TickDt));
+				Protocol::Pong pong;
+				pong.time = timestamp();
+				for (auto &c : rig.server.connections) {
+					send_message(c, pong);
+				}
+				if (nodelay) rig.server.flush();
+			}
+		}
+		//(a moment for the last messages to arrive)
+		auto last = Clock::now();
+		while (seconds_since(last) < 0.1) {
+			rig.server.poll(on_event, 0.01);
+		}
+		stop.store(true);
+		bots.join();
+
+		uint32_t ticks = uint32_t(Seconds * Game::TickRate);
+		if (to_bots.size() < Bots * ticks * 9 / 10 || to_server.size() < Bots * (ticks / Prediction::SendEvery) * 9 / 10) {
+			throw std::runtime_error("latency: too few messages arrived (" + std::to_string(to_bots.size()) + " to bots, " + std::to_string(to_server.size()) + " to the server)");
+		}
+		std::cout << "  " << std::setw(30) << std::left << (nodelay ? "TCP_NODELAY, flush() per tick:" : "Nagle, sent by the next poll():") << std::right
+			<< std::fixed << std::setprecision(3)
+			<< " server->bot p50 " << percentile(to_bots, 50) * 1e3 << " ms, p99 " << percentile(to_bots, 99) * 1e3 << " ms;"
+			<< " bot->server p50 " << percentile(to_server, 50) * 1e3 << " ms, p99 " << percentile(to_server, 99) * 1e3 << " ms" << std::endl;
+	}
+	#endif
+}
+
+//------ udp: both UdpConnection channels over loopback, through a lossy, laggy shim ------
+static void bench_udp() {
+	uint32_t const Messages = 5000; //reliable messages sent each way
+	float const Loss = 0.2f;
+	float const Latency = 0.02f;
+	float const Jitter = 0.02f;
+	std::cout << "udp: UdpServer <-> UdpClient on loopback, " << std::fixed << std::setprecision(0) << Loss * 100.0f << "% loss and " << Latency * 1e3f << "-" << (Latency + Jitter) * 1e3f << " ms latency each way;"
+		<< " checking reliable messages arrive in order and unreliable ones never go backwards" << std::endl;
+
+	UdpServer server("0"); //(any free port)
+	if (server.port() == 0) throw std::runtime_error("udp: couldn't find the server's port");
+	UdpClient client("127.0.0.1", std::to_string(server.port()));
+	for (UdpShim *shim : {&server.shim, &client.shim}) {
+		shim->loss = Loss;
+		shim->latency = Latency;
+		shim->jitter = Jitter;
+	}
+	server.shim.rng.seed(0x5e);
+	client.shim.rng.seed(0xc1);
+
+	//each end sends Attacks (numbered 0, 1, ...) on the reliable channel and Inputs (with increasing sequence numbers) on the unreliable one:
+	struct End {
+		char const *name;
+		uint32_t reliable_sent = 0;
+		uint32_t unreliable_sent = 0;
+		uint32_t reliable_received = 0;
+		uint32_t unreliable_received = 0;
+		uint32_t newest_sequence = 0;
+		BasicMessageHandlers< UdpConnection > handlers;
+		explicit End(char const *name_) : name(name_) {
+			handlers.on< Protocol::Attack >([this](UdpConnection *, Protocol::Attack const &attack) {
+				if (attack.target != reliable_received) {
+					throw std::runtime_error(std::string("udp: ") + name + " got reliable message " + std::to_string(attack.target) + " when expecting " + std::to_string(reliable_received));
+				}
+				reliable_received += 1;
+			});
+			handlers.on< Protocol::Input >([this](UdpConnection *, Protocol::Input const &input) {
+				if (input.sequence <= newest_sequence) {
+					throw std::runtime_error(std::string("udp: ") + name + " got unreliable sequence " + std::to_string(input.sequence) + " after " + std::to_string(newest_sequence));
+				}
+				newest_sequence = input.sequence;
+				unreliable_received += 1;
+			});
+		}
+		//queue a few reliable messages, and an unreliable one each tick (as positions would be):
+		Clock::time_point next_tick = Clock::now();
+		void send(UdpConnection &c) {
+			for (uint32_t i = 0; i < 5 && reliable_sent < Messages; ++i) {
+				Protocol::Attack attack;
+				attack.target = reliable_sent++;
+				send_message(c.reliable, attack);
+			}
+			if (Clock::now() < next_tick) return;
+			next_tick += std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(Game::TickDt));
+			Protocol::Input input;
+			memset(&input, 0, sizeof(input));
+			input.sequence = ++unreliable_sent;
+			send_message(c.unreliable, input);
+		}
+	};
+	End at_server("server"), at_client("client");
+
+	UdpConnection *server_end = nullptr;
+	bool closed = false;
+	auto on_server_event = [&](UdpConnection *c, Connection::Event evt){
+		if (evt == Connection::OnOpen) server_end = c;
+		else if (evt == Connection::OnRecv) {
+			at_server.handlers.dispatch(c, c->reliable.recv_buffer);
+			at_server.handlers.dispatch(c, c->unreliable.recv_buffer);
+		} else if (evt == Connection::OnClose) closed = true;
+	};
+	auto on_client_event = [&](UdpConnection *c, Connection::Event evt){
+		if (evt == Connection::OnRecv) {
+			at_client.handlers.dispatch(c, c->reliable.recv_buffer);
+			at_client.handlers.dispatch(c, c->unreliable.recv_buffer);
+		} else if (evt == Connection::OnClose) closed = true;
+	};
+
+	//(running for a couple of seconds at least, for enough unreliable ones to count)
+	auto before = Clock::now();
+	double reliable_done = 0.0;
+	while (at_server.reliable_received < Messages || at_client.reliable_received < Messages || seconds_since(before) < 2.0) {
+		if (seconds_since(before) > 60.0) throw std::runtime_error("udp: reliable messages still missing after a minute");
+		if (reliable_done == 0.0 && at_server.reliable_received == Messages && at_client.reliable_received == Messages) reliable_done = seconds_since(before);
+		if (closed) throw std::runtime_error("udp: connection closed");
+		at_client.send(client.connection);
+		if (server_end) at_server.send(*server_end);
+		client.poll(on_client_event, 0.0);
+		server.poll(on_server_event, 0.001);
+	}
+	if (reliable_done == 0.0) reliable_done = seconds_since(before);
+
+	for (End const *end : {&at_server, &at_client}) {
+		End const &other = (end == &at_server ? at_client : at_server);
+		//(about 1 - Loss of them should arrive, minus a few overtaken by later ones)
+		if (end->unreliable_received < other.unreliable_sent / 2) {
+			throw std::runtime_error(std::string("udp: ") + end->name + " got only " + std::to_string(end->unreliable_received) + " of " + std::to_string(other.unreliable_sent) + " unreliable messages");
+		}
+		std::cout << "  to " << std::setw(6) << std::left << end->name << std::right << ": all " << Messages << " reliable messages, in order; "
+			<< end->unreliable_received << " of " << other.unreliable_sent << " unreliable ones, never out of order" << std::endl;
+	}
+	std::cout << "  (reliable messages all delivered after " << std::fixed << std::setprecision(2) << reliable_done << " s)" << std::endl;
+
+	closesocket(client.socket);
+	closesocket(server.socket);
+
+	//a match whose players claim the UDP connections they're offered (as GameMode does): after that,
+	// States reach them over UDP, relayed events too, and nothing more goes over TCP:
+	{
+		UdpServer udp("0");
+		MatchManager matches;
+		matches.udp_port = udp.port();
+		std::stringstream recording;
+		Recorder recorder(recording);
+		matches.recorder = &recorder;
+		Connection players[2]; //hunter, wolf (stand-ins for their TCP connections)
+		std::unique_ptr< UdpClient > clients[2];
+		uint64_t tokens[2] = {0, 0};
+		bool claimed[2] = {false, false};
+		uint32_t states[2] = {0, 0};
+		uint32_t skins = 0;
+		uint32_t player = 0; //whose messages are being handled
+
+		MessageHandlers from_server;
+		from_server.on< Protocol::UdpOffer >([&](Connection *, Protocol::UdpOffer const &offer) {
+			tokens[player] = offer.token;
+			clients[player].reset(new UdpClient("127.0.0.1", std::to_string(offer.port)));
+			Protocol::UdpHello hello;
+			hello.token = offer.token;
+			send_message(clients[player]->connection.reliable, hello);
+		});
+		from_server.on< Protocol::UdpHello >([&](Connection *, Protocol::UdpHello const &hello) {
+			if (hello.token == tokens[player]) claimed[player] = true;
+		});
+		from_server.on(Protocol::State::Type, [&](Connection *, char const *, size_t) {
+			states[player] += 1;
+		});
+		from_server.on< Protocol::ChangeSkin >([&](Connection *, Protocol::ChangeSkin const &) {
+			skins += 1;
+		});
+
+		for (player = 0; player < 2; ++player) {
+			Connection wire;
+			players[player].socket = Replay::ReplaySocket;
+			matches.on_event(&players[player], Connection::OnOpen);
+			send_message(wire, Protocol::Hello());
+			players[player].recv_buffer.append(wire.send_buffer.data(), wire.send_buffer.size());
+			matches.on_event(&players[player], Connection::OnRecv);
+			from_server.dispatch(&players[player], players[player].send_buffer);
+			if (!clients[player]) throw std::runtime_error("udp: player " + std::to_string(player) + " wasn't offered a UDP connection");
+		}
+
+		auto on_udp_event = [&](UdpConnection *u, Connection::Event evt){
+			matches.on_udp_event(u, evt);
+		};
+		auto pump = [&](std::function< bool() > const &done) {
+			auto started = Clock::now();
+			while (!done()) {
+				if (seconds_since(started) > 5.0) throw std::runtime_error("udp: match over UDP stalled");
+				for (player = 0; player < 2; ++player) {
+					clients[player]->poll([&](UdpConnection *u, Connection::Event evt){
+						if (evt == Connection::OnRecv) {
+							from_server.dispatch(&players[player], u->reliable.recv_buffer);
+							from_server.dispatch(&players[player], u->unreliable.recv_buffer);
+						} else if (evt == Connection::OnClose) {
+							throw std::runtime_error("udp: player " + std::to_string(player) + "'s UDP connection closed");
+						}
+					});
+				}
+				udp.poll(on_udp_event, 0.001);
+			}
+		};
+		pump([&](){ return claimed[0] && claimed[1]; });
+
+		//(stand-ins never send, so anything queued for TCP from now on is still there at the end)
+		uint32_t tcp_before[2] = {uint32_t(players[0].send_buffer.size()), uint32_t(players[1].send_buffer.size())};
+		send_message(clients[1]->connection.reliable, Protocol::ChangeSkin());
+		uint32_t const Ticks = 20 * MatchManager::StateEvery;
+		for (uint32_t i = 0; i < Ticks; ++i) {
+			matches.step();
+		}
+		pump([&](){ return states[0] == Ticks / MatchManager::StateEvery && states[1] == Ticks / MatchManager::StateEvery && skins == 1; });
+		for (player = 0; player < 2; ++player) {
+			if (players[player].send_buffer.size() != tcp_before[player]) {
+				throw std::runtime_error("udp: player " + std::to_string(player) + " was still sent " + std::to_string(players[player].send_buffer.size() - tcp_before[player]) + " bytes over TCP");
+			}
+		}
+		std::cout << "  match over UDP: both players claimed their offers; " << states[0] << " States each and the wolf's ChangeSkin arrived over UDP, nothing more over TCP" << std::endl;
+
+		//what came in over UDP is recorded, and plays back (over the stand-ins):
+		recorder.flush();
+		Replay replay(recording);
+		uint32_t udp_records = 0;
+		for (auto const &record : replay.recording.records) {
+			if (record.kind == Recording::UdpRecv) udp_records += 1;
+		}
+		MatchManager replayed;
+		while (replay.step(&replayed)) { }
+		if (udp_records != 1 || replay.steps != Ticks) {
+			throw std::runtime_error("udp: recording of the match had " + std::to_string(udp_records) + " UDP records and replayed " + std::to_string(replay.steps) + " steps");
+		}
+
+		for (auto &client : clients) closesocket(client->socket);
+		closesocket(udp.socket);
+	}
+}
+
+int main(int argc, char **argv) {
+	struct Benchmark {
+		std::string name;
+		std::function< void() > run;
+	};
+	std::vector< Benchmark > benchmarks = {
+		{"ticks", bench_ticks},
+		{"snapshots", bench_snapshots},
+		{"interest", bench_interest},
+		{"hits", bench_hits},
+		{"ids", bench_ids},
+		{"herd", bench_herd},
+		{"wander", bench_wander},
+		{"jobs", bench_jobs},
+		{"lockstep", bench_lockstep},
+		{"replay", bench_replay},
+		{"transforms", bench_transforms},
+		{"hierarchy", bench_hierarchy},
+		{"pool", bench_pool},
+		{"queue", bench_queue},
+		{"instancing", bench_instancing},
+		{"poll", bench_poll},
+		{"buffers", bench_buffers},
+		{"latency", bench_latency},
+		{"udp", bench_udp},
+	};
+
+	bool ran = false;
+	for (auto const &b : benchmarks) {
+		if (argc > 1 && b.name != argv[1]) continue;
+		try {
+			b.run();
+		} catch (std::exception &e) {
+			std::cerr << "FAILED: " << b.name << ": " << e.what() << std::endl;
+			return 1;
+		}
+		ran = true;
+	}
+	if (!ran) {
+		std::cerr << "Usage:\n\t./bench [name]\nwhere name is one of:";
+		for (auto const &b : benchmarks) {
+			std::cerr << " " << b.name;
+		}
+		std::cerr << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,366 @@
+#include "Connection.hpp"
+#include "Message.hpp"
+#include "Protocol.hpp"
+#include "Game.hpp"
+#include "Prediction.hpp"
+#include "Snapshot.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstring>
+#include <cmath>
+
+/*
+ * loadgen is a headless stand-in for many copies of the game client.
+ *
+ * It opens 'pairs' hunter/wolf pairs of connections to a server and drives
+ * each one with a scripted player that speaks the same protocol as
+ * GameMode: hello, animal count and placements (hunter), input bits,
+ * facing directions (wolf), attacks, skin changes (wolf) and shots (hunter).
+ * Each bot runs its movement in fixed ticks with Prediction (sending
+ * batched Inputs, like GameMode) and re-rolls its controls 'rate' times
+ * per second.
+ *
+ * Every second it prints message throughput, round-trip time percentiles
+ * (measured with Ping/Pong) and the number of disconnects:
+
+./loadgen localhost 1337 1000 30 60 4
+
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t now_ns() {
+	return std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now().time_since_epoch()).count();
+}
+
+//Counters shared by all bot threads (updated with relaxed atomics, read by the reporter):
+struct Stats {
+	std::atomic< uint64_t > messages_sent{0};
+	std::atomic< uint64_t > bytes_sent{0};
+	std::atomic< uint64_t > messages_received{0};
+	std::atomic< uint64_t > disconnects{0};
+	std::atomic< uint64_t > bad_states{0}; //State messages that failed to decode
+	std::atomic< uint32_t > playing{0}; //bots that have been given a role
+
+	//round-trip times, bucketed by powers of two microseconds ([2^i, 2^(i+1)) us):
+	static constexpr const uint32_t Buckets = 32;
+	std::atomic< uint64_t > rtt[Buckets];
+
+	Stats() {
+		for (auto &b : rtt) b.store(0);
+	}
+
+	void record_rtt(uint64_t ns) {
+		uint64_t us = ns / 1000;
+		uint32_t bucket = 0;
+		while (us > 1 && bucket + 1 < Buckets) {
+			us >>= 1;
+			bucket += 1;
+		}
+		rtt[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+//A scripted player:
+struct Bot {
+	Connection *connection = nullptr;
+	Game state;
+	std::mt19937 mt;
+	Prediction prediction; //runs the bot's ticks and batches them into Inputs, like GameMode
+	SnapshotHistory received_states;
+	uint64_t last_update = 0; //(ns) when the prediction was last advanced
+	uint32_t sent_direction = 0; //(wolf) last Direction sent
+	uint64_t next_tick = 0; //(ns) when to next pick controls, attack, etc.
+	uint64_t next_ping = 0; //(ns) when to next send a ping
+	uint32_t ticks = 0;
+};
+
+//Settings shared by all bots:
+struct Script {
+	uint32_t animals = 40; //animal count announced by hunters (ids are 1 .. animals)
+	uint64_t tick_ns = 0; //time between bot updates
+	uint64_t ping_ns = 250000000; //time between pings
+	uint32_t attack_every = 30; //ticks between attacks
+	uint32_t skin_every = 45; //ticks between wolf skin changes / hunter shots
+};
+
+static void tick_bot(Bot &bot, Script const &script, uint64_t now, Stats &stats) {
+	Connection &c = *bot.connection;
+	size_t before = c.send_buffer.size();
+	uint32_t messages = 0;
+
+	if (now >= bot.next_ping) {
+		bot.next_ping = now + script.ping_ns;
+		Protocol::Ping ping;
+		ping.time = now;
+		send_message(c, ping);
+		messages += 1;
+	}
+
+	if (!(bot.state.identity.is_hunter || bot.state.identity.is_wolf)) {
+		//still waiting for an identity:
+		stats.messages_sent.fetch_add(messages, std::memory_order_relaxed);
+		stats.bytes_sent.fetch_add(c.send_buffer.size() - before, std::memory_order_relaxed);
+		return;
+	}
+
+	if (now >= bot.next_tick) {
+		bot.next_tick = now + script.tick_ns;
+		bot.ticks += 1;
+
+		//wander, turning back toward the middle of the frame when outside it:
+		glm::vec2 at = (bot.state.identity.is_hunter ? bot.state.crosshair : bot.state.wolf);
+		auto &controls = bot.state.controls;
+		controls.move_left = (at.x > 0.5f * Game::FrameWidth) || (bot.mt() % 3 == 0);
+		controls.move_right = !controls.move_left && (at.x < -0.5f * Game::FrameWidth || bot.mt() % 2 == 0);
+		controls.move_down = (at.y > 0.5f * Game::FrameHeight) || (bot.mt() % 3 == 0);
+		controls.move_up = !controls.move_down && (at.y < -0.5f * Game::FrameHeight || bot.mt() % 2 == 0);
+
+		//same messages as GameMode: (wolf) direction when it changes, occasional attacks:
+		if (bot.state.identity.is_wolf && controls.bits() != 0) {
+			uint32_t direction = 1 + controls.bits() % 8;
+			if (direction != bot.sent_direction) {
+				Protocol::Direction message;
+				message.id = script.animals; //(the server only relays it)
+				message.direction = direction;
+				send_message(c, message);
+				bot.sent_direction = direction;
+				messages += 1;
+			}
+		}
+
+		if (script.attack_every && bot.ticks % script.attack_every == 0) {
+			Protocol::Attack message;
+			message.target = 1 + bot.mt() % script.animals;
+			send_message(c, message);
+			messages += 1;
+		}
+
+		if (script.skin_every && bot.ticks % script.skin_every == 0) {
+			if (bot.state.identity.is_wolf) send_message(c, Protocol::ChangeSkin());
+			else send_message(c, Protocol::Shoot());
+			messages += 1;
+		}
+	}
+
+	//run the simulation ticks that are due and send their inputs:
+	{
+		float elapsed = (bot.last_update == 0 ? 0.0f : float(now - bot.last_update) / 1e9f);
+		bot.last_update = now;
+		glm::vec2 &at = (bot.state.identity.is_hunter ? bot.state.crosshair : bot.state.wolf);
+		bot.prediction.update(elapsed, bot.state.controls, &at);
+		Protocol::Input input;
+		while (bot.prediction.next_input(&input)) {
+			send_message(c, input);
+			messages += 1;
+		}
+	}
+
+	stats.messages_sent.fetch_add(messages, std::memory_order_relaxed);
+	stats.bytes_sent.fetch_add(c.send_buffer.size() - before, std::memory_order_relaxed);
+}
+
+//Each thread drives its share of the bots from one event loop:
+static void run_bots(std::vector< SOCKET > sockets, Script const &script, Stats &stats, std::atomic< bool > &quit) {
+	#ifdef __linux__
+	Server loop(Server::Epoll);
+	#else
+	Server loop(Server::Select);
+	#endif
+
+	std::vector< Bot > bots(sockets.size());
+	std::unordered_map< Connection *, Bot * > bot_for;
+	for (uint32_t i = 0; i < sockets.size(); ++i) {
+		Bot &bot = bots[i];
+		bot.connection = loop.adopt(sockets[i]);
+		bot.mt.seed(uint32_t(sockets[i]) * 0x9e3779b9u + i);
+		if (!bot.connection) {
+			stats.disconnects.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		bot_for[bot.connection] = &bot;
+		send_message(*bot.connection, Protocol::Hello());
+		stats.messages_sent.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	MessageHandlers handlers;
+	handlers.on< Protocol::Identity >([&](Connection *c, Protocol::Identity const &message) {
+		Bot &bot = *bot_for[c];
+		if (bot.state.identity.is_hunter || bot.state.identity.is_wolf) return;
+		if (message.role == 'h') {
+			bot.state.identity.is_hunter = true;
+			Protocol::AnimalCount count;
+			count.count = script.animals;
+			send_message(*c, count);
+			//animals in a grid around the middle of the frame; the last one is the wolf:
+			for (uint32_t id = 1; id <= script.animals; ++id) {
+				Protocol::Placement placement;
+				placement.id = id;
+				placement.kind = (id == script.animals ? Protocol::Placement::Wolf : Protocol::Placement::Animal);
+				placement.position = glm::vec2(float(id % 8) - 3.5f, float(id / 8) - 2.5f);
+				send_message(*c, placement);
+			}
+			//(the crosshair comes last; the server's herd starts wandering then)
+			Protocol::Placement placement;
+			placement.id = 0;
+			placement.kind = Protocol::Placement::Crosshair;
+			placement.position = bot.state.crosshair;
+			send_message(*c, placement);
+			stats.messages_sent.fetch_add(2 + script.animals, std::memory_order_relaxed);
+		} else if (message.role == 'w') {
+			bot.state.identity.is_wolf = true;
+		}
+		stats.playing.fetch_add(1, std::memory_order_relaxed);
+	});
+	handlers.on(Protocol::State::Type, [&](Connection *c, char const *payload, size_t size) {
+		Bot &bot = *bot_for[c];
+		Snapshot snapshot;
+		if (!decode_snapshot(payload, size, bot.received_states, &snapshot)) {
+			stats.bad_states.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		bot.received_states.add(snapshot);
+		glm::vec2 crosshair = Snapshot::dequantize(snapshot.crosshair);
+		glm::vec2 wolf = Snapshot::dequantize(snapshot.wolf);
+		if (bot.state.identity.is_hunter) {
+			bot.prediction.reconcile(snapshot.tick, snapshot.ack, crosshair, &bot.state.crosshair);
+			bot.state.wolf = wolf;
+		} else {
+			bot.prediction.reconcile(snapshot.tick, snapshot.ack, wolf, &bot.state.wolf);
+			bot.state.crosshair = crosshair;
+		}
+	});
+	handlers.on< Protocol::Pong >([&](Connection *, Protocol::Pong const &message) {
+		stats.record_rtt(now_ns() - message.time);
+	});
+
+	while (!quit.load(std::memory_order_relaxed)) {
+		loop.poll([&](Connection *c, Connection::Event evt){
+			if (evt == Connection::OnRecv) {
+				stats.messages_received.fetch_add(handlers.dispatch(c), std::memory_order_relaxed);
+			}
+			if (evt == Connection::OnClose || !*c) {
+				auto f = bot_for.find(c);
+				if (f != bot_for.end()) {
+					f->second->connection = nullptr;
+					bot_for.erase(f);
+					stats.disconnects.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}, 0.001);
+
+		uint64_t now = now_ns();
+		for (auto &bot : bots) {
+			if (!bot.connection) continue;
+			tick_bot(bot, script, now, stats);
+		}
+		loop.flush();
+	}
+}
+
+//Print percentiles of the round-trip times recorded since 'since':
+static void report_rtt(Stats const &stats, std::vector< uint64_t > &since) {
+	std::vector< uint64_t > counts(Stats::Buckets);
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < Stats::Buckets; ++i) {
+		uint64_t now = stats.rtt[i].load(std::memory_order_relaxed);
+		counts[i] = now - since[i];
+		since[i] = now;
+		total += counts[i];
+	}
+	std::cout << " rtt(us)";
+	if (total == 0) {
+		std::cout << " -";
+		return;
+	}
+	//report the upper bound of the bucket containing each percentile:
+	for (double p : {0.5, 0.9, 0.99, 1.0}) {
+		uint64_t want = uint64_t(std::ceil(p * total));
+		uint64_t seen = 0;
+		uint32_t bucket = 0;
+		while (bucket + 1 < Stats::Buckets && seen + counts[bucket] < want) {
+			seen += counts[bucket];
+			bucket += 1;
+		}
+		std::cout << " p" << (p == 1.0 ? std::string("max") : std::to_string(int(p * 100.0 + 0.5))) << "<" << (2ULL << bucket);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3 || argc > 7) {
+		std::cerr << "Usage:\n\t./loadgen <host> <port> [pairs=100] [rate=30] [seconds=10] [threads=1]\n"
+		             "\t(runs 'pairs' hunter/wolf pairs, each updating its controls up to 'rate' times per second)" << std::endl;
+		return 1;
+	}
+	std::string host = argv[1];
+	std::string port = argv[2];
+	uint32_t pairs = (argc > 3 ? uint32_t(std::max(1, std::stoi(argv[3]))) : 100);
+	double rate = (argc > 4 ? std::max(0.1, std::stod(argv[4])) : 30.0);
+	double seconds = (argc > 5 ? std::stod(argv[5]) : 10.0);
+	uint32_t threads = (argc > 6 ? uint32_t(std::max(1, std::stoi(argv[6]))) : 1);
+
+	Script script;
+	script.tick_ns = uint64_t(1e9 / rate);
+
+	//connect hunter and wolf of each pair back-to-back so the server pairs them up;
+	// each socket is then handed (by pairs) to a bot thread's event loop:
+	std::vector< std::vector< SOCKET > > sockets(threads);
+	for (uint32_t i = 0; i < 2 * pairs; ++i) {
+		Client client(host, port);
+		sockets[(i / 2) % threads].emplace_back(client.connection.socket);
+		client.connection.socket = INVALID_SOCKET; //(now owned by the bot thread)
+	}
+
+	Stats stats;
+	std::atomic< bool > quit(false);
+	std::vector< std::thread > workers;
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers.emplace_back(run_bots, sockets[t], std::cref(script), std::ref(stats), std::ref(quit));
+	}
+
+	std::vector< uint64_t > rtt_since(Stats::Buckets, 0);
+	uint64_t sent_since = 0, bytes_since = 0, received_since = 0;
+	auto start = Clock::now();
+	auto last = start;
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		auto now = Clock::now();
+		double dt = std::chrono::duration< double >(now - last).count();
+		last = now;
+
+		uint64_t sent = stats.messages_sent.load(std::memory_order_relaxed);
+		uint64_t bytes = stats.bytes_sent.load(std::memory_order_relaxed);
+		uint64_t received = stats.messages_received.load(std::memory_order_relaxed);
+		std::cout << std::fixed << std::setprecision(0)
+			<< "[" << std::chrono::duration< double >(now - start).count() << "s]"
+			<< " playing " << stats.playing.load(std::memory_order_relaxed) << "/" << 2 * pairs
+			<< " sent " << (sent - sent_since) / dt << " msg/s (" << (bytes - bytes_since) / dt / 1024.0 << " KiB/s)"
+			<< " received " << (received - received_since) / dt << " msg/s";
+		report_rtt(stats, rtt_since);
+		std::cout << " disconnects " << stats.disconnects.load(std::memory_order_relaxed) << std::endl;
+		sent_since = sent;
+		bytes_since = bytes;
+		received_since = received;
+
+		if (std::chrono::duration< double >(now - start).count() >= seconds) break;
+	}
+
+	quit.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	std::cout << "Totals: sent " << stats.messages_sent.load() << " messages (" << stats.bytes_sent.load() << " bytes), received "
+		<< stats.messages_received.load() << " messages (" << stats.bad_states.load() << " undecodable States), " << stats.disconnects.load() << " disconnects." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include "Recording.hpp"
+#include "Match.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+/*
+ * replay plays a recorded server session (see Recording.hpp) back through
+ * MatchManager as fast as it can, and reports how long dispatching messages
+ * and stepping matches took:
+
+./server 1337 2 session   #(then play for a while)
+./replay session.0.rec 5  #play worker 0's matches back five times
+
+ * Every run must send exactly the same bytes (the simulation is
+ * deterministic given the same inputs at the same steps); replay exits with
+ * an error if they differ.
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv) {
+	if (argc != 2 && argc != 3) {
+		std::cerr << "Usage:\n\t./replay <recording> [runs]" << std::endl;
+		return 1;
+	}
+	uint32_t runs = (argc == 3 ? uint32_t(std::max(1, std::stoi(argv[2]))) : 3);
+
+	std::unique_ptr< Replay > replay;
+	try {
+		std::ifstream file(argv[1], std::ios::binary);
+		if (!file) throw std::runtime_error("couldn't open file");
+		replay.reset(new Replay(file));
+	} catch (std::exception &e) {
+		std::cerr << "Failed to read recording '" << argv[1] << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	uint32_t first_hash = 0;
+	for (uint32_t run = 0; run < runs; ++run) {
+		replay->rewind();
+		MatchManager matches;
+
+		//time message handling and simulation separately:
+		double dispatch_seconds = 0.0;
+		double step_seconds = 0.0;
+		auto before = Clock::now();
+		while (replay->next_record < replay->recording.records.size()) {
+			bool step = (replay->recording.records[replay->next_record].kind == Recording::Step);
+			replay->step(&matches);
+			auto after = Clock::now();
+			(step ? step_seconds : dispatch_seconds) += std::chrono::duration< double >(after - before).count();
+			before = after;
+		}
+		replay->step(&matches); //(flushes the last of the sent data)
+
+		double total = dispatch_seconds + step_seconds;
+		if (run == 0) {
+			std::cout << argv[1] << ": " << replay->recording.records.size() << " records, "
+				<< replay->connections.size() << " connections, "
+				<< replay->bytes_received << " bytes received over "
+				<< std::fixed << std::setprecision(1) << replay->steps * MatchManager::TickDt << " seconds of play" << std::endl;
+			first_hash = replay->sent_hash;
+		}
+		std::cout << "  run " << run + 1 << ": " << std::fixed << std::setprecision(3) << total << " s ("
+			<< std::setprecision(0) << replay->steps * MatchManager::TickDt / total << "x real time); "
+			<< matches.dispatched << " frames dispatched in " << std::setprecision(3) << dispatch_seconds << " s ("
+			<< std::setprecision(0) << matches.dispatched / dispatch_seconds << " frames/s, "
+			<< std::setprecision(1) << replay->bytes_received / dispatch_seconds / 1e6 << " MB/s), "
+			<< replay->steps << " steps in " << std::setprecision(3) << step_seconds << " s; "
+			<< replay->bytes_sent << " bytes sent, hash " << std::hex << replay->sent_hash << std::dec << std::endl;
+
+		if (replay->sent_hash != first_hash) {
+			std::cerr << "Run " << run + 1 << " sent different bytes than run 1; replay isn't deterministic." << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -1,159 +1,145 @@
 #include "Connection.hpp"
-#include "Game.hpp"
+#include "UdpConnection.hpp"
+#include "Match.hpp"
+#include "SpscQueue.hpp"
+#include "Recording.hpp"
 
 #include <iostream>
-#include <set>
+#include <fstream>
 #include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
 
+//Each worker thread runs its own event loop over a disjoint set of matches:
+struct Worker {
+	SpscQueue< SOCKET, 1024 > incoming; //sockets accepted by the main thread, waiting to be adopted
+	std::atomic< uint32_t > matches{0}; //(for status reporting)
+	std::atomic< uint32_t > connections{0};
+	std::string record_path; //if not empty, record this worker's matches here (see Recording.hpp)
+	std::thread thread;
+};
 
-#define DEBUG
-#ifdef DEBUG
-#define dbg_cout(...) std::cout << __VA_ARGS__ << std::endl;
-#else
-#define dbg_cout(...)
-#endif
+static void run_worker(Worker &worker, std::vector< std::unique_ptr< Worker > > const &workers) {
+	#ifdef __linux__
+	Server server(Server::Epoll);
+	#else
+	Server server(Server::Select);
+	#endif
+
+	MatchManager matches;
+
+	//each worker offers its players UDP on a port of its own (picked by the OS), so their datagrams
+	// arrive on the thread that hosts their match:
+	UdpServer udp("0");
+	matches.udp_port = udp.port();
+	if (matches.udp_port == 0) {
+		std::cerr << "[server] couldn't find this worker's UDP port; players will stay on TCP." << std::endl;
+	}
+
+	std::ofstream record_file;
+	std::unique_ptr< Recorder > recorder;
+	if (!worker.record_path.empty()) {
+		record_file.open(worker.record_path, std::ios::binary);
+		if (!record_file) {
+			std::cerr << "[server] couldn't open '" << worker.record_path << "' for recording; not recording." << std::endl;
+		} else {
+			recorder.reset(new Recorder(record_file));
+			matches.recorder = recorder.get();
+		}
+	}
+
+	auto on_event = [&](Connection *c, Connection::Event evt){
+		matches.on_event(c, evt);
+	};
+	auto on_udp_event = [&](UdpConnection *u, Connection::Event evt){
+		matches.on_udp_event(u, evt);
+	};
+
+	auto then = std::chrono::steady_clock::now();
+	while (1) {
+		SOCKET got;
+		while (worker.incoming.pop(&got)) {
+			Connection *c = server.adopt(got);
+			if (c) on_event(c, Connection::OnOpen);
+		}
+
+		//wait for messages until the next simulation step is due (but check for new sockets regularly):
+		server.poll(on_event, std::min(0.01f, matches.time_to_tick()));
+		//(inputs are only applied at the next step, so UDP can wait for TCP's poll)
+		udp.poll(on_udp_event);
+
+		//step matches at a fixed rate and get their States onto the wire right away:
+		auto now = std::chrono::steady_clock::now();
+		matches.update(std::chrono::duration< float >(now - then).count());
+		then = now;
+		server.flush();
+		udp.poll(on_udp_event); //(sends what's queued, too)
+
+		worker.matches.store(uint32_t(matches.active()), std::memory_order_relaxed);
+		worker.connections.store(uint32_t(server.connections.size()), std::memory_order_relaxed);
+
+		//every second or so, the first worker dumps the number of matches being hosted:
+		if (&worker == workers[0].get()) {
+			static auto then = std::chrono::steady_clock::now();
+			auto now = std::chrono::steady_clock::now();
+			if (now > then + std::chrono::seconds(1)) {
+				then = now;
+				uint32_t total_matches = 0;
+				uint32_t total_connections = 0;
+				for (auto const &w : workers) {
+					total_matches += w->matches.load(std::memory_order_relaxed);
+					total_connections += w->connections.load(std::memory_order_relaxed);
+				}
+				std::cout << "Matches: " << total_matches << " (" << total_connections << " connections, " << workers.size() << " workers)" << std::endl;
+			}
+		}
+	}
+}
 
 int main(int argc, char **argv) {
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	if (argc < 2 || argc > 4) {
+		std::cerr << "Usage:\n\t./server <port> [threads] [record prefix]\n"
+			"(with a record prefix, worker i records its matches to <prefix>.i.rec; play them back with ./replay)" << std::endl;
 		return 1;
 	}
 
-	Server server(argv[1]);
+	uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+	if (argc >= 3) {
+		threads = std::max(1, std::stoi(argv[2]));
+	}
 
-	Game state;
+	//the main thread only accepts connections, on a blocking listen socket:
+	Server listener(argv[1]);
 
-    bool hunter_is_on = false;
-    bool wolf_is_on = false;
+	std::vector< std::unique_ptr< Worker > > workers;
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.emplace_back(new Worker);
+		if (argc == 4) {
+			workers.back()->record_path = std::string(argv[3]) + "." + std::to_string(i) + ".rec";
+		}
+	}
+	for (auto &w : workers) {
+		Worker &worker = *w;
+		worker.thread = std::thread([&worker, &workers](){ run_worker(worker, workers); });
+	}
+	std::cout << "Running " << workers.size() << " worker threads." << std::endl;
 
+	//hand out connections two at a time, so that players who connect one
+	// after another land on the same worker and are paired into a match there:
+	uint64_t accepted = 0;
 	while (1) {
-		server.poll([&](Connection *c, Connection::Event evt){
-			if (evt == Connection::OnOpen) {
-			} else if (evt == Connection::OnClose) {
-            } else { assert(evt == Connection::OnRecv);
-                while (!c->recv_buffer.empty()) {
-                    if (!hunter_is_on || !wolf_is_on) {
-                        // do not send data until two players are registered
-                        if (c->recv_buffer[0] == 'h') {
-                            c->recv_buffer.clear();
-                            if (!hunter_is_on) {
-                                c->send("ih");
-                                hunter_is_on = true;
-                            } else if (!wolf_is_on) {
-                                server.connections.back().send("iw");
-                                wolf_is_on = true;
-                            }
-                        } else if (*(c->recv_buffer.begin()) == 'p' && c->recv_buffer.size() >= 10) {
-                            // ignore any data received before both of two players are registered
-                            // e.g. hunter starts sending data once activated
-                            c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                 c->recv_buffer.begin() + 10);
-                        } else if (*(c->recv_buffer.begin()) == 'l' && c->recv_buffer.size() >= 1 + 8) {
-                            size_t living_animal_size;
-                            memcpy(&living_animal_size, c->recv_buffer.data() + 1, sizeof(size_t));
-                            {  // init living_animal
-                                for (uint32_t id = 1; id <= living_animal_size; id++) {
-                                    state.living_animal.insert(id);
-                                }
-                            }
-                            c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                 c->recv_buffer.begin() + 1 + 8);
-                        }
-                    } else if (*(c->recv_buffer.begin()) == 'p') {
-                        // "pc" or "pw" for position of crosshair/wolf
-                        if (c->recv_buffer.size() < 2 * (sizeof(char) + sizeof(float))) {
-                            return;
-                        } else {
-                            if (*(c->recv_buffer.begin() + 1) == 'c') {
-                                memcpy(&state.crosshair.x, c->recv_buffer.data() + 2, sizeof(float));
-                                memcpy(&state.crosshair.y, c->recv_buffer.data() + 2 + sizeof(float), sizeof(float));
-                                c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                     c->recv_buffer.begin() + 10);
-
-                                // send crosshair position to wolf
-                                if (wolf_is_on) {
-                                    server.connections.back().send_raw("pc", 2);
-                                    server.connections.back().send_raw(&state.crosshair.x, sizeof(float));
-                                    server.connections.back().send_raw(&state.crosshair.y, sizeof(float));
-                                }
-                            } else if (*(c->recv_buffer.begin() + 1) == 'w') {
-                                memcpy(&state.wolf.x, c->recv_buffer.data() + 2, sizeof(float));
-                                memcpy(&state.wolf.y, c->recv_buffer.data() + 2 + sizeof(float), sizeof(float));
-                                c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                     c->recv_buffer.begin() + 10);
-
-                                // send wolf position to hunter
-                                if (hunter_is_on) {
-                                    server.connections.front().send_raw("pw", 2);
-                                    server.connections.front().send_raw(&state.wolf.x, sizeof(float));
-                                    server.connections.front().send_raw(&state.wolf.y, sizeof(float));
-                                }
-                            }
-                        }
-                    } else if (*(c->recv_buffer.begin()) == 'a') {
-                        if (c->recv_buffer.size() < 1 + sizeof(uint32_t)) {
-                            return;
-                        } else {
-                            uint32_t target;
-                            memcpy(&target, c->recv_buffer.data() + 1, sizeof(uint32_t));
-                            dbg_cout("Receive attack target id " << target);
-                            if (state.living_animal.count(target)) {
-                                if (hunter_is_on) {
-                                    dbg_cout("send attack target id " << target << " to hunter");
-                                    server.connections.front().send_raw("a", 1);
-                                    server.connections.front().send_raw(&target, sizeof(uint32_t));
-                                }
-                                if (wolf_is_on) {
-                                    dbg_cout("send attack target id " << target << " to wolf");
-                                    server.connections.back().send_raw("a", 1);
-                                    server.connections.back().send_raw(&target, sizeof(uint32_t));
-                                }
-                                state.living_animal.erase(target);
-                                dbg_cout("# of living_animal " << state.living_animal.size());
-                            }
-                            c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                 c->recv_buffer.begin() + 1 + sizeof(uint32_t));
-                        }
-                    } else if (*(c->recv_buffer.begin()) == 'd') {
-                        if (c->recv_buffer.size() < 1 + 2 * sizeof(uint32_t)) {
-                            return;
-                        } else {
-                            uint32_t id, direction;
-                            memcpy(&id, c->recv_buffer.data() + 1, sizeof(uint32_t));
-                            memcpy(&direction, c->recv_buffer.data() + 1 + sizeof(uint32_t), sizeof(uint32_t));
-                            if (hunter_is_on) {
-                                server.connections.front().send_raw("d", 1);
-                                server.connections.front().send_raw(&id, sizeof(float));
-                                server.connections.front().send_raw(&direction, sizeof(float));
-                            }
-                            c->recv_buffer.erase(c->recv_buffer.begin(),
-                                                 c->recv_buffer.begin() + 1 + 2 * sizeof(uint32_t));
-                        }
-                    } else if (*(c->recv_buffer.begin()) == 'c') {  // wolf change skin
-                        if (hunter_is_on) {
-                            server.connections.front().send_raw("c", 1);
-                        }
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 1);
-                    } else if (*(c->recv_buffer.begin()) == 's') {  // hunter fires
-                        if (wolf_is_on) {
-                            server.connections.back().send_raw("s", 1);
-                        }
-                        c->recv_buffer.erase(c->recv_buffer.begin(),
-                                             c->recv_buffer.begin() + 1);
-                    }
-
-                }  // end while
-			}  // end else
-        }, 0.01);
-
-
-		//every second or so, dump the current paddle position:
-		static auto then = std::chrono::steady_clock::now();
-		auto now = std::chrono::steady_clock::now();
-		if (now > then + std::chrono::seconds(1)) {
-			then = now;
-			std::cout << "Current paddle position: " << state.paddle.x << std::endl;
+		SOCKET got = accept(listener.listen_socket, NULL, NULL);
+		if (got == INVALID_SOCKET) {
+			std::cerr << "[server] accept() failed; continuing." << std::endl;
+			continue;
+		}
+		Worker &worker = *workers[(accepted / 2) % workers.size()];
+		while (!worker.incoming.push(got)) {
+			std::this_thread::yield();
 		}
+		accepted += 1;
 	}
 }
@@ -0,0 +1,62 @@
+#include "vertex_color_instanced_program.hpp"
+
+#include "compile_program.hpp"
+
+VertexColorInstancedProgram::VertexColorInstancedProgram() {
+	program = compile_program(
+		"#version 330\n"
+		"uniform mat4 world_to_clip;\n"
+		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in mat4x3 InstanceToWorld;\n" //per instance
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"void main() {\n"
+		"	position = InstanceToWorld * Position;\n" //(lighting is done in world space)
+		"	gl_Position = world_to_clip * vec4(position, 1.0);\n"
+		"	normal = mat3(InstanceToWorld) * Normal;\n" //(no scale, so this is also the inverse transpose)
+		"	color = Color;\n"
+		"}\n"
+		,
+		//(same as VertexColorProgram's)
+		"#version 330\n"
+		"uniform vec3 sun_direction;\n"
+		"uniform vec3 sun_color;\n"
+		"uniform vec3 sky_direction;\n"
+		"uniform vec3 sky_color;\n"
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec4 color;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	vec3 total_light = vec3(0.0, 0.0, 0.0);\n"
+		"	vec3 n = normalize(normal);\n"
+		"	{ //sky (hemisphere) light:\n"
+		"		vec3 l = sky_direction;\n"
+		"		float nl = 0.5 + 0.5 * dot(n,l);\n"
+		"		total_light += nl * sky_color;\n"
+		"	}\n"
+		"	{ //sun (directional) light:\n"
+		"		vec3 l = sun_direction;\n"
+		"		float nl = max(0.0, dot(n,l));\n"
+		"		total_light += nl * sun_color;\n"
+		"	}\n"
+		"	fragColor = vec4(color.rgb * total_light, color.a);\n"
+		"}\n"
+	);
+
+	instance_to_world_mat4x3 = glGetAttribLocation(program, "InstanceToWorld");
+
+	world_to_clip_mat4 = glGetUniformLocation(program, "world_to_clip");
+
+	sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
+	sun_color_vec3 = glGetUniformLocation(program, "sun_color");
+	sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
+	sky_color_vec3 = glGetUniformLocation(program, "sky_color");
+}
+
+Load< VertexColorInstancedProgram > vertex_color_instanced_program(LoadTagInit, [](){
+	return new VertexColorInstancedProgram();
+});
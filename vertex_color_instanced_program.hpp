@@ -0,0 +1,24 @@
+#include "GL.hpp"
+#include "Load.hpp"
+
+//Like VertexColorProgram, but for drawing many copies of a mesh with one glDrawArraysInstanced:
+// each instance's object-to-world matrix comes from the per-instance 'InstanceToWorld' attribute
+// (a mat4x3 -- four vec3 attribute locations, starting at instance_to_world), and must not scale.
+struct VertexColorInstancedProgram {
+	//opengl program object:
+	GLuint program = 0;
+
+	//attribute locations:
+	GLuint instance_to_world_mat4x3 = -1U;
+
+	//uniform locations:
+	GLuint world_to_clip_mat4 = -1U;
+	GLuint sun_direction_vec3 = -1U;
+	GLuint sun_color_vec3 = -1U;
+	GLuint sky_direction_vec3 = -1U;
+	GLuint sky_color_vec3 = -1U;
+
+	VertexColorInstancedProgram();
+};
+
+extern Load< VertexColorInstancedProgram > vertex_color_instanced_program;